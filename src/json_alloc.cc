@@ -0,0 +1,69 @@
+#include "json_alloc.h"
+#include <cstdlib>
+
+namespace {
+
+class JsonMallocAllocator final : public JsonAllocator {
+public:
+    void* allocate(size_t size) override {
+        return malloc(size);
+    }
+    void deallocate(void* ptr, size_t) override {
+        free(ptr);
+    }
+};
+
+}
+
+JsonAllocator& json_default_allocator() {
+    static JsonMallocAllocator allocator;
+    return allocator;
+}
+
+JsonCountingAllocator::JsonCountingAllocator(size_t budget, JsonAllocator& upstream)
+    : upstream(upstream), budget(budget) {}
+
+void* JsonCountingAllocator::allocate(size_t size) {
+    void* ptr = size <= this->budget - this->bytes ? this->upstream.allocate(size) : nullptr;
+    if (ptr == nullptr) {
+        this->failures++;
+        return nullptr;
+    }
+    this->allocations++;
+    this->bytes += size;
+    if (this->bytes > this->peak_bytes) {
+        this->peak_bytes = this->bytes;
+    }
+    return ptr;
+}
+
+void JsonCountingAllocator::deallocate(void* ptr, size_t size) {
+    this->deallocations++;
+    this->bytes -= size;
+    this->upstream.deallocate(ptr, size);
+}
+
+size_t JsonCountingAllocator::get_bytes() const {
+    return this->bytes;
+}
+
+size_t JsonCountingAllocator::get_peak_bytes() const {
+    return this->peak_bytes;
+}
+
+size_t JsonCountingAllocator::get_allocations() const {
+    return this->allocations;
+}
+
+size_t JsonCountingAllocator::get_deallocations() const {
+    return this->deallocations;
+}
+
+size_t JsonCountingAllocator::get_failures() const {
+    return this->failures;
+}
+
+//Starts a new peak measurement from the bytes live now.
+void JsonCountingAllocator::reset_peak() {
+    this->peak_bytes = this->bytes;
+}
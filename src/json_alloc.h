@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//Allocator hooks for parsed nodes. Pass one in JsonParseOptions and every
+//node of that parse comes from it; each node remembers its allocator and
+//gives itself back to it when freed. Returning nullptr from allocate fails
+//the parse with JSON_PARSE_OUT_OF_MEMORY. String and container buffers
+//still use the standard allocator; json_memory_stats reports them.
+class JsonAllocator {
+public:
+    virtual ~JsonAllocator() = default;
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+};
+
+//malloc and free.
+JsonAllocator& json_default_allocator();
+
+//Counts the calls and bytes that pass through it to upstream and refuses
+//any allocation that would take the live bytes over budget. One instance
+//per request gives that request's peak and enforces its budget; it is not
+//thread-safe.
+class JsonCountingAllocator final : public JsonAllocator {
+public:
+    explicit JsonCountingAllocator(size_t budget = SIZE_MAX, JsonAllocator& upstream = json_default_allocator());
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr, size_t size) override;
+    size_t get_bytes() const;
+    size_t get_peak_bytes() const;
+    size_t get_allocations() const;
+    size_t get_deallocations() const;
+    size_t get_failures() const;
+    void reset_peak();
+
+private:
+    JsonAllocator& upstream;
+    size_t budget;
+    size_t bytes = 0;
+    size_t peak_bytes = 0;
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t failures = 0;
+};
@@ -0,0 +1,131 @@
+#include "json_batch.h"
+#include <algorithm>
+#include <cassert>
+
+JsonBatch::JsonBatch(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 1; i < threads; i++) {
+        this->workers.emplace_back(&JsonBatch::run, this);
+    }
+}
+
+JsonBatch::~JsonBatch() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stop = true;
+    }
+    this->wake.notify_all();
+    for (auto& worker : this->workers) {
+        worker.join();
+    }
+}
+
+//Worker threads, plus the calling thread.
+int JsonBatch::get_thread_count() const {
+    return this->workers.size() + 1;
+}
+
+int JsonBatch::parse(const char* const* documents, size_t count) {
+    return this->parse(documents, count, JsonParseOptions());
+}
+
+//Returns JSON_PARSE_OK if every document parsed, otherwise the error of the
+//first document that failed; get_result has each document's own code.
+int JsonBatch::parse(const char* const* documents, size_t count, const JsonParseOptions& options) {
+    //Slots past this call's documents are freed, so a batch holds the trees
+    //of its latest call rather than of its largest one.
+    this->slots.resize(std::min(this->slots.size(), count));
+    while (this->slots.size() < count) {
+        this->slots.emplace_back(new JsonDocument());
+    }
+    this->results.assign(count, JSON_PARSE_OK);
+    this->documents = documents;
+    this->count = count;
+    this->options = options;
+    //Runs short enough to balance uneven documents, long enough that the
+    //shared counter is not contended.
+    this->chunk = std::min<size_t>(64, std::max<size_t>(1, count / (this->get_thread_count() * 8)));
+    this->next.store(0, std::memory_order_relaxed);
+    if (this->workers.empty() || count <= this->chunk) {
+        this->work();
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->busy = this->workers.size();
+            this->generation++;
+        }
+        this->wake.notify_all();
+        this->work();
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->done.wait(lock, [this]() { return this->busy == 0; });
+    }
+    for (int result : this->results) {
+        if (result != JSON_PARSE_OK) {
+            return result;
+        }
+    }
+    return JSON_PARSE_OK;
+}
+
+int JsonBatch::parse(const std::vector<std::string>& documents) {
+    this->pointers.clear();
+    for (const auto& document : documents) {
+        this->pointers.push_back(document.c_str());
+    }
+    return this->parse(this->pointers.data(), this->pointers.size());
+}
+
+size_t JsonBatch::get_size() const {
+    return this->count;
+}
+
+int JsonBatch::get_result(size_t index) const {
+    assert(index < this->count);
+    return this->results[index];
+}
+
+JsonNode& JsonBatch::get_root(size_t index) {
+    assert(index < this->count);
+    return this->slots[index]->get_root();
+}
+
+const JsonNode& JsonBatch::get_root(size_t index) const {
+    assert(index < this->count);
+    return this->slots[index]->get_root();
+}
+
+//Waits for each call and joins in until the documents run out.
+void JsonBatch::run() {
+    unsigned long seen = 0;
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true) {
+        this->wake.wait(lock, [&]() { return this->stop || this->generation != seen; });
+        if (this->stop) {
+            return;
+        }
+        seen = this->generation;
+        lock.unlock();
+        this->work();
+        lock.lock();
+        if (--this->busy == 0) {
+            this->done.notify_one();
+        }
+    }
+}
+
+//Claims runs of documents until none are left. Every document has its own
+//slot and result, so the threads share nothing else.
+void JsonBatch::work() {
+    while (true) {
+        size_t begin = this->next.fetch_add(this->chunk, std::memory_order_relaxed);
+        if (begin >= this->count) {
+            return;
+        }
+        size_t end = std::min(begin + this->chunk, this->count);
+        for (size_t i = begin; i < end; i++) {
+            this->results[i] = this->slots[i]->parse(this->documents[i], this->options);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "json_document.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//Parses many independent documents at once. The worker threads live as
+//long as the batch, and the calling thread works alongside them, so a call
+//costs one wake-up rather than a thread start. Threads claim documents in
+//small runs from a shared counter, which keeps them all busy when some
+//documents are slower than others.
+//
+//Result i always belongs to document i. Each slot is a JsonDocument kept
+//from one call to the next, so a consumer parsing batches of same-shape
+//messages reuses the previous batch's nodes and buffers; a smaller batch
+//frees the slots it does not use. Trees are valid until the next parse.
+//An allocator given in the options is shared by all threads and must be
+//thread-safe.
+class JsonBatch final {
+public:
+    explicit JsonBatch(int threads = 0);//0 is one per hardware thread
+    JsonBatch(const JsonBatch& batch) = delete;
+    JsonBatch& operator=(const JsonBatch& batch) = delete;
+    ~JsonBatch();
+    int get_thread_count() const;
+    int parse(const char* const* documents, size_t count);
+    int parse(const char* const* documents, size_t count, const JsonParseOptions& options);
+    int parse(const std::vector<std::string>& documents);
+    size_t get_size() const;
+    int get_result(size_t index) const;
+    JsonNode& get_root(size_t index);
+    const JsonNode& get_root(size_t index) const;
+
+private:
+    void run();
+    void work();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long generation = 0;//bumped for every call the workers join
+    int busy = 0;//workers still on the current call
+    bool stop = false;
+
+    //The current call.
+    const char* const* documents = nullptr;
+    size_t count = 0;
+    size_t chunk = 1;
+    JsonParseOptions options;
+    std::atomic<size_t> next{0};
+
+    std::vector<std::unique_ptr<JsonDocument>> slots;
+    std::vector<int> results;
+    std::vector<const char*> pointers;//for parse(const std::vector<std::string>&)
+};
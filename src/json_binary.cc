@@ -0,0 +1,659 @@
+#include "json_binary.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+static bool JsonBinary_is_utf8(const std::string& str) {
+    size_t i = 0;
+    size_t size = str.size();
+    while (i < size) {
+        unsigned char ch = str[i];
+        int n = ch < 0x80 ? 0 : (ch & 0xE0) == 0xC0 ? 1 : (ch & 0xF0) == 0xE0 ? 2 : (ch & 0xF8) == 0xF0 ? 3 : -1;
+        if (n < 0 || size - i <= (size_t) n) {
+            return false;
+        }
+        for (int k = 1; k <= n; k++) {
+            if (((unsigned char) str[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+//Integral doubles that fit in 64 bits are encoded as integers.
+static bool JsonBinary_integer(double num, int64_t* i) {
+    if (num != num || num < -9223372036854775808.0 || num >= 9223372036854775808.0 || (num == 0 && std::signbit(num))) {
+        return false;
+    }
+    *i = (int64_t) num;
+    return (double) *i == num;
+}
+
+static void JsonBinary_put_be(std::string& out, uint64_t v, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back((char) ((v >> shift) & 0xFF));
+    }
+}
+
+static uint64_t JsonBinary_get_be(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static double JsonBinary_half(uint16_t h) {
+    int exp = (h >> 10) & 0x1F;
+    int mant = h & 0x3FF;
+    double val = exp == 0 ? ldexp(mant, -24) : exp != 31 ? ldexp(mant + 1024, exp - 25) : mant == 0 ? INFINITY : NAN;
+    return (h & 0x8000) ? -val : val;
+}
+
+//Writes a float32 or float64 with the given prefix bytes.
+static void JsonBinary_put_float(std::string& out, double num, char f32, char f64) {
+    float f = (float) num;
+    if ((double) f == num) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        out.push_back(f32);
+        JsonBinary_put_be(out, bits, 4);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &num, sizeof(bits));
+        out.push_back(f64);
+        JsonBinary_put_be(out, bits, 8);
+    }
+}
+
+static void JsonCbor_head(std::string& out, int major, uint64_t v) {
+    char m = (char) (major << 5);
+    if (v < 24) {
+        out.push_back(m | (char) v);
+    } else if (v <= 0xFF) {
+        out.push_back(m | 24);
+        JsonBinary_put_be(out, v, 1);
+    } else if (v <= 0xFFFF) {
+        out.push_back(m | 25);
+        JsonBinary_put_be(out, v, 2);
+    } else if (v <= 0xFFFFFFFF) {
+        out.push_back(m | 26);
+        JsonBinary_put_be(out, v, 4);
+    } else {
+        out.push_back(m | 27);
+        JsonBinary_put_be(out, v, 8);
+    }
+}
+
+static void JsonCbor_string(std::string& out, const std::string& str) {
+    JsonCbor_head(out, JsonBinary_is_utf8(str) ? 3 : 2, str.size());
+    out += str;
+}
+
+static void JsonCbor_number(std::string& out, double num) {
+    int64_t i;
+    if (JsonBinary_integer(num, &i)) {
+        i >= 0 ? JsonCbor_head(out, 0, (uint64_t) i) : JsonCbor_head(out, 1, (uint64_t) (-1 - i));
+    } else {
+        JsonBinary_put_float(out, num, (char) 0xFA, (char) 0xFB);
+    }
+}
+
+void json_to_cbor(const JsonNode* node, std::string& out) {
+    switch (node->get_type()) {
+        case JSON_TYPE_NULL:
+            out.push_back((char) 0xF6);
+            break;
+        case JSON_TYPE_TRUE:
+            out.push_back((char) 0xF5);
+            break;
+        case JSON_TYPE_FALSE:
+            out.push_back((char) 0xF4);
+            break;
+        case JSON_TYPE_NUMBER:
+            JsonCbor_number(out, node->get_number());
+            break;
+        case JSON_TYPE_STRING:
+            JsonCbor_string(out, node->get_string());
+            break;
+        case JSON_TYPE_ARRAY:
+            JsonCbor_head(out, 4, node->get_array_size());
+            if (node->is_packed_array()) {
+                for (int k = 0; k < node->get_array_size(); k++) {
+                    JsonCbor_number(out, node->get_packed_array()[k]);
+                }
+                break;
+            }
+            for (const JsonNode& element : node->elements()) {
+                json_to_cbor(&element, out);
+            }
+            break;
+        case JSON_TYPE_OBJECT:
+            JsonCbor_head(out, 5, node->get_object_size());
+            for (auto member : node->members()) {
+                JsonCbor_string(out, member.key);
+                json_to_cbor(&member.value, out);
+            }
+            break;
+    }
+}
+
+//Decoders recurse once per level, and their input comes off the wire, so
+//nesting is always bounded even when max_depth is not.
+static const int JsonBinary_max_depth = 1024;
+
+class JsonCborReader final {
+public:
+    JsonCborReader(const char* data, size_t size, int max_depth)
+        : p((const unsigned char*) data), end((const unsigned char*) data + size),
+          max_depth(std::min(max_depth, JsonBinary_max_depth)) {}
+    int parse(JsonNode* node);
+
+private:
+    int parse_head(int* major, int* info, uint64_t* v);
+    int parse_string(int major, int info, uint64_t v, std::string& str);
+    int parse_value(JsonNode* node);
+    const unsigned char* p;
+    const unsigned char* end;
+    int max_depth;
+    int depth = 0;//arrays, maps and tags being decoded
+};
+
+int JsonCborReader::parse_head(int* major, int* info, uint64_t* v) {
+    if (p == end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    *major = *p >> 5;
+    *info = *p & 0x1F;
+    p++;
+    if (*info < 24) {
+        *v = *info;
+    } else if (*info <= 27) {
+        int bytes = 1 << (*info - 24);
+        if (end - p < bytes) {
+            return JSON_PARSE_EXPECT_VALUE;
+        }
+        *v = JsonBinary_get_be(p, bytes);
+        p += bytes;
+    } else if (*info == 31 && *major >= 2 && *major <= 5) {
+        *v = 0;//indefinite length
+    } else if (*major != 7) {
+        return JSON_PARSE_INVALID_VALUE;
+    }
+    return JSON_PARSE_OK;
+}
+
+int JsonCborReader::parse_string(int major, int info, uint64_t v, std::string& str) {
+    int ret;
+    if (info != 31) {
+        if ((uint64_t) (end - p) < v) {
+            return JSON_PARSE_EXPECT_VALUE;
+        }
+        str.append((const char*) p, v);
+        p += v;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        if (p == end) {
+            return JSON_PARSE_EXPECT_VALUE;
+        }
+        if (*p == 0xFF) {
+            p++;
+            return JSON_PARSE_OK;
+        }
+        int chunk_major, chunk_info;
+        if ((ret = parse_head(&chunk_major, &chunk_info, &v)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        if (chunk_major != major || chunk_info == 31) {
+            return JSON_PARSE_INVALID_VALUE;
+        }
+        if ((ret = parse_string(major, chunk_info, v, str)) != JSON_PARSE_OK) {
+            return ret;
+        }
+    }
+}
+
+int JsonCborReader::parse_value(JsonNode* node) {
+    int major, info, ret;
+    uint64_t v;
+    if ((ret = parse_head(&major, &info, &v)) != JSON_PARSE_OK) {
+        return ret;
+    }
+    switch (major) {
+        case 0:
+            node->set_number((double) v);
+            return JSON_PARSE_OK;
+        case 1:
+            node->set_number(-1.0 - (double) v);
+            return JSON_PARSE_OK;
+        case 2:
+        case 3: {
+            std::string str;
+            if ((ret = parse_string(major, info, v, str)) == JSON_PARSE_OK) {
+                node->set_string(str);
+            }
+            return ret;
+        }
+        case 4:
+            if (depth >= max_depth) {
+                return JSON_PARSE_TOO_DEEP;
+            }
+            depth++;
+            node->set_array();
+            for (uint64_t i = 0; info == 31 || i < v; i++) {
+                if (info == 31 && p < end && *p == 0xFF) {
+                    p++;
+                    break;
+                }
+                auto n = new JsonNode();
+                n->json_init();
+                node->pushback_array_element(n);
+                if ((ret = parse_value(n)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+            }
+            depth--;
+            return JSON_PARSE_OK;
+        case 5: {
+            std::string key;
+            if (depth >= max_depth) {
+                return JSON_PARSE_TOO_DEEP;
+            }
+            depth++;
+            node->set_object();
+            for (uint64_t i = 0; info == 31 || i < v; i++) {
+                if (info == 31 && p < end && *p == 0xFF) {
+                    p++;
+                    break;
+                }
+                int key_major, key_info;
+                uint64_t key_v;
+                if ((ret = parse_head(&key_major, &key_info, &key_v)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+                if (key_major != 2 && key_major != 3) {
+                    return JSON_PARSE_NOT_EXIST_KEY;
+                }
+                key.clear();
+                if ((ret = parse_string(key_major, key_info, key_v, key)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+                auto n = new JsonNode();
+                n->json_init();
+                node->pushback_object_element(key, n);
+                if ((ret = parse_value(n)) != JSON_PARSE_OK) {
+                    return ret;
+                }
+            }
+            depth--;
+            return JSON_PARSE_OK;
+        }
+        case 6://tags carry no meaning for JSON, decode the tagged item
+            if (depth >= max_depth) {
+                return JSON_PARSE_TOO_DEEP;
+            }
+            depth++;
+            ret = parse_value(node);
+            depth--;
+            return ret;
+        default:
+            switch (info) {
+                case 20:
+                    node->set_bool(false);
+                    return JSON_PARSE_OK;
+                case 21:
+                    node->set_bool(true);
+                    return JSON_PARSE_OK;
+                case 22:
+                case 23:
+                    node->set_null();
+                    return JSON_PARSE_OK;
+                case 25:
+                    node->set_number(JsonBinary_half((uint16_t) v));
+                    return JSON_PARSE_OK;
+                case 26: {
+                    float f;
+                    uint32_t bits = (uint32_t) v;
+                    memcpy(&f, &bits, sizeof(f));
+                    node->set_number(f);
+                    return JSON_PARSE_OK;
+                }
+                case 27: {
+                    double d;
+                    memcpy(&d, &v, sizeof(d));
+                    node->set_number(d);
+                    return JSON_PARSE_OK;
+                }
+                default:
+                    return JSON_PARSE_INVALID_VALUE;
+            }
+    }
+}
+
+int JsonCborReader::parse(JsonNode* node) {
+    int ret = parse_value(node);
+    if (ret == JSON_PARSE_OK && p != end) {
+        ret = JSON_PARSE_NOT_SINGLE_VALUE;
+    }
+    if (ret != JSON_PARSE_OK) {
+        node->set_null();
+    }
+    return ret;
+}
+
+int json_from_cbor(const char* data, size_t size, JsonNode* node) {
+    return json_from_cbor(data, size, node, JsonParseOptions());
+}
+
+//Only max_depth applies.
+int json_from_cbor(const char* data, size_t size, JsonNode* node, const JsonParseOptions& options) {
+    JsonCborReader r(data, size, options.max_depth);
+    node->json_init();
+    return r.parse(node);
+}
+
+static void JsonMsgpack_length(std::string& out, uint64_t n, int fix, int fix_max, char c8, char c16, char c32) {
+    if (fix >= 0 && n <= (uint64_t) fix_max) {
+        out.push_back((char) (fix | n));
+    } else if (c8 != 0 && n <= 0xFF) {
+        out.push_back(c8);
+        JsonBinary_put_be(out, n, 1);
+    } else if (n <= 0xFFFF) {
+        out.push_back(c16);
+        JsonBinary_put_be(out, n, 2);
+    } else {
+        out.push_back(c32);
+        JsonBinary_put_be(out, n, 4);
+    }
+}
+
+static void JsonMsgpack_string(std::string& out, const std::string& str) {
+    if (JsonBinary_is_utf8(str)) {
+        JsonMsgpack_length(out, str.size(), 0xA0, 31, (char) 0xD9, (char) 0xDA, (char) 0xDB);
+    } else {
+        JsonMsgpack_length(out, str.size(), -1, 0, (char) 0xC4, (char) 0xC5, (char) 0xC6);
+    }
+    out += str;
+}
+
+static void JsonMsgpack_integer(std::string& out, int64_t i) {
+    if (i >= 0) {
+        if (i < 128) {
+            out.push_back((char) i);
+        } else if (i <= 0xFF) {
+            out.push_back((char) 0xCC);
+            JsonBinary_put_be(out, i, 1);
+        } else if (i <= 0xFFFF) {
+            out.push_back((char) 0xCD);
+            JsonBinary_put_be(out, i, 2);
+        } else if (i <= 0xFFFFFFFFLL) {
+            out.push_back((char) 0xCE);
+            JsonBinary_put_be(out, i, 4);
+        } else {
+            out.push_back((char) 0xCF);
+            JsonBinary_put_be(out, i, 8);
+        }
+    } else if (i >= -32) {
+        out.push_back((char) i);
+    } else if (i >= -128) {
+        out.push_back((char) 0xD0);
+        JsonBinary_put_be(out, (uint64_t) i, 1);
+    } else if (i >= -32768) {
+        out.push_back((char) 0xD1);
+        JsonBinary_put_be(out, (uint64_t) i, 2);
+    } else if (i >= -2147483648LL) {
+        out.push_back((char) 0xD2);
+        JsonBinary_put_be(out, (uint64_t) i, 4);
+    } else {
+        out.push_back((char) 0xD3);
+        JsonBinary_put_be(out, (uint64_t) i, 8);
+    }
+}
+
+static void JsonMsgpack_number(std::string& out, double num) {
+    int64_t i;
+    if (JsonBinary_integer(num, &i)) {
+        JsonMsgpack_integer(out, i);
+    } else {
+        JsonBinary_put_float(out, num, (char) 0xCA, (char) 0xCB);
+    }
+}
+
+void json_to_msgpack(const JsonNode* node, std::string& out) {
+    switch (node->get_type()) {
+        case JSON_TYPE_NULL:
+            out.push_back((char) 0xC0);
+            break;
+        case JSON_TYPE_TRUE:
+            out.push_back((char) 0xC3);
+            break;
+        case JSON_TYPE_FALSE:
+            out.push_back((char) 0xC2);
+            break;
+        case JSON_TYPE_NUMBER:
+            JsonMsgpack_number(out, node->get_number());
+            break;
+        case JSON_TYPE_STRING:
+            JsonMsgpack_string(out, node->get_string());
+            break;
+        case JSON_TYPE_ARRAY:
+            JsonMsgpack_length(out, node->get_array_size(), 0x90, 15, 0, (char) 0xDC, (char) 0xDD);
+            if (node->is_packed_array()) {
+                for (int k = 0; k < node->get_array_size(); k++) {
+                    JsonMsgpack_number(out, node->get_packed_array()[k]);
+                }
+                break;
+            }
+            for (const JsonNode& element : node->elements()) {
+                json_to_msgpack(&element, out);
+            }
+            break;
+        case JSON_TYPE_OBJECT:
+            JsonMsgpack_length(out, node->get_object_size(), 0x80, 15, 0, (char) 0xDE, (char) 0xDF);
+            for (auto member : node->members()) {
+                JsonMsgpack_string(out, member.key);
+                json_to_msgpack(&member.value, out);
+            }
+            break;
+    }
+}
+
+class JsonMsgpackReader final {
+public:
+    JsonMsgpackReader(const char* data, size_t size, int max_depth)
+        : p((const unsigned char*) data), end((const unsigned char*) data + size),
+          max_depth(std::min(max_depth, JsonBinary_max_depth)) {}
+    int parse(JsonNode* node);
+
+private:
+    int read(int bytes, uint64_t* v);
+    int parse_string(uint64_t length, std::string& str);
+    int parse_key(std::string& key);
+    int parse_value(JsonNode* node);
+    const unsigned char* p;
+    const unsigned char* end;
+    int max_depth;
+    int depth = 0;//arrays, maps and tags being decoded
+};
+
+int JsonMsgpackReader::read(int bytes, uint64_t* v) {
+    if (end - p < bytes) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    *v = JsonBinary_get_be(p, bytes);
+    p += bytes;
+    return JSON_PARSE_OK;
+}
+
+int JsonMsgpackReader::parse_string(uint64_t length, std::string& str) {
+    if ((uint64_t) (end - p) < length) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    str.assign((const char*) p, length);
+    p += length;
+    return JSON_PARSE_OK;
+}
+
+int JsonMsgpackReader::parse_key(std::string& key) {
+    uint64_t length;
+    int ret = JSON_PARSE_OK;
+    if (p == end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    unsigned char c = *p++;
+    if ((c & 0xE0) == 0xA0) {
+        length = c & 0x1F;
+    } else if (c == 0xD9 || c == 0xC4) {
+        ret = read(1, &length);
+    } else if (c == 0xDA || c == 0xC5) {
+        ret = read(2, &length);
+    } else if (c == 0xDB || c == 0xC6) {
+        ret = read(4, &length);
+    } else {
+        return JSON_PARSE_NOT_EXIST_KEY;
+    }
+    if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    return parse_string(length, key);
+}
+
+int JsonMsgpackReader::parse_value(JsonNode* node) {
+    uint64_t v = 0, count;
+    int ret = JSON_PARSE_OK;
+    if (p == end) {
+        return JSON_PARSE_EXPECT_VALUE;
+    }
+    unsigned char c = *p++;
+    if (c < 0x80 || c >= 0xE0) {
+        node->set_number((double) (int8_t) c);
+        return JSON_PARSE_OK;
+    }
+    if ((c & 0xE0) == 0xA0 || (c >= 0xC4 && c <= 0xC6) || (c >= 0xD9 && c <= 0xDB)) {
+        std::string str;
+        p--;
+        if ((ret = parse_key(str)) == JSON_PARSE_OK) {
+            node->set_string(str);
+        }
+        return ret;
+    }
+    if ((c & 0xF0) == 0x90 || c == 0xDC || c == 0xDD) {
+        count = c & 0x0F;
+        if (c != (0x90 | count) && (ret = read(c == 0xDC ? 2 : 4, &count)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        if (depth >= max_depth) {
+            return JSON_PARSE_TOO_DEEP;
+        }
+        depth++;
+        node->set_array();
+        for (uint64_t i = 0; i < count; i++) {
+            auto n = new JsonNode();
+            n->json_init();
+            node->pushback_array_element(n);
+            if ((ret = parse_value(n)) != JSON_PARSE_OK) {
+                return ret;
+            }
+        }
+        depth--;
+        return JSON_PARSE_OK;
+    }
+    if ((c & 0xF0) == 0x80 || c == 0xDE || c == 0xDF) {
+        std::string key;
+        count = c & 0x0F;
+        if (c != (0x80 | count) && (ret = read(c == 0xDE ? 2 : 4, &count)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        if (depth >= max_depth) {
+            return JSON_PARSE_TOO_DEEP;
+        }
+        depth++;
+        node->set_object();
+        for (uint64_t i = 0; i < count; i++) {
+            if ((ret = parse_key(key)) != JSON_PARSE_OK) {
+                return ret;
+            }
+            auto n = new JsonNode();
+            n->json_init();
+            node->pushback_object_element(key, n);
+            if ((ret = parse_value(n)) != JSON_PARSE_OK) {
+                return ret;
+            }
+        }
+        depth--;
+        return JSON_PARSE_OK;
+    }
+    switch (c) {
+        case 0xC0:
+            node->set_null();
+            return JSON_PARSE_OK;
+        case 0xC2:
+            node->set_bool(false);
+            return JSON_PARSE_OK;
+        case 0xC3:
+            node->set_bool(true);
+            return JSON_PARSE_OK;
+        case 0xCA:
+            if ((ret = read(4, &v)) == JSON_PARSE_OK) {
+                float f;
+                uint32_t bits = (uint32_t) v;
+                memcpy(&f, &bits, sizeof(f));
+                node->set_number(f);
+            }
+            return ret;
+        case 0xCB:
+            if ((ret = read(8, &v)) == JSON_PARSE_OK) {
+                double d;
+                memcpy(&d, &v, sizeof(d));
+                node->set_number(d);
+            }
+            return ret;
+        case 0xCC:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+            if ((ret = read(1 << (c - 0xCC), &v)) == JSON_PARSE_OK) {
+                node->set_number((double) v);
+            }
+            return ret;
+        case 0xD0:
+        case 0xD1:
+        case 0xD2:
+        case 0xD3: {
+            int bytes = 1 << (c - 0xD0);
+            if ((ret = read(bytes, &v)) == JSON_PARSE_OK) {
+                int shift = 64 - bytes * 8;
+                node->set_number((double) ((int64_t) (v << shift) >> shift));
+            }
+            return ret;
+        }
+        default:
+            return JSON_PARSE_INVALID_VALUE;
+    }
+}
+
+int JsonMsgpackReader::parse(JsonNode* node) {
+    int ret = parse_value(node);
+    if (ret == JSON_PARSE_OK && p != end) {
+        ret = JSON_PARSE_NOT_SINGLE_VALUE;
+    }
+    if (ret != JSON_PARSE_OK) {
+        node->set_null();
+    }
+    return ret;
+}
+
+int json_from_msgpack(const char* data, size_t size, JsonNode* node) {
+    return json_from_msgpack(data, size, node, JsonParseOptions());
+}
+
+//Only max_depth applies.
+int json_from_msgpack(const char* data, size_t size, JsonNode* node, const JsonParseOptions& options) {
+    JsonMsgpackReader r(data, size, options.max_depth);
+    node->json_init();
+    return r.parse(node);
+}
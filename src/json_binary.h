@@ -0,0 +1,16 @@
+#pragma once
+#include "tiny_json.h"
+
+//CBOR (RFC 8949) and MessagePack encodings of a JsonNode tree.
+//Integral numbers are written as integers and other numbers as the
+//narrowest float that holds them exactly. Strings that are not valid
+//UTF-8 are written as byte strings, so arbitrary bytes round-trip.
+//Decoding returns JSON_PARSE_* codes. Arrays, maps and CBOR tags nested
+//deeper than options.max_depth, or than 1024 levels in any case, give
+//JSON_PARSE_TOO_DEEP.
+void json_to_cbor(const JsonNode* node, std::string& out);
+int json_from_cbor(const char* data, size_t size, JsonNode* node);
+int json_from_cbor(const char* data, size_t size, JsonNode* node, const JsonParseOptions& options);
+void json_to_msgpack(const JsonNode* node, std::string& out);
+int json_from_msgpack(const char* data, size_t size, JsonNode* node);
+int json_from_msgpack(const char* data, size_t size, JsonNode* node, const JsonParseOptions& options);
@@ -0,0 +1,221 @@
+#pragma once
+#include "json_reader.h"
+#include "json_writer.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+//Typed (de)serialization of plain structs. Declare the fields once, after
+//the struct and after the bindings of any struct types it contains:
+//
+//    struct Point { int x; double y; std::string label; };
+//    TINY_JSON_BIND(Point, x, y, label)
+//
+//json_bind_parse then reads a document straight into a Point with no
+//JsonNode in between, and json_bind_stringify writes one through a
+//JsonWriter. Member keys are dispatched by a switch on a compile-time hash
+//of the field names; two names that collide are duplicate case labels and
+//fail to compile. Unknown keys are skipped, missing ones leave the field as
+//it was, and a value of the wrong type is JSON_PARSE_UNEXPECTED_TYPE.
+
+//FNV-1a, usable in case labels. A C++11 constexpr function is a single
+//return statement, so this recurses once per character of a field name.
+constexpr uint32_t JsonBind_hash(const char* str, size_t length, uint32_t hash = 2166136261u) {
+    return length == 0 ? hash : JsonBind_hash(str + 1, length - 1, (hash ^ (unsigned char) str[0]) * 16777619u);
+}
+
+//The same hash for a key read from a document, which may be any length.
+inline uint32_t JsonBind_key_hash(const char* str, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+inline int json_bind_read(JsonReader& reader, bool& value) {
+    return reader.read_bool(value);
+}
+
+inline int json_bind_read(JsonReader& reader, double& value) {
+    return reader.read_number(value);
+}
+
+inline int json_bind_read(JsonReader& reader, float& value) {
+    double num;
+    int ret = reader.read_number(num);
+    if (ret == JSON_PARSE_OK) {
+        value = (float) num;
+    }
+    return ret;
+}
+
+//Integers must be integral and in range for the field's type.
+template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+int json_bind_read(JsonReader& reader, T& value) {
+    double num;
+    int ret;
+    if ((ret = reader.read_number(num)) != JSON_PARSE_OK) {
+        return ret;
+    }
+    double limit = std::ldexp(1.0, std::numeric_limits<T>::digits);
+    if (!(num >= (std::is_signed<T>::value ? -limit : 0.0) && num < limit && num == std::trunc(num))) {
+        return reader.set_error(JSON_PARSE_UNEXPECTED_TYPE);
+    }
+    value = (T) num;
+    return JSON_PARSE_OK;
+}
+
+inline int json_bind_read(JsonReader& reader, std::string& value) {
+    return reader.read_string(value);
+}
+
+//A JsonNode field takes any value as is.
+inline int json_bind_read(JsonReader& reader, JsonNode& value) {
+    return reader.read_value(value);
+}
+
+template <typename T>
+int json_bind_read(JsonReader& reader, std::vector<T>& value) {
+    int ret;
+    if ((ret = reader.begin_array()) != JSON_PARSE_OK) {
+        return ret;
+    }
+    value.clear();
+    while (reader.has_next()) {
+        value.emplace_back();
+        if ((ret = json_bind_read(reader, value.back())) != JSON_PARSE_OK) {
+            return ret;
+        }
+    }
+    return reader.get_error();
+}
+
+inline void json_bind_write(JsonWriter& writer, bool value) {
+    writer.value(value);
+}
+
+inline void json_bind_write(JsonWriter& writer, double value) {
+    writer.value(value);
+}
+
+inline void json_bind_write(JsonWriter& writer, float value) {
+    writer.value((double) value);
+}
+
+template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+void json_bind_write(JsonWriter& writer, T value) {
+    writer.value(value);
+}
+
+inline void json_bind_write(JsonWriter& writer, const std::string& value) {
+    writer.value(value);
+}
+
+inline void json_bind_write(JsonWriter& writer, const JsonNode& value) {
+    writer.value(&value);
+}
+
+template <typename T>
+void json_bind_write(JsonWriter& writer, const std::vector<T>& value) {
+    writer.begin_array();
+    for (const T& element : value) {
+        json_bind_write(writer, element);
+    }
+    writer.end_array();
+}
+
+template <typename T>
+int json_bind_parse(const char* json, T& value) {
+    JsonReader reader(json);
+    json_bind_read(reader, value);
+    return reader.finish();
+}
+
+template <typename T>
+std::string json_bind_stringify(const T& value) {
+    JsonWriter writer;
+    json_bind_write(writer, value);
+    return writer.get_string();
+}
+
+//Applies m to each of up to 32 arguments.
+#define TINY_JSON_BIND_N(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, \
+                         _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...)                         \
+    N
+#define TINY_JSON_BIND_COUNT(...)                                                                                    \
+    TINY_JSON_BIND_N(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, \
+                     11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, )
+#define TINY_JSON_BIND_CAT(a, b) TINY_JSON_BIND_CAT_(a, b)
+#define TINY_JSON_BIND_CAT_(a, b) a##b
+#define TINY_JSON_BIND_FOR_EACH(m, ...) TINY_JSON_BIND_CAT(TINY_JSON_BIND_EACH_, TINY_JSON_BIND_COUNT(__VA_ARGS__))(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_1(m, x) m(x)
+#define TINY_JSON_BIND_EACH_2(m, x, ...) m(x) TINY_JSON_BIND_EACH_1(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_3(m, x, ...) m(x) TINY_JSON_BIND_EACH_2(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_4(m, x, ...) m(x) TINY_JSON_BIND_EACH_3(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_5(m, x, ...) m(x) TINY_JSON_BIND_EACH_4(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_6(m, x, ...) m(x) TINY_JSON_BIND_EACH_5(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_7(m, x, ...) m(x) TINY_JSON_BIND_EACH_6(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_8(m, x, ...) m(x) TINY_JSON_BIND_EACH_7(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_9(m, x, ...) m(x) TINY_JSON_BIND_EACH_8(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_10(m, x, ...) m(x) TINY_JSON_BIND_EACH_9(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_11(m, x, ...) m(x) TINY_JSON_BIND_EACH_10(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_12(m, x, ...) m(x) TINY_JSON_BIND_EACH_11(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_13(m, x, ...) m(x) TINY_JSON_BIND_EACH_12(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_14(m, x, ...) m(x) TINY_JSON_BIND_EACH_13(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_15(m, x, ...) m(x) TINY_JSON_BIND_EACH_14(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_16(m, x, ...) m(x) TINY_JSON_BIND_EACH_15(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_17(m, x, ...) m(x) TINY_JSON_BIND_EACH_16(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_18(m, x, ...) m(x) TINY_JSON_BIND_EACH_17(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_19(m, x, ...) m(x) TINY_JSON_BIND_EACH_18(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_20(m, x, ...) m(x) TINY_JSON_BIND_EACH_19(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_21(m, x, ...) m(x) TINY_JSON_BIND_EACH_20(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_22(m, x, ...) m(x) TINY_JSON_BIND_EACH_21(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_23(m, x, ...) m(x) TINY_JSON_BIND_EACH_22(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_24(m, x, ...) m(x) TINY_JSON_BIND_EACH_23(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_25(m, x, ...) m(x) TINY_JSON_BIND_EACH_24(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_26(m, x, ...) m(x) TINY_JSON_BIND_EACH_25(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_27(m, x, ...) m(x) TINY_JSON_BIND_EACH_26(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_28(m, x, ...) m(x) TINY_JSON_BIND_EACH_27(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_29(m, x, ...) m(x) TINY_JSON_BIND_EACH_28(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_30(m, x, ...) m(x) TINY_JSON_BIND_EACH_29(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_31(m, x, ...) m(x) TINY_JSON_BIND_EACH_30(m, __VA_ARGS__)
+#define TINY_JSON_BIND_EACH_32(m, x, ...) m(x) TINY_JSON_BIND_EACH_31(m, __VA_ARGS__)
+
+#define TINY_JSON_BIND_READ_CASE(field)                                                               \
+    case JsonBind_hash(#field, sizeof(#field) - 1):                                                   \
+        if (length == sizeof(#field) - 1 && memcmp(key, #field, length) == 0) {                       \
+            json_bind_read(reader, value.field);                                                      \
+        } else {                                                                                      \
+            reader.skip();                                                                            \
+        }                                                                                             \
+        break;
+
+#define TINY_JSON_BIND_WRITE_MEMBER(field)       \
+    writer.key(#field, sizeof(#field) - 1);      \
+    json_bind_write(writer, value.field);
+
+#define TINY_JSON_BIND(Type, ...)                                                 \
+    inline int json_bind_read(JsonReader& reader, Type& value) {                  \
+        const char* key;                                                          \
+        size_t length;                                                            \
+        reader.begin_object();                                                    \
+        while (reader.has_next()) {                                               \
+            if (reader.read_key(key, length) != JSON_PARSE_OK) {                  \
+                break;                                                            \
+            }                                                                     \
+            switch (JsonBind_key_hash(key, length)) {                             \
+                TINY_JSON_BIND_FOR_EACH(TINY_JSON_BIND_READ_CASE, __VA_ARGS__)    \
+                default:                                                          \
+                    reader.skip();                                                \
+            }                                                                     \
+        }                                                                         \
+        return reader.get_error();                                                \
+    }                                                                             \
+    inline void json_bind_write(JsonWriter& writer, const Type& value) {          \
+        writer.begin_object();                                                    \
+        TINY_JSON_BIND_FOR_EACH(TINY_JSON_BIND_WRITE_MEMBER, __VA_ARGS__)         \
+        writer.end_object();                                                      \
+    }
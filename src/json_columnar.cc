@@ -0,0 +1,499 @@
+#include "json_columnar.h"
+#include "json_pointer.h"
+#include "json_reader.h"
+#include "json_stringify.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+//Converts an array of objects, or fails with JSON_COLUMNAR_NOT_RECORDS and
+//leaves the columnar empty.
+int JsonColumnar::convert(const JsonNode* array) {
+    assert(array != nullptr);
+    this->clear();
+    if (array->get_type() != JSON_TYPE_ARRAY || (array->get_array_size() > 0 && array->is_packed_array())) {
+        return JSON_COLUMNAR_NOT_RECORDS;
+    }
+    std::string path;
+    for (int i = 0; i < array->get_array_size(); i++) {
+        const JsonNode* record = array->get_array_index(i);
+        if (record->get_type() != JSON_TYPE_OBJECT) {
+            this->clear();
+            return JSON_COLUMNAR_NOT_RECORDS;
+        }
+        this->hint = 0;
+        this->add_record(record, path);
+        this->rows++;
+    }
+    this->finish();
+    return JSON_COLUMNAR_OK;
+}
+
+//Reads the records straight from text. Returns the reader's error, with
+//JSON_PARSE_UNEXPECTED_TYPE for input that is not an array of objects.
+int JsonColumnar::parse(const char* json) {
+    this->clear();
+    JsonReader reader(json);
+    std::string path;
+    reader.begin_array();
+    while (reader.has_next()) {
+        if (reader.peek() != JSON_TYPE_OBJECT) {
+            reader.set_error(JSON_PARSE_UNEXPECTED_TYPE);
+            break;
+        }
+        this->hint = 0;
+        if (this->read_record(reader, path) != JSON_PARSE_OK) {
+            break;
+        }
+        this->rows++;
+    }
+    int ret = reader.finish();
+    if (ret != JSON_PARSE_OK) {
+        this->clear();
+        return ret;
+    }
+    this->finish();
+    return JSON_PARSE_OK;
+}
+
+void JsonColumnar::clear() {
+    this->columns.clear();
+    this->index.clear();
+    this->strings.clear();
+    this->rows = 0;
+    this->hint = 0;
+}
+
+size_t JsonColumnar::get_row_count() const {
+    return this->rows;
+}
+
+int JsonColumnar::get_column_count() const {
+    return this->columns.size();
+}
+
+//Columns come in the order their fields were first seen.
+const JsonColumn* JsonColumnar::get_column(int index) const {
+    if (index < 0 || (size_t) index >= this->columns.size()) {
+        return nullptr;
+    }
+    return &this->columns[index];
+}
+
+const JsonColumn* JsonColumnar::find_column(const std::string& path) const {
+    auto iter = this->index.find(path);
+    return iter == this->index.end() ? nullptr : &this->columns[iter->second];
+}
+
+//Records of one layout visit the columns in order, so the column after the
+//previous one is tried before the hash lookup.
+int JsonColumnar::find(const std::string& path) {
+    int found;
+    if ((size_t) this->hint < this->columns.size() && this->columns[this->hint].path == path) {
+        found = this->hint;
+    } else {
+        auto iter = this->index.find(path);
+        if (iter != this->index.end()) {
+            found = iter->second;
+        } else {
+            found = this->columns.size();
+            this->columns.emplace_back();
+            this->columns.back().path = path;
+            this->strings.emplace_back();
+            this->index.emplace(path, found);
+        }
+    }
+    this->hint = found + 1;
+    return found;
+}
+
+//Fills the column with empty slots up to rows.
+void JsonColumnar::pad(JsonColumn& column, size_t rows) {
+    switch (column.type) {
+        case JSON_COLUMN_BOOLEAN:
+            column.booleans.resize(rows, 0);
+            break;
+        case JSON_COLUMN_NUMBER:
+            column.numbers.resize(rows, 0);
+            break;
+        case JSON_COLUMN_STRING:
+            column.codes.resize(rows, -1);
+            break;
+        case JSON_COLUMN_JSON:
+            column.texts.resize(rows);
+            break;
+        default:
+            break;
+    }
+    column.size = rows;
+    column.validity.resize((rows + 63) / 64, 0);
+}
+
+//Readies the column for a value of the given type in the current row. A
+//column that has seen another type turns into a JSON column, keeping its
+//earlier values as text.
+JsonColumn& JsonColumnar::begin_value(int index, JsonColumnType type) {
+    JsonColumn& column = this->columns[index];
+    this->pad(column, this->rows);
+    if (column.type == type || column.type == JSON_COLUMN_JSON) {
+        return column;
+    }
+    if (column.type == JSON_COLUMN_NULL) {
+        column.type = type;
+        this->pad(column, this->rows);
+        return column;
+    }
+    column.texts.assign(this->rows, std::string());
+    for (size_t row = 0; row < this->rows; row++) {
+        if (!column.is_valid(row)) {
+            continue;
+        }
+        std::string& text = column.texts[row];
+        switch (column.type) {
+            case JSON_COLUMN_BOOLEAN:
+                text = column.booleans[row] ? "true" : "false";
+                break;
+            case JSON_COLUMN_NUMBER:
+                JsonStringify_number(column.numbers[row], text);
+                break;
+            default: {
+                const std::string& str = column.dictionary[column.codes[row]];
+                JsonStringify_string(str.data(), str.size(), text);
+                break;
+            }
+        }
+    }
+    std::vector<double>().swap(column.numbers);
+    std::vector<uint8_t>().swap(column.booleans);
+    std::vector<int32_t>().swap(column.codes);
+    std::vector<std::string>().swap(column.dictionary);
+    this->strings[index].clear();
+    column.type = JSON_COLUMN_JSON;
+    return column;
+}
+
+#define JSON_COLUMNAR_SET_VALID(column)                                          \
+    do {                                                                         \
+        (column).size = this->rows + 1;                                          \
+        (column).validity.resize((this->rows + 64) / 64, 0);                     \
+        (column).validity[this->rows >> 6] |= 1ULL << (this->rows & 63);         \
+    } while (0)
+
+void JsonColumnar::add_bool(int index, bool b) {
+    if (this->columns[index].size > this->rows) {
+        return;//a repeated key keeps its first value
+    }
+    JsonColumn& column = this->begin_value(index, JSON_COLUMN_BOOLEAN);
+    if (column.type == JSON_COLUMN_JSON) {
+        column.texts.emplace_back(b ? "true" : "false");
+    } else {
+        column.booleans.push_back(b);
+    }
+    JSON_COLUMNAR_SET_VALID(column);
+}
+
+void JsonColumnar::add_number(int index, double num) {
+    if (this->columns[index].size > this->rows) {
+        return;
+    }
+    JsonColumn& column = this->begin_value(index, JSON_COLUMN_NUMBER);
+    if (column.type == JSON_COLUMN_JSON) {
+        column.texts.emplace_back();
+        JsonStringify_number(num, column.texts.back());
+    } else {
+        column.numbers.push_back(num);
+    }
+    JSON_COLUMNAR_SET_VALID(column);
+}
+
+void JsonColumnar::add_string(int index, const char* str, size_t length) {
+    if (this->columns[index].size > this->rows) {
+        return;
+    }
+    JsonColumn& column = this->begin_value(index, JSON_COLUMN_STRING);
+    if (column.type == JSON_COLUMN_JSON) {
+        column.texts.emplace_back();
+        JsonStringify_string(str, length, column.texts.back());
+    } else {
+        this->scratch.assign(str, length);
+        auto inserted = this->strings[index].emplace(this->scratch, (int32_t) column.dictionary.size());
+        if (inserted.second) {
+            column.dictionary.push_back(this->scratch);
+        }
+        column.codes.push_back(inserted.first->second);
+    }
+    JSON_COLUMNAR_SET_VALID(column);
+}
+
+void JsonColumnar::add_json(int index, const std::string& text) {
+    if (this->columns[index].size > this->rows) {
+        return;
+    }
+    JsonColumn& column = this->begin_value(index, JSON_COLUMN_JSON);
+    column.texts.push_back(text);
+    JSON_COLUMNAR_SET_VALID(column);
+}
+
+#undef JSON_COLUMNAR_SET_VALID
+
+//Nested objects add their members under the pointer of the object.
+void JsonColumnar::add_record(const JsonNode* record, std::string& path) {
+    for (auto member : record->members()) {
+        size_t base = path.size();
+        JsonPointer::append_token(path, member.key);
+        const JsonNode* value = &member.value;
+        switch (value->get_type()) {
+            case JSON_TYPE_NULL:
+                this->find(path);//the column exists; the row stays empty
+                break;
+            case JSON_TYPE_TRUE:
+            case JSON_TYPE_FALSE:
+                this->add_bool(this->find(path), value->get_bool());
+                break;
+            case JSON_TYPE_NUMBER:
+                this->add_number(this->find(path), value->get_number());
+                break;
+            case JSON_TYPE_STRING: {
+                std::string str = value->get_string();
+                this->add_string(this->find(path), str.data(), str.size());
+                break;
+            }
+            case JSON_TYPE_ARRAY:
+                this->add_json(this->find(path), value->json_stringify());
+                break;
+            case JSON_TYPE_OBJECT:
+                this->add_record(value, path);
+                break;
+        }
+        path.resize(base);
+    }
+}
+
+int JsonColumnar::read_record(JsonReader& reader, std::string& path) {
+    int ret;
+    const char* key;
+    size_t length;
+    if ((ret = reader.begin_object()) != JSON_PARSE_OK) {
+        return ret;
+    }
+    while (reader.has_next()) {
+        if ((ret = reader.read_key(key, length)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        size_t base = path.size();
+        this->scratch.assign(key, length);
+        JsonPointer::append_token(path, this->scratch);
+        switch (reader.peek()) {
+            case JSON_TYPE_NULL:
+                if (reader.read_null() == JSON_PARSE_OK) {
+                    this->find(path);//the column exists; the row stays empty
+                }
+                break;
+            case JSON_TYPE_TRUE:
+            case JSON_TYPE_FALSE: {
+                bool b;
+                if (reader.read_bool(b) == JSON_PARSE_OK) {
+                    this->add_bool(this->find(path), b);
+                }
+                break;
+            }
+            case JSON_TYPE_NUMBER: {
+                double num;
+                if (reader.read_number(num) == JSON_PARSE_OK) {
+                    this->add_number(this->find(path), num);
+                }
+                break;
+            }
+            case JSON_TYPE_STRING: {
+                std::string str;
+                if (reader.read_string(str) == JSON_PARSE_OK) {
+                    this->add_string(this->find(path), str.data(), str.size());
+                }
+                break;
+            }
+            case JSON_TYPE_ARRAY: {
+                JsonNode value;
+                if (reader.read_value(value) == JSON_PARSE_OK) {
+                    this->add_json(this->find(path), value.json_stringify());
+                }
+                break;
+            }
+            case JSON_TYPE_OBJECT:
+                this->read_record(reader, path);
+                break;
+        }
+        path.resize(base);
+    }
+    return reader.get_error();
+}
+
+void JsonColumnar::finish() {
+    for (auto& column : this->columns) {
+        this->pad(column, this->rows);
+    }
+}
+
+//The column at path if it has the given type; a column of nulls only is
+//treated as an empty column of any type.
+const JsonColumn* JsonColumnar::get_typed(const std::string& path, JsonColumnType type) const {
+    const JsonColumn* column = this->find_column(path);
+    if (column == nullptr || (column->type != type && column->type != JSON_COLUMN_NULL)) {
+        return nullptr;
+    }
+    return column;
+}
+
+//Calls f(row) for every valid, selected row of column.
+template <typename F>
+static void JsonColumnar_rows(const JsonColumn& column, const std::vector<uint64_t>* selection, F f) {
+    assert(selection == nullptr || selection->size() == column.validity.size());
+    for (size_t w = 0; w < column.validity.size(); w++) {
+        uint64_t bits = column.validity[w] & (selection != nullptr ? (*selection)[w] : ~0ULL);
+        size_t base = w * 64;
+        if (bits == ~0ULL) {
+            for (size_t j = 0; j < 64; j++) {
+                f(base + j);
+            }
+            continue;
+        }
+        while (bits != 0) {
+            f(base + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+}
+
+//Number of valid, selected rows; works on columns of every type.
+int JsonColumnar::count(const std::string& path, size_t& result, const std::vector<uint64_t>* selection) const {
+    const JsonColumn* column = this->find_column(path);
+    if (column == nullptr) {
+        return JSON_COLUMNAR_NO_COLUMN;
+    }
+    assert(selection == nullptr || selection->size() == column->validity.size());
+    result = 0;
+    for (size_t w = 0; w < column->validity.size(); w++) {
+        result += __builtin_popcountll(column->validity[w] & (selection != nullptr ? (*selection)[w] : ~0ULL));
+    }
+    return JSON_COLUMNAR_OK;
+}
+
+int JsonColumnar::sum(const std::string& path, double& result, const std::vector<uint64_t>* selection) const {
+    const JsonColumn* column = this->get_typed(path, JSON_COLUMN_NUMBER);
+    if (column == nullptr) {
+        return this->find_column(path) == nullptr ? JSON_COLUMNAR_NO_COLUMN : JSON_COLUMNAR_NOT_NUMBER;
+    }
+    const double* numbers = column->numbers.data();
+    double total = 0;
+    JsonColumnar_rows(*column, selection, [&](size_t row) { total += numbers[row]; });
+    result = total;
+    return JSON_COLUMNAR_OK;
+}
+
+//NaN when no row is valid and selected.
+int JsonColumnar::min(const std::string& path, double& result, const std::vector<uint64_t>* selection) const {
+    const JsonColumn* column = this->get_typed(path, JSON_COLUMN_NUMBER);
+    if (column == nullptr) {
+        return this->find_column(path) == nullptr ? JSON_COLUMNAR_NO_COLUMN : JSON_COLUMNAR_NOT_NUMBER;
+    }
+    const double* numbers = column->numbers.data();
+    double low = std::numeric_limits<double>::infinity();
+    bool any = false;
+    JsonColumnar_rows(*column, selection, [&](size_t row) {
+        low = std::min(low, numbers[row]);
+        any = true;
+    });
+    result = any ? low : std::numeric_limits<double>::quiet_NaN();
+    return JSON_COLUMNAR_OK;
+}
+
+int JsonColumnar::max(const std::string& path, double& result, const std::vector<uint64_t>* selection) const {
+    const JsonColumn* column = this->get_typed(path, JSON_COLUMN_NUMBER);
+    if (column == nullptr) {
+        return this->find_column(path) == nullptr ? JSON_COLUMNAR_NO_COLUMN : JSON_COLUMNAR_NOT_NUMBER;
+    }
+    const double* numbers = column->numbers.data();
+    double high = -std::numeric_limits<double>::infinity();
+    bool any = false;
+    JsonColumnar_rows(*column, selection, [&](size_t row) {
+        high = std::max(high, numbers[row]);
+        any = true;
+    });
+    result = any ? high : std::numeric_limits<double>::quiet_NaN();
+    return JSON_COLUMNAR_OK;
+}
+
+//Keeps the selected rows whose slot passes f, 64 rows per bitmap word.
+template <typename T, typename F>
+static void JsonColumnar_narrow(const JsonColumn& column, const T* slots, std::vector<uint64_t>& selection, F f) {
+    for (size_t w = 0; w < selection.size(); w++) {
+        size_t base = w * 64;
+        size_t count = std::min<size_t>(64, column.size - base);
+        uint64_t bits = 0;
+        for (size_t j = 0; j < count; j++) {
+            bits |= (uint64_t) f(slots[base + j]) << j;
+        }
+        selection[w] &= bits & column.validity[w];
+    }
+}
+
+//Narrows selection to rows whose number compares true against value. An
+//empty selection starts from every row.
+int JsonColumnar::filter(const std::string& path, JsonCompare compare, double value,
+                         std::vector<uint64_t>& selection) const {
+    const JsonColumn* column = this->get_typed(path, JSON_COLUMN_NUMBER);
+    if (column == nullptr) {
+        return this->find_column(path) == nullptr ? JSON_COLUMNAR_NO_COLUMN : JSON_COLUMNAR_NOT_NUMBER;
+    }
+    if (selection.empty()) {
+        selection.assign(column->validity.size(), ~0ULL);
+    }
+    assert(selection.size() == column->validity.size());
+    if (column->type == JSON_COLUMN_NULL) {
+        std::fill(selection.begin(), selection.end(), 0);
+        return JSON_COLUMNAR_OK;
+    }
+    const double* numbers = column->numbers.data();
+    switch (compare) {
+        case JSON_COMPARE_EQ:
+            JsonColumnar_narrow(*column, numbers, selection, [value](double x) { return x == value; });
+            break;
+        case JSON_COMPARE_NE:
+            JsonColumnar_narrow(*column, numbers, selection, [value](double x) { return x != value; });
+            break;
+        case JSON_COMPARE_LT:
+            JsonColumnar_narrow(*column, numbers, selection, [value](double x) { return x < value; });
+            break;
+        case JSON_COMPARE_LE:
+            JsonColumnar_narrow(*column, numbers, selection, [value](double x) { return x <= value; });
+            break;
+        case JSON_COMPARE_GT:
+            JsonColumnar_narrow(*column, numbers, selection, [value](double x) { return x > value; });
+            break;
+        case JSON_COMPARE_GE:
+            JsonColumnar_narrow(*column, numbers, selection, [value](double x) { return x >= value; });
+            break;
+    }
+    return JSON_COLUMNAR_OK;
+}
+
+//Narrows selection to rows whose string equals value, comparing dictionary
+//codes rather than strings.
+int JsonColumnar::filter(const std::string& path, const std::string& value, std::vector<uint64_t>& selection) const {
+    const JsonColumn* column = this->get_typed(path, JSON_COLUMN_STRING);
+    if (column == nullptr) {
+        return this->find_column(path) == nullptr ? JSON_COLUMNAR_NO_COLUMN : JSON_COLUMNAR_NOT_STRING;
+    }
+    if (selection.empty()) {
+        selection.assign(column->validity.size(), ~0ULL);
+    }
+    assert(selection.size() == column->validity.size());
+    const auto& strings = this->strings[this->index.find(path)->second];
+    auto iter = strings.find(value);
+    if (iter == strings.end()) {
+        std::fill(selection.begin(), selection.end(), 0);
+        return JSON_COLUMNAR_OK;
+    }
+    int32_t code = iter->second;
+    JsonColumnar_narrow(*column, column->codes.data(), selection, [code](int32_t x) { return x == code; });
+    return JSON_COLUMNAR_OK;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "tiny_json.h"
+#include <cstdint>
+#include <unordered_map>
+
+class JsonReader;
+
+//Json columnar return
+enum {
+    JSON_COLUMNAR_OK = 0,
+    JSON_COLUMNAR_NOT_RECORDS,
+    JSON_COLUMNAR_NO_COLUMN,
+    JSON_COLUMNAR_NOT_NUMBER,
+    JSON_COLUMNAR_NOT_STRING
+};
+
+enum JsonColumnType {
+    JSON_COLUMN_NULL,//no row has a value yet
+    JSON_COLUMN_BOOLEAN,
+    JSON_COLUMN_NUMBER,
+    JSON_COLUMN_STRING,
+    JSON_COLUMN_JSON//arrays, or values of more than one type, as JSON text
+};
+
+enum JsonCompare {
+    JSON_COMPARE_EQ,
+    JSON_COMPARE_NE,
+    JSON_COMPARE_LT,
+    JSON_COMPARE_LE,
+    JSON_COMPARE_GT,
+    JSON_COMPARE_GE
+};
+
+//One field across all records. Bit i of validity is set when row i has a
+//non-null value; the slot of any other row is 0, false, code -1 or "".
+//Only the storage of the column's type is filled.
+struct JsonColumn {
+    std::string path;//JSON Pointer of the field inside a record
+    JsonColumnType type = JSON_COLUMN_NULL;
+    size_t size = 0;
+    std::vector<uint64_t> validity;
+    std::vector<double> numbers;
+    std::vector<uint8_t> booleans;
+    std::vector<int32_t> codes;//indexes into dictionary
+    std::vector<std::string> dictionary;//each distinct string once
+    std::vector<std::string> texts;
+
+    bool is_valid(size_t row) const {
+        return (this->validity[row >> 6] >> (row & 63)) & 1;
+    }
+};
+
+//Columnar form of an array of records: one typed column per field, with
+//nested objects flattened into pointer paths such as "/dims/w". Build it
+//from a parsed array with convert, or straight from the text with parse,
+//which reads through a JsonReader and never builds the records.
+//
+//The aggregations scan a column's contiguous storage. A selection is a row
+//bitmap: filter narrows it, starting from every row when it is empty, and
+//sum, min and max only look at selected rows when given one.
+class JsonColumnar final {
+public:
+    int convert(const JsonNode* array);
+    int parse(const char* json);
+    void clear();
+    size_t get_row_count() const;
+    int get_column_count() const;
+    const JsonColumn* get_column(int index) const;
+    const JsonColumn* find_column(const std::string& path) const;
+
+    int count(const std::string& path, size_t& result, const std::vector<uint64_t>* selection = nullptr) const;
+    int sum(const std::string& path, double& result, const std::vector<uint64_t>* selection = nullptr) const;
+    int min(const std::string& path, double& result, const std::vector<uint64_t>* selection = nullptr) const;
+    int max(const std::string& path, double& result, const std::vector<uint64_t>* selection = nullptr) const;
+    int filter(const std::string& path, JsonCompare compare, double value, std::vector<uint64_t>& selection) const;
+    int filter(const std::string& path, const std::string& value, std::vector<uint64_t>& selection) const;
+
+private:
+    int find(const std::string& path);
+    void pad(JsonColumn& column, size_t rows);
+    JsonColumn& begin_value(int index, JsonColumnType type);
+    void add_bool(int index, bool b);
+    void add_number(int index, double num);
+    void add_string(int index, const char* str, size_t length);
+    void add_json(int index, const std::string& text);
+    void add_record(const JsonNode* record, std::string& path);
+    int read_record(JsonReader& reader, std::string& path);
+    void finish();
+    const JsonColumn* get_typed(const std::string& path, JsonColumnType type) const;
+
+    std::vector<JsonColumn> columns;
+    std::unordered_map<std::string, int> index;
+    std::vector<std::unordered_map<std::string, int32_t>> strings;
+    size_t rows = 0;
+    int hint = 0;
+    std::string scratch;
+};
@@ -0,0 +1,166 @@
+#include "json_dedup.h"
+#include <cassert>
+#include <cstring>
+
+JsonDedup::~JsonDedup() {
+    this->clear();
+}
+
+void JsonDedup::dedup(JsonNode* root) {
+    JsonDedupStats stats;
+    this->dedup(root, stats);
+}
+
+//Adds to stats, which may already hold other roots. The root itself stays
+//put, since its owner holds it by address.
+void JsonDedup::dedup(JsonNode* root, JsonDedupStats& stats) {
+    assert(root != nullptr);
+    this->dedup_children(root, stats);
+}
+
+//Distinct nodes in the pool.
+size_t JsonDedup::get_size() const {
+    return this->pool.size();
+}
+
+//Gives back the pool's shares; nodes no tree uses any more are freed.
+void JsonDedup::clear() {
+    for (auto& entry : this->pool) {
+        JsonNode::release(entry.second);
+    }
+    this->pool.clear();
+}
+
+void JsonDedup::dedup_children(JsonNode* node, JsonDedupStats& stats) {
+    for (auto& child : node->array) {
+        child = this->intern(child, stats);
+    }
+    for (auto& member : node->object) {
+        member.second = this->intern(member.second, stats);
+    }
+}
+
+//Bottom-up: once the children of node are pool nodes, node equals a pool
+//node exactly when their own contents and child pointers match, so no
+//subtree is compared twice. Returns the node to keep in node's place.
+JsonNode* JsonDedup::intern(JsonNode* node, JsonDedupStats& stats) {
+    stats.nodes++;
+    uint64_t h;
+    if (node->shares > 0) {
+        //Reached again, through another parent or another pass; a pool
+        //node's subtree is already done.
+        h = JsonDedup::hash(node);
+        auto range = this->pool.equal_range(h);
+        for (auto iter = range.first; iter != range.second; iter++) {
+            if (iter->second == node) {
+                return node;
+            }
+        }
+    }
+    //A node that may end up with several owners keeps no parent, and no
+    //place in any one parent's cached text.
+    node->leave_parent();
+    this->dedup_children(node, stats);
+    h = JsonDedup::hash(node);
+    auto range = this->pool.equal_range(h);
+    for (auto iter = range.first; iter != range.second; iter++) {
+        JsonNode* kept = iter->second;
+        if (kept == node) {
+            return node;
+        }
+        if (JsonDedup::same(kept, node)) {
+            JsonMemoryStats freed;
+            node->node_memory_stats(freed);
+            stats.shared++;
+            stats.bytes_saved += freed.total_bytes;
+            kept->shares++;
+            JsonNode::release(node);
+            return kept;
+        }
+    }
+    node->shares++;
+    this->pool.emplace(h, node);
+    return node;
+}
+
+static uint64_t JsonDedup_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t JsonDedup_bytes(uint64_t h, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+//Hash of the node's own contents, with children taken by address.
+uint64_t JsonDedup::hash(const JsonNode* node) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ node->type;
+    switch (node->type) {
+        case JSON_TYPE_NUMBER:
+            if (!node->string.empty()) {
+                h = JsonDedup_bytes(h ^ 1, node->string.data(), node->string.size());
+            } else {
+                h = JsonDedup_bytes(h, &node->number, sizeof(node->number));
+            }
+            break;
+        case JSON_TYPE_STRING:
+            h = JsonDedup_bytes(h, node->string.data(), node->string.size());
+            break;
+        case JSON_TYPE_ARRAY:
+            if (node->packed != nullptr) {
+                const std::vector<double>& numbers = node->packed->numbers;
+                h = JsonDedup_bytes(h ^ 1, numbers.data(), numbers.size() * sizeof(double));
+            } else {
+                h = JsonDedup_bytes(h, node->array.data(), node->array.size() * sizeof(JsonNode*));
+            }
+            break;
+        case JSON_TYPE_OBJECT:
+            for (const auto& member : node->object) {
+                h = JsonDedup_bytes(h, member.first.data(), member.first.size() + 1);
+                h = JsonDedup_bytes(h, &member.second, sizeof(member.second));
+            }
+            break;
+        default:
+            break;
+    }
+    return JsonDedup_mix(h);
+}
+
+//Equal contents with the same child nodes; numbers compare by bits so that
+//0 and -0 stay apart, and raw numbers by their text.
+bool JsonDedup::same(const JsonNode* a, const JsonNode* b) {
+    if (a->type != b->type) {
+        return false;
+    }
+    switch (a->type) {
+        case JSON_TYPE_NUMBER:
+            if (!a->string.empty() || !b->string.empty()) {
+                return a->string == b->string;
+            }
+            return memcmp(&a->number, &b->number, sizeof(a->number)) == 0;
+        case JSON_TYPE_STRING:
+            return a->string == b->string;
+        case JSON_TYPE_ARRAY:
+            if (a->packed != nullptr || b->packed != nullptr) {
+                if (a->packed == nullptr || b->packed == nullptr) {
+                    return false;
+                }
+                const std::vector<double>& x = a->packed->numbers;
+                const std::vector<double>& y = b->packed->numbers;
+                return x.size() == y.size() && memcmp(x.data(), y.data(), x.size() * sizeof(double)) == 0;
+            }
+            return a->array == b->array;
+        case JSON_TYPE_OBJECT:
+            return a->object == b->object;
+        default:
+            return true;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "tiny_json.h"
+#include <unordered_map>
+
+struct JsonDedupStats {
+    size_t nodes = 0;//nodes visited, not counting the roots
+    size_t shared = 0;//nodes replaced by an equal node already in the pool
+    size_t bytes_saved = 0;//heap bytes freed by those replacements
+};
+
+//Hash-consing of subtrees. Every node under a root passed to dedup is
+//replaced by an equal node already in the pool if there is one, so each
+//distinct value is stored once however often it repeats, and equal subtrees
+//of trees deduplicated by one pool compare equal by pointer. Values match
+//only if they would print the same: member order counts, and 0 and -0
+//differ, so json_stringify output never changes.
+//
+//The pool keeps a share of each node it holds, so its nodes stay valid
+//after the trees they came from are freed, until clear or destruction.
+//A deduplicated tree is for reading: editing a shared node changes every
+//place it appears. json_copy gives an unshared tree to edit, and detach and
+//replace hand back an unshared copy of a shared node. Deduplicated nodes
+//forget their parents, so editing one leaves stale any text cached above it
+//by json_stringify_cached.
+class JsonDedup final {
+public:
+    JsonDedup() = default;
+    JsonDedup(const JsonDedup& dedup) = delete;
+    JsonDedup& operator=(const JsonDedup& dedup) = delete;
+    ~JsonDedup();
+    void dedup(JsonNode* root);
+    void dedup(JsonNode* root, JsonDedupStats& stats);
+    size_t get_size() const;
+    void clear();
+
+private:
+    void dedup_children(JsonNode* node, JsonDedupStats& stats);
+    JsonNode* intern(JsonNode* node, JsonDedupStats& stats);
+    static uint64_t hash(const JsonNode* node);
+    static bool same(const JsonNode* a, const JsonNode* b);
+    std::unordered_multimap<uint64_t, JsonNode*> pool;
+};
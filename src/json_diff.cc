@@ -0,0 +1,217 @@
+#include "json_diff.h"
+#include "json_pointer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+//Arrays whose changed middle is larger than this are matched by position.
+static const size_t JSON_DIFF_EDIT_LIMIT = 1 << 20;
+
+class JsonDiff final {
+public:
+    explicit JsonDiff(JsonNode* patch) : patch(patch) {}
+    void diff(const JsonNode* a, const JsonNode* b, std::string& path);
+
+private:
+    uint64_t hash(const JsonNode* node);
+    bool same(const JsonNode* a, const JsonNode* b);
+    void diff_object(const JsonNode* a, const JsonNode* b, std::string& path);
+    void diff_array(const JsonNode* a, const JsonNode* b, std::string& path);
+    void emit(const char* op, const std::string& path, const JsonNode* value);
+    JsonNode* patch;
+    std::unordered_map<const JsonNode*, uint64_t> hashes;
+};
+
+static uint64_t JsonDiff_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t JsonDiff_hash_string(const std::string& str) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char ch : str) {
+        h = (h ^ ch) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+//Same as the hash of a number node, for the elements of packed arrays.
+static uint64_t JsonDiff_hash_number(double num) {
+    uint64_t bits = 0;
+    if (num != 0) {
+        memcpy(&bits, &num, sizeof(bits));
+    }
+    return JsonDiff_mix(JsonDiff_mix(JSON_TYPE_NUMBER + 1) ^ bits);
+}
+
+//Structural hash, consistent with json_is_equal: member order does not matter.
+uint64_t JsonDiff::hash(const JsonNode* node) {
+    auto iter = this->hashes.find(node);
+    if (iter != this->hashes.end()) {
+        return iter->second;
+    }
+    uint64_t h = JsonDiff_mix(node->get_type() + 1);
+    switch (node->get_type()) {
+        case JSON_TYPE_NUMBER:
+            h = JsonDiff_hash_number(node->get_number());
+            break;
+        case JSON_TYPE_STRING:
+            h = JsonDiff_mix(h ^ JsonDiff_hash_string(node->get_string()));
+            break;
+        case JSON_TYPE_ARRAY:
+            for (int i = 0; i < node->get_array_size(); i++) {
+                h = JsonDiff_mix(h + (node->is_packed_array() ? JsonDiff_hash_number(node->get_array_number(i))
+                                                               : hash(node->get_array_index(i))));
+            }
+            break;
+        case JSON_TYPE_OBJECT: {
+            uint64_t sum = 0;
+            for (int i = 0; i < node->get_object_size(); i++) {
+                sum += JsonDiff_mix(JsonDiff_hash_string(node->get_object_key(i)) ^ hash(node->get_object_value(i)));
+            }
+            h = JsonDiff_mix(h ^ sum);
+            break;
+        }
+        default:
+            break;
+    }
+    this->hashes[node] = h;
+    return h;
+}
+
+bool JsonDiff::same(const JsonNode* a, const JsonNode* b) {
+    return hash(a) == hash(b) && a->json_is_equal(const_cast<JsonNode*>(b));
+}
+
+void JsonDiff::emit(const char* op, const std::string& path, const JsonNode* value) {
+    auto item = new JsonNode();
+    auto node = new JsonNode();
+    item->json_init();
+    item->set_object();
+    node->json_init();
+    node->set_string(op);
+    item->pushback_object_element("op", node);
+    node = new JsonNode();
+    node->json_init();
+    node->set_string(path);
+    item->pushback_object_element("path", node);
+    if (value != nullptr) {
+        node = new JsonNode();
+        node->json_init();
+        node->json_copy(value);
+        item->pushback_object_element("value", node);
+    }
+    this->patch->pushback_array_element(item);
+}
+
+void JsonDiff::diff(const JsonNode* a, const JsonNode* b, std::string& path) {
+    if (same(a, b)) {
+        return;
+    }
+    if (a->get_type() == b->get_type() && a->get_type() == JSON_TYPE_OBJECT) {
+        diff_object(a, b, path);
+    } else if (a->get_type() == b->get_type() && a->get_type() == JSON_TYPE_ARRAY && !a->is_packed_array() &&
+               !b->is_packed_array()) {
+        diff_array(a, b, path);
+    } else {
+        emit("replace", path, b);
+    }
+}
+
+void JsonDiff::diff_object(const JsonNode* a, const JsonNode* b, std::string& path) {
+    size_t length = path.size();
+    for (int i = 0; i < a->get_object_size(); i++) {
+        std::string key = a->get_object_key(i);
+        int index = b->find_object_index(key, i);
+        JsonPointer::append_token(path, key);
+        if (index < 0) {
+            emit("remove", path, nullptr);
+        } else {
+            diff(a->get_object_value(i), b->get_object_value(index), path);
+        }
+        path.resize(length);
+    }
+    for (int i = 0; i < b->get_object_size(); i++) {
+        std::string key = b->get_object_key(i);
+        if (a->find_object_index(key, i) < 0) {
+            JsonPointer::append_token(path, key);
+            emit("add", path, b->get_object_value(i));
+            path.resize(length);
+        }
+    }
+}
+
+//Common prefix and suffix are skipped, the middle is aligned by an edit
+//distance over subtree hashes where matching elements cost nothing and
+//each add, remove or in-place diff costs one operation.
+void JsonDiff::diff_array(const JsonNode* a, const JsonNode* b, std::string& path) {
+    int n = a->get_array_size();
+    int m = b->get_array_size();
+    int prefix = 0;
+    int suffix = 0;
+    while (prefix < n && prefix < m && same(a->get_array_index(prefix), b->get_array_index(prefix))) {
+        prefix++;
+    }
+    while (suffix < n - prefix && suffix < m - prefix &&
+           same(a->get_array_index(n - 1 - suffix), b->get_array_index(m - 1 - suffix))) {
+        suffix++;
+    }
+    int na = n - prefix - suffix;
+    int nb = m - prefix - suffix;
+    size_t width = nb + 1;
+    std::vector<int> cost;
+    bool aligned = (size_t) (na + 1) * width <= JSON_DIFF_EDIT_LIMIT;
+    if (aligned) {
+        //cost[i * width + j] is the number of operations turning a[i..] into b[j..]
+        cost.resize((size_t) (na + 1) * width);
+        for (int i = na; i >= 0; i--) {
+            for (int j = nb; j >= 0; j--) {
+                int* cell = &cost[i * width + j];
+                if (i == na || j == nb) {
+                    *cell = (na - i) + (nb - j);
+                } else if (hash(a->get_array_index(prefix + i)) == hash(b->get_array_index(prefix + j))) {
+                    *cell = cell[width + 1];
+                } else {
+                    *cell = 1 + std::min(cell[width + 1], std::min(cell[1], cell[width]));
+                }
+            }
+        }
+    }
+    size_t length = path.size();
+    int cur = prefix;
+    int i = 0;
+    int j = 0;
+    while (i < na || j < nb) {
+        const JsonNode* x = i < na ? a->get_array_index(prefix + i) : nullptr;
+        const JsonNode* y = j < nb ? b->get_array_index(prefix + j) : nullptr;
+        const int* cell = aligned ? &cost[i * width + j] : nullptr;
+        if (x != nullptr && y != nullptr && (!aligned || *cell == cell[width + 1] + (same(x, y) ? 0 : 1))) {
+            JsonPointer::append_token(path, std::to_string(cur++));
+            diff(x, y, path);
+            i++;
+            j++;
+        } else if (y != nullptr && (x == nullptr || *cell == cell[1] + 1)) {
+            JsonPointer::append_token(path, std::to_string(cur++));
+            emit("add", path, y);
+            j++;
+        } else {
+            JsonPointer::append_token(path, std::to_string(cur));
+            emit("remove", path, nullptr);
+            i++;
+        }
+        path.resize(length);
+    }
+}
+
+void json_diff(const JsonNode* a, const JsonNode* b, JsonNode* patch) {
+    std::string path;
+    patch->json_free();
+    patch->set_array();
+    JsonDiff d(patch);
+    d.diff(a, b, path);
+}
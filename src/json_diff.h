@@ -0,0 +1,5 @@
+#pragma once
+#include "tiny_json.h"
+
+//Writes into patch an RFC 6902 patch that turns a into b.
+void json_diff(const JsonNode* a, const JsonNode* b, JsonNode* patch);
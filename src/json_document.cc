@@ -0,0 +1,86 @@
+#include "json_document.h"
+#include "parser.h"
+#include <algorithm>
+
+JsonDocument::~JsonDocument() {
+    for (auto node : this->spare.nodes) {
+        delete node;
+    }
+}
+
+int JsonDocument::parse(const char* json) {
+    return this->parse(json, JsonParseOptions());
+}
+
+int JsonDocument::parse(const char* json, const JsonParseOptions& options) {
+    this->reset();
+    JsonContext ctx{};
+    ctx.json = json;
+    Parser p(ctx, options, &this->spare);
+    return p.parse(this->root);
+}
+
+JsonNode& JsonDocument::get_root() {
+    return this->root;
+}
+
+const JsonNode& JsonDocument::get_root() const {
+    return this->root;
+}
+
+//Empties the tree but keeps its storage for the next parse. The new spares
+//go on top of any left over, reversed so the first node of the tree is
+//taken first.
+void JsonDocument::reset() {
+    size_t nodes = this->spare.nodes.size();
+    size_t keys = this->spare.keys.size();
+    this->recycle(&this->root);
+    std::reverse(this->spare.nodes.begin() + nodes, this->spare.nodes.end());
+    std::reverse(this->spare.keys.begin() + keys, this->spare.keys.end());
+}
+
+//Empties the tree and frees everything kept for reuse.
+void JsonDocument::release() {
+    this->root.json_free();
+    std::string().swap(this->root.string);
+    std::vector<JsonNode*>().swap(this->root.array);
+    std::vector<std::pair<std::string, JsonNode*>>().swap(this->root.object);
+    for (auto node : this->spare.nodes) {
+        delete node;
+    }
+    std::vector<JsonNode*>().swap(this->spare.nodes);
+    std::vector<std::string>().swap(this->spare.keys);
+}
+
+size_t JsonDocument::get_spare_nodes() const {
+    return this->spare.nodes.size();
+}
+
+//Moves the descendants of node and their keys onto the spares in the order
+//a parse creates them, leaving every node null but with its capacity.
+void JsonDocument::recycle(JsonNode* node) {
+    delete node->packed;
+    node->packed = nullptr;
+    node->drop_cache();
+    node->parent = nullptr;
+    for (auto child : node->array) {
+        if (child->shares > 0) {
+            child->shares--;//still in use elsewhere
+            continue;
+        }
+        this->spare.nodes.push_back(child);
+        this->recycle(child);
+    }
+    node->array.clear();
+    for (auto& member : node->object) {
+        this->spare.keys.push_back(std::move(member.first));
+        if (member.second->shares > 0) {
+            member.second->shares--;
+            continue;
+        }
+        this->spare.nodes.push_back(member.second);
+        this->recycle(member.second);
+    }
+    node->object.clear();
+    node->type = JSON_TYPE_NULL;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "tiny_json.h"
+
+//Storage given up by an earlier tree, stacked so that the parser takes it
+//back in the order it builds a tree: the next node or key it needs is at
+//the back.
+struct JsonRecycle {
+    std::vector<JsonNode*> nodes;//emptied, with their string and vector capacity
+    std::vector<std::string> keys;//object keys, buffers included
+};
+
+//A parse target that recycles its tree. Each parse first takes the previous
+//tree apart and hands its nodes and key strings to the parser, so a message
+//shaped like the last one lands in the same nodes, string buffers and
+//vector capacity: once warm, parsing a stream of same-shape messages makes
+//no heap allocations. Packed arrays still allocate their numbers.
+//
+//Nodes are reused whatever allocator the options name. Pointers into the
+//tree are invalid after the next parse, reset or release.
+class JsonDocument final {
+public:
+    JsonDocument() = default;
+    JsonDocument(const JsonDocument& document) = delete;
+    JsonDocument& operator=(const JsonDocument& document) = delete;
+    ~JsonDocument();
+    int parse(const char* json);
+    int parse(const char* json, const JsonParseOptions& options);
+    JsonNode& get_root();
+    const JsonNode& get_root() const;
+    void reset();
+    void release();
+    size_t get_spare_nodes() const;
+
+private:
+    void recycle(JsonNode* node);
+    JsonNode root;
+    JsonRecycle spare;
+};
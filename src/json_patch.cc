@@ -0,0 +1,296 @@
+#include "json_patch.h"
+
+JsonPatch::~JsonPatch() {
+    release();
+}
+
+void JsonPatch::release() {
+    for (auto& op : this->operations) {
+        delete op.value;
+    }
+    this->operations.clear();
+}
+
+static const JsonNode* JsonPatch_member(const JsonNode* node, const char* key) {
+    int index = node->find_object_index(key, 0);
+    return index < 0 ? nullptr : node->get_object_value(index);
+}
+
+int JsonPatch::compile(const JsonNode* patch) {
+    static const char* names[] = {"add", "remove", "replace", "move", "copy", "test"};
+    release();
+    if (patch->get_type() != JSON_TYPE_ARRAY) {
+        return JSON_PATCH_INVALID_OPERATION;
+    }
+    for (int i = 0; i < patch->get_array_size(); i++) {
+        const JsonNode* item = patch->get_array_index(i);
+        if (item == nullptr || item->get_type() != JSON_TYPE_OBJECT) {
+            release();
+            return JSON_PATCH_INVALID_OPERATION;
+        }
+        const JsonNode* op = JsonPatch_member(item, "op");
+        const JsonNode* path = JsonPatch_member(item, "path");
+        const JsonNode* from = JsonPatch_member(item, "from");
+        const JsonNode* value = JsonPatch_member(item, "value");
+        Operation operation{};
+        const int count = sizeof(names) / sizeof(names[0]);
+        int n = count;
+        if (op != nullptr && op->get_type() == JSON_TYPE_STRING) {
+            for (n = 0; n < count; n++) {
+                if (op->get_string() == names[n]) {
+                    break;
+                }
+            }
+        }
+        if (n == count || path == nullptr || path->get_type() != JSON_TYPE_STRING) {
+            release();
+            return JSON_PATCH_INVALID_OPERATION;
+        }
+        operation.op = (Op) n;
+        operation.path_string = path->get_string();
+        if (operation.op == OP_MOVE || operation.op == OP_COPY) {
+            if (from == nullptr || from->get_type() != JSON_TYPE_STRING) {
+                release();
+                return JSON_PATCH_INVALID_OPERATION;
+            }
+            operation.from_string = from->get_string();
+        }
+        if (operation.op == OP_ADD || operation.op == OP_REPLACE || operation.op == OP_TEST) {
+            if (value == nullptr) {
+                release();
+                return JSON_PATCH_INVALID_OPERATION;
+            }
+            operation.value = new JsonNode();
+            operation.value->json_init();
+            operation.value->json_copy(value);
+        }
+        this->operations.push_back(std::move(operation));
+        Operation& added = this->operations.back();
+        if (added.path.compile(added.path_string) != JSON_POINTER_OK ||
+            added.from.compile(added.from_string) != JSON_POINTER_OK) {
+            release();
+            return JSON_PATCH_INVALID_POINTER;
+        }
+    }
+    return JSON_PATCH_OK;
+}
+
+int JsonPatch::get_operation_size() const {
+    return this->operations.size();
+}
+
+//Detaches the value at path from the document.
+int JsonPatch::take(JsonNode* doc, JsonPointer& path, JsonNode** node) {
+    int last = path.get_token_size() - 1;
+    if (last < 0) {
+        return JSON_PATCH_INVALID_POINTER;
+    }
+    JsonNode* parent = path.resolve_parent(doc);
+    if (parent == nullptr) {
+        return JSON_PATCH_PATH_NOT_FOUND;
+    }
+    Undo u{UNDO_TAKE, parent, -1, "", nullptr};
+    if (parent->get_type() == JSON_TYPE_OBJECT) {
+        u.key = path.get_token(last);
+        u.index = parent->find_object_index(u.key, 0);
+        if (u.index < 0) {
+            return JSON_PATCH_PATH_NOT_FOUND;
+        }
+        u.node = parent->detach_object_value(u.index);
+    } else if (parent->get_type() == JSON_TYPE_ARRAY) {
+        u.index = path.get_token_index(last);
+        if (u.index < 0 || u.index >= parent->get_array_size()) {
+            return JSON_PATCH_PATH_NOT_FOUND;
+        }
+        u.node = parent->detach_array_element(u.index);
+    } else {
+        return JSON_PATCH_PATH_NOT_FOUND;
+    }
+    *node = u.node;
+    this->undo.push_back(std::move(u));
+    return JSON_PATCH_OK;
+}
+
+//Inserts node at op.path. With replace set the target must already exist.
+int JsonPatch::put(JsonNode* doc, Operation& op, JsonNode* node, bool replace) {
+    int last = op.path.get_token_size() - 1;
+    if (last < 0) {
+        doc->json_swap(node);
+        this->garbage.push_back(node);
+        this->undo.push_back(Undo{UNDO_ROOT, doc, -1, "", node});
+        return JSON_PATCH_OK;
+    }
+    JsonNode* parent = op.path.resolve_parent(doc);
+    if (parent == nullptr) {
+        return JSON_PATCH_PATH_NOT_FOUND;
+    }
+    Undo u{UNDO_PUT, parent, -1, "", nullptr};
+    if (parent->get_type() == JSON_TYPE_OBJECT) {
+        const std::string& key = op.path.get_token(last);
+        u.index = parent->find_object_index(key, 0);
+        if (u.index >= 0) {
+            u.kind = UNDO_SWAP;
+            u.node = parent->replace_object_value(u.index, node);
+            this->garbage.push_back(u.node);
+        } else if (replace) {
+            return JSON_PATCH_PATH_NOT_FOUND;
+        } else {
+            u.index = parent->get_object_size();
+            parent->pushback_object_element(key, node);
+        }
+    } else if (parent->get_type() == JSON_TYPE_ARRAY) {
+        int size = parent->get_array_size();
+        u.index = op.path.get_token(last) == "-" && !replace ? size : op.path.get_token_index(last);
+        if (u.index < 0 || u.index > size || (replace && u.index == size)) {
+            return JSON_PATCH_PATH_NOT_FOUND;
+        }
+        if (replace) {
+            u.kind = UNDO_SWAP;
+            u.node = parent->replace_array_element(u.index, node);
+            this->garbage.push_back(u.node);
+        } else {
+            parent->insert_array_element(node, u.index);
+        }
+    } else {
+        return JSON_PATCH_PATH_NOT_FOUND;
+    }
+    this->undo.push_back(std::move(u));
+    return JSON_PATCH_OK;
+}
+
+void JsonPatch::rollback() {
+    for (auto u = this->undo.rbegin(); u != this->undo.rend(); u++) {
+        switch (u->kind) {
+            case UNDO_TAKE:
+                if (u->parent->get_type() == JSON_TYPE_OBJECT) {
+                    u->parent->insert_object_element(u->index, u->key, u->node);
+                } else {
+                    u->parent->insert_array_element(u->node, u->index);
+                }
+                break;
+            case UNDO_PUT:
+                if (u->parent->get_type() == JSON_TYPE_OBJECT) {
+                    u->parent->detach_object_value(u->index);
+                } else {
+                    u->parent->detach_array_element(u->index);
+                }
+                break;
+            case UNDO_SWAP:
+                if (u->parent->get_type() == JSON_TYPE_OBJECT) {
+                    u->parent->replace_object_value(u->index, u->node);
+                } else {
+                    u->parent->replace_array_element(u->index, u->node);
+                }
+                break;
+            case UNDO_ROOT:
+                u->parent->json_swap(u->node);
+                break;
+        }
+    }
+}
+
+static bool JsonPatch_is_prefix(const std::string& from, const std::string& path) {
+    return path.size() > from.size() && path.compare(0, from.size(), from) == 0 && path[from.size()] == '/';
+}
+
+int JsonPatch::apply(JsonNode* doc) {
+    int ret = JSON_PATCH_OK;
+    JsonNode* node;
+    this->undo.clear();
+    this->garbage.clear();
+    this->fresh.clear();
+    for (auto& op : this->operations) {
+        switch (op.op) {
+            case OP_ADD:
+            case OP_REPLACE:
+                node = new JsonNode();
+                node->json_init();
+                node->json_copy(op.value);
+                this->fresh.push_back(node);
+                ret = put(doc, op, node, op.op == OP_REPLACE);
+                break;
+            case OP_REMOVE:
+                if ((ret = take(doc, op.path, &node)) == JSON_PATCH_OK) {
+                    this->garbage.push_back(node);
+                }
+                break;
+            case OP_MOVE:
+                if (op.from_string == op.path_string) {
+                    ret = op.from.resolve(doc) != nullptr ? JSON_PATCH_OK : JSON_PATCH_PATH_NOT_FOUND;
+                } else if (JsonPatch_is_prefix(op.from_string, op.path_string)) {
+                    ret = JSON_PATCH_INVALID_POINTER;
+                } else if ((ret = take(doc, op.from, &node)) == JSON_PATCH_OK) {
+                    ret = put(doc, op, node, false);
+                }
+                break;
+            case OP_COPY:
+                if ((node = op.from.resolve(doc)) == nullptr) {
+                    ret = JSON_PATCH_PATH_NOT_FOUND;
+                    break;
+                }
+                {
+                    auto copy = new JsonNode();
+                    copy->json_init();
+                    copy->json_copy(node);
+                    this->fresh.push_back(copy);
+                    ret = put(doc, op, copy, false);
+                }
+                break;
+            case OP_TEST:
+                if ((node = op.path.resolve(doc)) == nullptr) {
+                    ret = JSON_PATCH_PATH_NOT_FOUND;
+                } else if (!node->json_is_equal(op.value)) {
+                    ret = JSON_PATCH_TEST_FAILED;
+                }
+                break;
+        }
+        if (ret != JSON_PATCH_OK) {
+            break;
+        }
+    }
+    if (ret == JSON_PATCH_OK) {
+        for (auto n : this->garbage) {
+            delete n;
+        }
+    } else {
+        rollback();
+        for (auto n : this->fresh) {
+            delete n;
+        }
+    }
+    this->undo.clear();
+    this->garbage.clear();
+    this->fresh.clear();
+    return ret;
+}
+
+//RFC 7386: members set to null are removed, objects merge recursively,
+//anything else replaces the target.
+void JsonPatch::merge(JsonNode* doc, const JsonNode* patch) {
+    if (patch->get_type() != JSON_TYPE_OBJECT) {
+        doc->json_free();
+        doc->json_copy(patch);
+        return;
+    }
+    if (doc->get_type() != JSON_TYPE_OBJECT) {
+        doc->json_free();
+        doc->set_object();
+    }
+    for (int i = 0; i < patch->get_object_size(); i++) {
+        std::string key = patch->get_object_key(i);
+        const JsonNode* value = patch->get_object_value(i);
+        int index = doc->find_object_index(key, 0);
+        if (value->get_type() == JSON_TYPE_NULL) {
+            if (index >= 0) {
+                delete doc->detach_object_value(index);
+            }
+        } else if (index >= 0) {
+            merge(doc->get_object_value(index), value);
+        } else {
+            auto node = new JsonNode();
+            node->json_init();
+            merge(node, value);
+            doc->pushback_object_element(key, node);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "json_pointer.h"
+
+//Json patch return
+enum {
+    JSON_PATCH_OK = 0,
+    JSON_PATCH_INVALID_OPERATION,
+    JSON_PATCH_INVALID_POINTER,
+    JSON_PATCH_PATH_NOT_FOUND,
+    JSON_PATCH_TEST_FAILED
+};
+
+//RFC 6902 patch, compiled once and applied in place. Every applied step is
+//recorded in an undo log, so a failing operation rolls the document back to
+//its original state. Cost depends on the patch, not on the document size.
+class JsonPatch final {
+public:
+    JsonPatch() = default;
+    JsonPatch(const JsonPatch& patch) = delete;
+    JsonPatch& operator=(const JsonPatch& patch) = delete;
+    ~JsonPatch();
+    int compile(const JsonNode* patch);
+    int get_operation_size() const;
+    int apply(JsonNode* doc);
+    static void merge(JsonNode* doc, const JsonNode* patch);
+
+private:
+    enum Op {
+        OP_ADD,
+        OP_REMOVE,
+        OP_REPLACE,
+        OP_MOVE,
+        OP_COPY,
+        OP_TEST
+    };
+    struct Operation {
+        Op op;
+        std::string path_string;
+        std::string from_string;
+        JsonPointer path;
+        JsonPointer from;
+        JsonNode* value;
+    };
+    enum UndoKind {
+        UNDO_TAKE,//reinsert a removed element or member
+        UNDO_PUT,//detach an inserted element or member
+        UNDO_SWAP,//put the replaced value back
+        UNDO_ROOT//swap the document root back
+    };
+    struct Undo {
+        UndoKind kind;
+        JsonNode* parent;
+        int index;
+        std::string key;
+        JsonNode* node;
+    };
+    void release();
+    int take(JsonNode* doc, JsonPointer& path, JsonNode** node);
+    int put(JsonNode* doc, Operation& op, JsonNode* node, bool replace);
+    void rollback();
+    std::vector<Operation> operations;
+    std::vector<Undo> undo;
+    std::vector<JsonNode*> garbage;//detached by the patch, freed on success
+    std::vector<JsonNode*> fresh;//copies made by the patch, freed on failure
+};
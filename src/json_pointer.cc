@@ -0,0 +1,107 @@
+#include "json_pointer.h"
+#include <cassert>
+#include <climits>
+
+static int JsonPointer_index(const std::string& token) {
+    if (token.empty() || token.size() > 10 || (token[0] == '0' && token.size() > 1)) {
+        return -1;
+    }
+    long long index = 0;
+    for (char ch : token) {
+        if (ch < '0' || ch > '9') {
+            return -1;
+        }
+        index = index * 10 + (ch - '0');
+    }
+    return index > INT_MAX ? -1 : (int) index;
+}
+
+int JsonPointer::compile(const std::string& pointer) {
+    this->tokens.clear();
+    if (pointer.empty()) {
+        return JSON_POINTER_OK;
+    }
+    if (pointer[0] != '/') {
+        return JSON_POINTER_INVALID_SYNTAX;
+    }
+    Token token{};
+    for (size_t i = 1; i <= pointer.size(); i++) {
+        if (i == pointer.size() || pointer[i] == '/') {
+            token.index = JsonPointer_index(token.key);
+            token.hint = 0;
+            this->tokens.push_back(token);
+            token.key.clear();
+        } else if (pointer[i] == '~') {
+            if (i + 1 < pointer.size() && pointer[i + 1] == '0') {
+                token.key.push_back('~');
+            } else if (i + 1 < pointer.size() && pointer[i + 1] == '1') {
+                token.key.push_back('/');
+            } else {
+                this->tokens.clear();
+                return JSON_POINTER_INVALID_ESCAPE;
+            }
+            i++;
+        } else {
+            token.key.push_back(pointer[i]);
+        }
+    }
+    return JSON_POINTER_OK;
+}
+
+int JsonPointer::get_token_size() const {
+    return this->tokens.size();
+}
+
+const std::string& JsonPointer::get_token(int index) const {
+    assert(index >= 0 && (size_t) index < this->tokens.size());
+    return this->tokens[index].key;
+}
+
+int JsonPointer::get_token_index(int index) const {
+    assert(index >= 0 && (size_t) index < this->tokens.size());
+    return this->tokens[index].index;
+}
+
+JsonNode* JsonPointer::resolve(JsonNode* root) {
+    return resolve_tokens(root, this->tokens.size());
+}
+
+//Resolves every token but the last one, i.e. the container the pointer refers into.
+JsonNode* JsonPointer::resolve_parent(JsonNode* root) {
+    assert(!this->tokens.empty());
+    return resolve_tokens(root, this->tokens.size() - 1);
+}
+
+JsonNode* JsonPointer::resolve_tokens(JsonNode* root, size_t count) {
+    JsonNode* node = root;
+    for (size_t i = 0; i < count; i++) {
+        Token& token = this->tokens[i];
+        if (node == nullptr) {
+            return nullptr;
+        }
+        switch (node->get_type()) {
+            case JSON_TYPE_OBJECT:
+                node = node->find_object_value(token.key, token.hint);
+                break;
+            case JSON_TYPE_ARRAY:
+                node = token.index < 0 ? nullptr : node->get_array_index(token.index);
+                break;
+            default:
+                return nullptr;
+        }
+    }
+    return node;
+}
+
+void JsonPointer::append_token(std::string& pointer, const std::string& token) {
+    pointer.push_back('/');
+    for (char ch : token) {
+        if (ch == '~') {
+            pointer += "~0";
+        } else if (ch == '/') {
+            pointer += "~1";
+        } else {
+            pointer.push_back(ch);
+        }
+    }
+}
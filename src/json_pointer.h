@@ -0,0 +1,33 @@
+#pragma once
+#include "tiny_json.h"
+
+//Json pointer compile return
+enum {
+    JSON_POINTER_OK = 0,
+    JSON_POINTER_INVALID_SYNTAX,
+    JSON_POINTER_INVALID_ESCAPE
+};
+
+//RFC 6901 pointer, parsed once and resolved many times.
+//Each token remembers where its key was found last time, so documents
+//of the same shape resolve without scanning object members.
+class JsonPointer final {
+public:
+    JsonPointer() = default;
+    int compile(const std::string& pointer);
+    int get_token_size() const;
+    const std::string& get_token(int index) const;
+    int get_token_index(int index) const;
+    JsonNode* resolve(JsonNode* root);
+    JsonNode* resolve_parent(JsonNode* root);
+    static void append_token(std::string& pointer, const std::string& token);
+
+private:
+    JsonNode* resolve_tokens(JsonNode* root, size_t count);
+    struct Token {
+        std::string key;
+        int index;//array index, -1 if the token is not a valid index
+        int hint;//object member position of the last match
+    };
+    std::vector<Token> tokens;
+};
@@ -0,0 +1,253 @@
+#include "json_reader.h"
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+JsonReader::JsonReader(const char* json) : parser(JsonContext{json}) {}
+
+//Type of the next value, judged by its first character.
+JsonType JsonReader::peek() {
+    this->parser.parse_whitespace();
+    switch (*this->parser.ctx.json) {
+        case 'n':
+            return JSON_TYPE_NULL;
+        case 't':
+            return JSON_TYPE_TRUE;
+        case 'f':
+            return JSON_TYPE_FALSE;
+        case '"':
+            return JSON_TYPE_STRING;
+        case '[':
+            return JSON_TYPE_ARRAY;
+        case '{':
+            return JSON_TYPE_OBJECT;
+        default:
+            return JSON_TYPE_NUMBER;
+    }
+}
+
+//Checks that the next value starts with ch. A value of another type is
+//JSON_PARSE_UNEXPECTED_TYPE; anything else is not a value at all.
+int JsonReader::expect(char ch) {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    this->parser.parse_whitespace();
+    char next = *this->parser.ctx.json;
+    if (next == ch) {
+        return JSON_PARSE_OK;
+    }
+    if (next == '\0') {
+        return this->set_error(JSON_PARSE_EXPECT_VALUE);
+    }
+    if (strchr("ntf\"[{-0123456789", next) != nullptr) {
+        return this->set_error(JSON_PARSE_UNEXPECTED_TYPE);
+    }
+    return this->set_error(JSON_PARSE_INVALID_VALUE);
+}
+
+int JsonReader::read_null() {
+    int ret;
+    if ((ret = this->expect('n')) != JSON_PARSE_OK) {
+        return ret;
+    }
+    if (strncmp(this->parser.ctx.json, "null", 4) != 0) {
+        return this->set_error(JSON_PARSE_INVALID_VALUE);
+    }
+    this->parser.ctx.json += 4;
+    return JSON_PARSE_OK;
+}
+
+int JsonReader::read_bool(bool& b) {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    if (this->peek() == JSON_TYPE_FALSE) {
+        if (strncmp(this->parser.ctx.json, "false", 5) != 0) {
+            return this->set_error(JSON_PARSE_INVALID_VALUE);
+        }
+        this->parser.ctx.json += 5;
+        b = false;
+        return JSON_PARSE_OK;
+    }
+    int ret;
+    if ((ret = this->expect('t')) != JSON_PARSE_OK) {
+        return ret;
+    }
+    if (strncmp(this->parser.ctx.json, "true", 4) != 0) {
+        return this->set_error(JSON_PARSE_INVALID_VALUE);
+    }
+    this->parser.ctx.json += 4;
+    b = true;
+    return JSON_PARSE_OK;
+}
+
+int JsonReader::read_number(double& num) {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    if (this->peek() != JSON_TYPE_NUMBER) {
+        return this->set_error(JSON_PARSE_UNEXPECTED_TYPE);
+    }
+    const char* p = this->parser.scan_number(this->parser.ctx.json);
+    if (p == nullptr) {
+        return this->set_error(*this->parser.ctx.json == '\0' ? JSON_PARSE_EXPECT_VALUE : JSON_PARSE_INVALID_VALUE);
+    }
+    errno = 0;
+    num = strtod(this->parser.ctx.json, nullptr);
+    if (errno == ERANGE && (num == HUGE_VAL || num == -HUGE_VAL)) {
+        return this->set_error(JSON_PARSE_NUMBER_TOO_BIG);
+    }
+    this->parser.ctx.json = p;
+    return JSON_PARSE_OK;
+}
+
+int JsonReader::read_string(std::string& str) {
+    int ret;
+    if ((ret = this->expect('"')) != JSON_PARSE_OK) {
+        return ret;
+    }
+    str.clear();
+    if ((ret = this->parser.parse_string_raw(str)) != JSON_PARSE_OK) {
+        return this->set_error(ret);
+    }
+    return JSON_PARSE_OK;
+}
+
+//Reads a member key and its colon. A key without escapes points into the
+//input, otherwise into a scratch buffer that the next read_key reuses.
+int JsonReader::read_key(const char*& key, size_t& length) {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    assert(!this->stack.empty() && this->stack.back().object);
+    this->parser.parse_whitespace();
+    const char* p = this->parser.ctx.json;
+    if (*p != '"') {
+        return this->set_error(JSON_PARSE_NOT_EXIST_KEY);
+    }
+    const char* end = p + 1;
+    while (*end != '"' && *end != '\\' && (unsigned char) *end >= 0x20) {
+        end++;
+    }
+    if (*end == '"') {
+        key = p + 1;
+        length = end - key;
+        this->parser.ctx.json = end + 1;
+    } else {
+        int ret;
+        this->scratch.clear();
+        if ((ret = this->parser.parse_string_raw(this->scratch)) != JSON_PARSE_OK) {
+            return this->set_error(ret);
+        }
+        key = this->scratch.data();
+        length = this->scratch.size();
+    }
+    this->parser.parse_whitespace();
+    if (*this->parser.ctx.json != ':') {
+        return this->set_error(JSON_PARSE_MISS_COLON);
+    }
+    this->parser.ctx.json++;
+    return JSON_PARSE_OK;
+}
+
+//Parses the next value, whatever its type, into node.
+int JsonReader::read_value(JsonNode& node) {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    this->parser.parse_whitespace();
+    node.json_free();
+    node.json_init();
+    int ret;
+    if ((ret = this->parser.parse_value(&node)) != JSON_PARSE_OK) {
+        return this->set_error(ret);
+    }
+    return JSON_PARSE_OK;
+}
+
+//Steps over the next value, still checking its syntax.
+int JsonReader::skip() {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    this->parser.parse_whitespace();
+    int ret;
+    if ((ret = this->parser.skip_value()) != JSON_PARSE_OK) {
+        return this->set_error(ret);
+    }
+    return JSON_PARSE_OK;
+}
+
+int JsonReader::begin_object() {
+    int ret;
+    if ((ret = this->expect('{')) != JSON_PARSE_OK) {
+        return ret;
+    }
+    this->parser.ctx.json++;
+    this->stack.push_back({true, true});
+    return JSON_PARSE_OK;
+}
+
+int JsonReader::begin_array() {
+    int ret;
+    if ((ret = this->expect('[')) != JSON_PARSE_OK) {
+        return ret;
+    }
+    this->parser.ctx.json++;
+    this->stack.push_back({false, true});
+    return JSON_PARSE_OK;
+}
+
+//True if the innermost container has another member or element; false at
+//its end, which it consumes, or on an error.
+bool JsonReader::has_next() {
+    if (this->error != JSON_PARSE_OK) {
+        return false;
+    }
+    assert(!this->stack.empty());
+    Level& level = this->stack.back();
+    this->parser.parse_whitespace();
+    char ch = *this->parser.ctx.json;
+    if (ch == (level.object ? '}' : ']')) {
+        this->parser.ctx.json++;
+        this->stack.pop_back();
+        return false;
+    }
+    if (!level.first) {
+        if (ch != ',') {
+            this->set_error(level.object ? JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET : JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+            return false;
+        }
+        this->parser.ctx.json++;
+    }
+    level.first = false;
+    return true;
+}
+
+//Ends the document: only whitespace may follow the top-level value.
+int JsonReader::finish() {
+    if (this->error != JSON_PARSE_OK) {
+        return this->error;
+    }
+    assert(this->stack.empty());
+    this->parser.parse_whitespace();
+    if (*this->parser.ctx.json != '\0') {
+        return this->set_error(JSON_PARSE_NOT_SINGLE_VALUE);
+    }
+    return JSON_PARSE_OK;
+}
+
+int JsonReader::get_error() const {
+    return this->error;
+}
+
+//Records error unless an earlier one is pending, and returns the pending one.
+int JsonReader::set_error(int error) {
+    if (this->error == JSON_PARSE_OK) {
+        this->error = error;
+    }
+    return this->error;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "parser.h"
+#include "tiny_json.h"
+
+//Pull parser: the caller walks the document value by value and nothing is
+//built unless asked for. Errors are sticky; after the first one every call
+//returns it and has_next() returns false. A container is read with
+//
+//    reader.begin_array();
+//    while (reader.has_next()) {
+//        reader.read_number(num);
+//    }
+//
+//with read_key before each member value in an object.
+class JsonReader final {
+public:
+    explicit JsonReader(const char* json);
+    JsonReader(const JsonReader& reader) = delete;
+    JsonReader& operator=(const JsonReader& reader) = delete;
+
+    JsonType peek();
+    int read_null();
+    int read_bool(bool& b);
+    int read_number(double& num);
+    int read_string(std::string& str);
+    int read_key(const char*& key, size_t& length);
+    int read_value(JsonNode& node);
+    int skip();
+
+    int begin_object();
+    int begin_array();
+    bool has_next();
+
+    int finish();
+    int get_error() const;
+    int set_error(int error);
+
+private:
+    struct Level {
+        bool object;
+        bool first;
+    };
+
+    int expect(char ch);
+
+    Parser parser;
+    std::vector<Level> stack;
+    std::string scratch;
+    int error = JSON_PARSE_OK;
+};
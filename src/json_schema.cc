@@ -0,0 +1,471 @@
+#include "json_schema.h"
+#include "json_pointer.h"
+#include "parser.h"
+#include <cassert>
+#include <climits>
+#include <cmath>
+
+//std::regex in libstdc++ backtracks with one level of recursion per
+//character, so a long string can overflow the stack. Its polynomial mode
+//matches breadth-first with a stack bounded by the pattern instead, at the
+//price of back-references, which compile then reports as unsupported.
+//Other libraries get a cap on the length matched, and longer strings fail
+//the pattern.
+#ifdef __GLIBCXX__
+static const std::regex::flag_type JsonSchema_regex = std::regex::ECMAScript | std::regex_constants::__polynomial;
+static const size_t JsonSchema_pattern_max = SIZE_MAX;
+#else
+static const std::regex::flag_type JsonSchema_regex = std::regex::ECMAScript;
+static const size_t JsonSchema_pattern_max = 4096;
+#endif
+
+static bool JsonSchema_search(const std::string& str, const std::regex& pattern) {
+    return str.size() <= JsonSchema_pattern_max && std::regex_search(str, pattern);
+}
+
+JsonSchema::~JsonSchema() {
+    this->clear();
+}
+
+void JsonSchema::clear() {
+    for (auto& rule : this->rules) {
+        for (auto node : rule.enums) {
+            delete node;
+        }
+    }
+    this->rules.clear();
+}
+
+static const char* const JsonSchema_unsupported[] = {
+        "$ref", "allOf", "anyOf", "oneOf", "not", "if", "then", "else", "const", "contains", "multipleOf",
+        "uniqueItems", "additionalItems", "additionalProperties", "patternProperties", "propertyNames",
+        "dependencies", "minProperties", "maxProperties",
+};
+
+//A non-negative integer keyword value.
+static bool JsonSchema_count(const JsonNode* value, long& count) {
+    if (value->get_type() != JSON_TYPE_NUMBER || value->get_number() < 0 ||
+        value->get_number() != std::floor(value->get_number()) || value->get_number() > 1e15) {
+        return false;
+    }
+    count = (long) value->get_number();
+    return true;
+}
+
+static unsigned JsonSchema_type(const std::string& name) {
+    static const char* const names[] = {"null", "boolean", "integer", "number", "string", "array", "object"};
+    for (int i = 0; i < 7; i++) {
+        if (name == names[i]) {
+            return 1u << i;
+        }
+    }
+    return 0;
+}
+
+//Compiles schema into a new rule and returns its index, or a negative
+//JSON_SCHEMA_* code.
+int JsonSchema::compile_rule(const JsonNode* schema) {
+    int index = this->rules.size();
+    this->rules.emplace_back();
+    if (schema->get_type() == JSON_TYPE_TRUE || schema->get_type() == JSON_TYPE_FALSE) {
+        this->rules[index].never = schema->get_type() == JSON_TYPE_FALSE;
+        return index;
+    }
+    if (schema->get_type() != JSON_TYPE_OBJECT) {
+        return -JSON_SCHEMA_INVALID_SCHEMA;
+    }
+    for (int i = 0; i < schema->get_object_size(); i++) {
+        std::string keyword = schema->get_object_key(i);
+        const JsonNode* value = schema->get_object_value(i);
+        JsonType type = value->get_type();
+        for (const char* name : JsonSchema_unsupported) {
+            if (keyword == name) {
+                return -JSON_SCHEMA_UNSUPPORTED;
+            }
+        }
+        if (keyword == "type") {
+            unsigned types = 0;
+            if (type == JSON_TYPE_STRING) {
+                types = JsonSchema_type(value->get_string());
+            } else if (type == JSON_TYPE_ARRAY) {
+                for (int j = 0; j < value->get_array_size(); j++) {
+                    const JsonNode* name = value->get_array_index(j);
+                    unsigned bit = name != nullptr && name->get_type() == JSON_TYPE_STRING
+                                           ? JsonSchema_type(name->get_string())
+                                           : 0;
+                    if (bit == 0) {
+                        return -JSON_SCHEMA_INVALID_SCHEMA;
+                    }
+                    types |= bit;
+                }
+            }
+            if (types == 0) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            this->rules[index].types = types;
+        } else if (keyword == "properties") {
+            if (type != JSON_TYPE_OBJECT) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            for (int j = 0; j < value->get_object_size(); j++) {
+                int property = this->compile_rule(value->get_object_value(j));
+                if (property < 0) {
+                    return property;
+                }
+                this->rules[index].properties.emplace_back(value->get_object_key(j), property);
+            }
+        } else if (keyword == "required") {
+            if (type != JSON_TYPE_ARRAY) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            for (int j = 0; j < value->get_array_size(); j++) {
+                if (value->get_array_index(j) == nullptr || value->get_array_index(j)->get_type() != JSON_TYPE_STRING) {
+                    return -JSON_SCHEMA_INVALID_SCHEMA;
+                }
+                this->rules[index].required.push_back(value->get_array_index(j)->get_string());
+            }
+        } else if (keyword == "items") {
+            if (type == JSON_TYPE_ARRAY) {
+                for (int j = 0; j < value->get_array_size(); j++) {
+                    if (value->get_array_index(j) == nullptr) {
+                        return -JSON_SCHEMA_INVALID_SCHEMA;
+                    }
+                    int item = this->compile_rule(value->get_array_index(j));
+                    if (item < 0) {
+                        return item;
+                    }
+                    this->rules[index].tuple.push_back(item);
+                }
+            } else {
+                int item = this->compile_rule(value);
+                if (item < 0) {
+                    return item;
+                }
+                this->rules[index].items = item;
+            }
+        } else if (keyword == "enum") {
+            if (type != JSON_TYPE_ARRAY) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            for (int j = 0; j < value->get_array_size(); j++) {
+                JsonNode* copy = new JsonNode();
+                copy->json_init();
+                if (value->is_packed_array()) {
+                    copy->set_number(value->get_array_number(j));
+                } else {
+                    copy->json_copy(value->get_array_index(j));
+                }
+                this->rules[index].enums.push_back(copy);
+            }
+        } else if (keyword == "minimum" || keyword == "maximum" || keyword == "exclusiveMinimum" ||
+                   keyword == "exclusiveMaximum") {
+            if (type != JSON_TYPE_NUMBER) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            Rule& rule = this->rules[index];
+            if (keyword == "minimum") {
+                rule.limits |= LIMIT_MINIMUM;
+                rule.minimum = value->get_number();
+            } else if (keyword == "maximum") {
+                rule.limits |= LIMIT_MAXIMUM;
+                rule.maximum = value->get_number();
+            } else if (keyword == "exclusiveMinimum") {
+                rule.limits |= LIMIT_EXCLUSIVE_MINIMUM;
+                rule.exclusive_minimum = value->get_number();
+            } else {
+                rule.limits |= LIMIT_EXCLUSIVE_MAXIMUM;
+                rule.exclusive_maximum = value->get_number();
+            }
+        } else if (keyword == "minLength" || keyword == "maxLength" || keyword == "minItems" || keyword == "maxItems") {
+            long count;
+            if (!JsonSchema_count(value, count)) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            Rule& rule = this->rules[index];
+            if (keyword == "minLength") {
+                rule.min_length = count;
+            } else if (keyword == "maxLength") {
+                rule.max_length = count;
+            } else if (keyword == "minItems") {
+                rule.min_items = count;
+            } else {
+                rule.max_items = count;
+            }
+        } else if (keyword == "pattern") {
+            if (type != JSON_TYPE_STRING) {
+                return -JSON_SCHEMA_INVALID_SCHEMA;
+            }
+            //std::regex reports a bad pattern only by throwing.
+            try {
+                this->rules[index].pattern = std::regex(value->get_string(), JsonSchema_regex);
+            } catch (const std::regex_error&) {
+                try {
+                    std::regex(value->get_string(), std::regex::ECMAScript);
+                } catch (const std::regex_error&) {
+                    return -JSON_SCHEMA_INVALID_SCHEMA;
+                }
+                return -JSON_SCHEMA_UNSUPPORTED;
+            }
+            this->rules[index].has_pattern = true;
+        }
+    }
+    return index;
+}
+
+int JsonSchema::compile(const JsonNode* schema) {
+    assert(schema != nullptr);
+    this->clear();
+    int ret = this->compile_rule(schema);
+    if (ret < 0) {
+        this->clear();
+        return -ret;
+    }
+    return JSON_SCHEMA_OK;
+}
+
+//Rule for the member key, or -1. hint is where the previous lookup
+//matched, so members in schema order are found in one step each.
+int JsonSchema::find_property(int rule, const std::string& key, int& hint) const {
+    const auto& properties = this->rules[rule].properties;
+    for (size_t i = 0; i < properties.size(); i++) {
+        size_t j = (hint + i) % properties.size();
+        if (properties[j].first == key) {
+            hint = j + 1;
+            return properties[j].second;
+        }
+    }
+    return -1;
+}
+
+//Rule for the array element at index, or -1.
+int JsonSchema::get_item(int rule, int index) const {
+    const Rule& r = this->rules[rule];
+    if (!r.tuple.empty()) {
+        return index >= 0 && (size_t) index < r.tuple.size() ? r.tuple[index] : -1;
+    }
+    return r.items;
+}
+
+//Whether a value starting with first can have an accepted type.
+bool JsonSchema::accepts(int rule, char first) const {
+    const Rule& r = this->rules[rule];
+    if (r.never) {
+        return false;
+    }
+    if (r.types == 0) {
+        return true;
+    }
+    switch (first) {
+        case 'n':
+            return r.types & TYPE_NULL;
+        case 't':
+        case 'f':
+            return r.types & TYPE_BOOLEAN;
+        case '"':
+            return r.types & TYPE_STRING;
+        case '[':
+            return r.types & TYPE_ARRAY;
+        case '{':
+            return r.types & TYPE_OBJECT;
+        default:
+            return r.types & (TYPE_NUMBER | TYPE_INTEGER);
+    }
+}
+
+static bool JsonSchema_fail(std::vector<JsonSchemaError>* errors, const std::string& pointer, const char* keyword,
+                            const std::string& message) {
+    if (errors != nullptr) {
+        errors->push_back({pointer, keyword, message});
+    }
+    return false;
+}
+
+//Length in code points, as JSON Schema counts it.
+static long JsonSchema_length(const std::string& str) {
+    long length = 0;
+    for (unsigned char ch : str) {
+        length += (ch & 0xC0) != 0x80;
+    }
+    return length;
+}
+
+//Checks node against rule, and its members and elements too when deep.
+//Returns true if valid; stops at the first failure unless all_errors.
+bool JsonSchema::check(int rule, const JsonNode* node, bool deep, std::string& pointer,
+                       std::vector<JsonSchemaError>* errors, bool all_errors) const {
+    const Rule& r = this->rules[rule];
+    bool valid = true;
+    if (r.never) {
+        return JsonSchema_fail(errors, pointer, "false", "no value is allowed");
+    }
+    JsonType type = node->get_type();
+    if (r.types != 0) {
+        unsigned bits;
+        switch (type) {
+            case JSON_TYPE_NULL:
+                bits = TYPE_NULL;
+                break;
+            case JSON_TYPE_TRUE:
+            case JSON_TYPE_FALSE:
+                bits = TYPE_BOOLEAN;
+                break;
+            case JSON_TYPE_NUMBER:
+                bits = node->get_number() == std::floor(node->get_number()) ? TYPE_NUMBER | TYPE_INTEGER : TYPE_NUMBER;
+                break;
+            case JSON_TYPE_STRING:
+                bits = TYPE_STRING;
+                break;
+            case JSON_TYPE_ARRAY:
+                bits = TYPE_ARRAY;
+                break;
+            default:
+                bits = TYPE_OBJECT;
+        }
+        if ((r.types & bits) == 0) {
+            return JsonSchema_fail(errors, pointer, "type", "value has the wrong type");
+        }
+    }
+    if (!r.enums.empty()) {
+        bool found = false;
+        for (auto value : r.enums) {
+            if (value->json_is_equal(const_cast<JsonNode*>(node))) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            valid = JsonSchema_fail(errors, pointer, "enum", "value is not one of the enumerated values");
+            if (!all_errors) {
+                return false;
+            }
+        }
+    }
+    if (type == JSON_TYPE_NUMBER && r.limits != 0) {
+        double num = node->get_number();
+        const char* keyword = nullptr;
+        if ((r.limits & LIMIT_MINIMUM) && num < r.minimum) {
+            keyword = "minimum";
+        } else if ((r.limits & LIMIT_MAXIMUM) && num > r.maximum) {
+            keyword = "maximum";
+        } else if ((r.limits & LIMIT_EXCLUSIVE_MINIMUM) && num <= r.exclusive_minimum) {
+            keyword = "exclusiveMinimum";
+        } else if ((r.limits & LIMIT_EXCLUSIVE_MAXIMUM) && num >= r.exclusive_maximum) {
+            keyword = "exclusiveMaximum";
+        }
+        if (keyword != nullptr) {
+            valid = JsonSchema_fail(errors, pointer, keyword, "number is out of range");
+            if (!all_errors) {
+                return false;
+            }
+        }
+    } else if (type == JSON_TYPE_STRING) {
+        if (r.min_length >= 0 || r.max_length >= 0) {
+            long length = JsonSchema_length(node->get_string());
+            if ((r.min_length >= 0 && length < r.min_length) || (r.max_length >= 0 && length > r.max_length)) {
+                valid = JsonSchema_fail(errors, pointer, length < r.min_length ? "minLength" : "maxLength",
+                                        "string length is out of range");
+                if (!all_errors) {
+                    return false;
+                }
+            }
+        }
+        if (r.has_pattern && !JsonSchema_search(node->get_string(), r.pattern)) {
+            valid = JsonSchema_fail(errors, pointer, "pattern", "string does not match the pattern");
+            if (!all_errors) {
+                return false;
+            }
+        }
+    } else if (type == JSON_TYPE_ARRAY) {
+        long size = node->get_array_size();
+        if ((r.min_items >= 0 && size < r.min_items) || (r.max_items >= 0 && size > r.max_items)) {
+            valid = JsonSchema_fail(errors, pointer, size < r.min_items ? "minItems" : "maxItems",
+                                    "array size is out of range");
+            if (!all_errors) {
+                return false;
+            }
+        }
+        if (deep && (r.items >= 0 || !r.tuple.empty())) {
+            size_t length = pointer.size();
+            for (int i = 0; i < size; i++) {
+                int item = this->get_item(rule, i);
+                if (item < 0) {
+                    break;
+                }
+                //The elements of a packed array are checked as number nodes of their own.
+                const JsonNode* element = node->get_array_index(i);
+                JsonNode number;
+                if (element == nullptr) {
+                    number.set_number(node->get_array_number(i));
+                    element = &number;
+                }
+                JsonPointer::append_token(pointer, std::to_string(i));
+                bool ok = this->check(item, element, true, pointer, errors, all_errors);
+                pointer.resize(length);
+                if (!ok) {
+                    valid = false;
+                    if (!all_errors) {
+                        return false;
+                    }
+                }
+            }
+        }
+    } else if (type == JSON_TYPE_OBJECT) {
+        for (const auto& key : r.required) {
+            if (node->find_object_index(key, 0) < 0) {
+                valid = JsonSchema_fail(errors, pointer, "required", "missing property \"" + key + "\"");
+                if (!all_errors) {
+                    return false;
+                }
+            }
+        }
+        if (deep && !r.properties.empty()) {
+            size_t length = pointer.size();
+            int hint = 0;
+            for (int i = 0; i < node->get_object_size(); i++) {
+                std::string key = node->get_object_key(i);
+                int property = this->find_property(rule, key, hint);
+                if (property < 0) {
+                    continue;
+                }
+                JsonPointer::append_token(pointer, key);
+                bool ok = this->check(property, node->get_object_value(i), true, pointer, errors, all_errors);
+                pointer.resize(length);
+                if (!ok) {
+                    valid = false;
+                    if (!all_errors) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return valid;
+}
+
+//JSON_SCHEMA_OK or JSON_SCHEMA_MISMATCH, stopping at the first failure.
+int JsonSchema::validate(const JsonNode* node) const {
+    assert(node != nullptr && !this->rules.empty());
+    std::string pointer;
+    return this->check(0, node, true, pointer, nullptr, false) ? JSON_SCHEMA_OK : JSON_SCHEMA_MISMATCH;
+}
+
+//Like validate(node), also reporting where and why; with all_errors every
+//failure is collected instead of only the first.
+int JsonSchema::validate(const JsonNode* node, std::vector<JsonSchemaError>& errors, bool all_errors) const {
+    assert(node != nullptr && !this->rules.empty());
+    std::string pointer;
+    errors.clear();
+    return this->check(0, node, true, pointer, &errors, all_errors) ? JSON_SCHEMA_OK : JSON_SCHEMA_MISMATCH;
+}
+
+//Parses and validates in one pass. Returns the JSON_PARSE_* code of
+//json_parse, or JSON_PARSE_SCHEMA_MISMATCH with the failure in error.
+int JsonSchema::parse(const char* json, JsonNode* node, JsonSchemaError* error) const {
+    assert(node != nullptr && !this->rules.empty());
+    JsonContext ctx{};
+    ctx.json = json;
+    JsonSchemaError local;
+    node->json_init();
+    Parser p(ctx);
+    return p.parse(*node, *this, error != nullptr ? *error : local);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "tiny_json.h"
+#include <regex>
+
+//Json schema return
+enum {
+    JSON_SCHEMA_OK = 0,
+    JSON_SCHEMA_INVALID_SCHEMA,
+    JSON_SCHEMA_UNSUPPORTED,
+    JSON_SCHEMA_MISMATCH
+};
+
+struct JsonSchemaError {
+    std::string pointer;//location of the offending value
+    std::string keyword;//the keyword that failed, e.g. "type" or "required"
+    std::string message;
+};
+
+//JSON Schema (draft 7) validator, compiled once and reused. Supported
+//keywords: type, properties, required, items (a schema or a tuple), enum,
+//minimum, maximum, exclusiveMinimum, exclusiveMaximum, minLength, maxLength,
+//minItems, maxItems and pattern, plus the true and false schemas. Other
+//validation keywords make compile return JSON_SCHEMA_UNSUPPORTED instead of
+//being silently ignored; annotations such as title are ignored. A pattern
+//with a back-reference is unsupported too, so that matching never
+//backtracks.
+//
+//parse validates while parsing: a value is checked as soon as it is
+//complete and a container's type as soon as it opens, so an invalid
+//payload is rejected with JSON_PARSE_SCHEMA_MISMATCH before the rest of it
+//is read.
+class JsonSchema final {
+public:
+    JsonSchema() = default;
+    JsonSchema(const JsonSchema& schema) = delete;
+    JsonSchema& operator=(const JsonSchema& schema) = delete;
+    ~JsonSchema();
+    int compile(const JsonNode* schema);
+    int validate(const JsonNode* node) const;
+    int validate(const JsonNode* node, std::vector<JsonSchemaError>& errors, bool all_errors = true) const;
+    int parse(const char* json, JsonNode* node, JsonSchemaError* error = nullptr) const;
+
+private:
+    friend class Parser;
+    enum {
+        TYPE_NULL = 1,
+        TYPE_BOOLEAN = 2,
+        TYPE_INTEGER = 4,
+        TYPE_NUMBER = 8,
+        TYPE_STRING = 16,
+        TYPE_ARRAY = 32,
+        TYPE_OBJECT = 64
+    };
+    enum {
+        LIMIT_MINIMUM = 1,
+        LIMIT_MAXIMUM = 2,
+        LIMIT_EXCLUSIVE_MINIMUM = 4,
+        LIMIT_EXCLUSIVE_MAXIMUM = 8
+    };
+    struct Rule {
+        bool never = false;
+        unsigned types = 0;//0 accepts every type
+        std::vector<std::pair<std::string, int>> properties;
+        std::vector<std::string> required;
+        int items = -1;
+        std::vector<int> tuple;
+        std::vector<JsonNode*> enums;
+        unsigned limits = 0;
+        double minimum = 0;
+        double maximum = 0;
+        double exclusive_minimum = 0;
+        double exclusive_maximum = 0;
+        long min_length = -1;
+        long max_length = -1;
+        long min_items = -1;
+        long max_items = -1;
+        bool has_pattern = false;
+        std::regex pattern;
+    };
+    int compile_rule(const JsonNode* schema);
+    int find_property(int rule, const std::string& key, int& hint) const;
+    int get_item(int rule, int index) const;
+    bool accepts(int rule, char first) const;
+    bool check(int rule, const JsonNode* node, bool deep, std::string& pointer, std::vector<JsonSchemaError>* errors,
+               bool all_errors) const;
+    void clear();
+    std::vector<Rule> rules;
+};
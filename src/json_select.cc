@@ -0,0 +1,104 @@
+#include "json_select.h"
+#include "json_pointer.h"
+#include "parser.h"
+
+JsonSelector::JsonSelector() : steps(1, Step{"", false, -1, {}}), path_size(0) {}
+
+int JsonSelector::add_path(const std::string& path) {
+    JsonPointer p;
+    int ret;
+    if ((ret = p.compile(path)) != JSON_POINTER_OK) {
+        return ret;
+    }
+    int step = 0;
+    for (int i = 0; i < p.get_token_size(); i++) {
+        const std::string& token = p.get_token(i);
+        bool wildcard = token == "*";
+        int next = -1;
+        for (int child : this->steps[step].children) {
+            if (this->steps[child].wildcard == wildcard && this->steps[child].key == token) {
+                next = child;
+                break;
+            }
+        }
+        if (next < 0) {
+            next = this->steps.size();
+            this->steps.push_back(Step{token, wildcard, -1, {}});
+            this->steps[step].children.push_back(next);
+        }
+        step = next;
+    }
+    if (this->steps[step].path < 0) {
+        this->steps[step].path = this->path_size;
+    }
+    this->path_size++;
+    return JSON_POINTER_OK;
+}
+
+int JsonSelector::get_path_size() const {
+    return this->path_size;
+}
+
+//On error the selections made by this call are released and removed.
+int JsonSelector::extract(const char* json, std::vector<JsonSelection>& out) const {
+    JsonContext ctx{};
+    ctx.json = json;
+    Parser p(ctx);
+    size_t size = out.size();
+    int ret = p.select(*this, out);
+    if (ret != JSON_PARSE_OK) {
+        for (size_t i = size; i < out.size(); i++) {
+            delete out[i].value;
+        }
+        out.resize(size);
+    }
+    return ret;
+}
+
+void JsonSelector::match(const std::vector<int>& steps, const std::string& key, std::vector<int>& next) const {
+    for (int step : steps) {
+        for (int child : this->steps[step].children) {
+            if (this->steps[child].wildcard || this->steps[child].key == key) {
+                next.push_back(child);
+            }
+        }
+    }
+}
+
+//Used when a matched value is also the parent of other matches, e.g. /a and /a/b.
+void JsonSelector::select_tree(const JsonNode* node, const std::vector<int>& steps, std::string& pointer,
+                               std::vector<JsonSelection>& out) const {
+    for (int step : steps) {
+        if (this->steps[step].path >= 0) {
+            auto copy = new JsonNode();
+            copy->json_init();
+            copy->json_copy(node);
+            out.push_back({this->steps[step].path, pointer, copy});
+        }
+    }
+    std::vector<int> next;
+    size_t length = pointer.size();
+    if (node->get_type() == JSON_TYPE_OBJECT) {
+        for (int i = 0; i < node->get_object_size(); i++) {
+            std::string key = node->get_object_key(i);
+            next.clear();
+            match(steps, key, next);
+            if (!next.empty()) {
+                JsonPointer::append_token(pointer, key);
+                select_tree(node->get_object_value(i), next, pointer, out);
+                pointer.resize(length);
+            }
+        }
+    } else if (node->get_type() == JSON_TYPE_ARRAY) {
+        for (int i = 0; i < node->get_array_size(); i++) {
+            std::string token = std::to_string(i);
+            next.clear();
+            match(steps, token, next);
+            if (!next.empty()) {
+                JsonPointer::append_token(pointer, token);
+                select_tree(node->get_array_index(i), next, pointer, out);
+                pointer.resize(length);
+            }
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "tiny_json.h"
+
+struct JsonSelection {
+    int path;//index of the matched path, in add_path order
+    std::string pointer;//concrete location of the value, e.g. /items/3/price
+    JsonNode* value;//owned by the caller
+};
+
+//Extracts only the values reached by a set of pointer paths, skipping the
+//rest of the document without building nodes. A "*" token matches any
+//member or element.
+class JsonSelector final {
+public:
+    JsonSelector();
+    int add_path(const std::string& path);
+    int get_path_size() const;
+    int extract(const char* json, std::vector<JsonSelection>& out) const;
+
+private:
+    friend class Parser;
+    struct Step {
+        std::string key;
+        bool wildcard;
+        int path;//-1 if no path ends here
+        std::vector<int> children;
+    };
+    void match(const std::vector<int>& steps, const std::string& key, std::vector<int>& next) const;
+    void select_tree(const JsonNode* node, const std::vector<int>& steps, std::string& pointer,
+                     std::vector<JsonSelection>& out) const;
+    std::vector<Step> steps;
+    int path_size;
+};
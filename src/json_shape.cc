@@ -0,0 +1,84 @@
+#include "json_shape.h"
+#include "json_stringify.h"
+#include "parser.h"
+#include <cassert>
+
+JsonShape::JsonShape() : shapes(1, Shape{{}, -1}) {}
+
+//Appends key to the expected member order of shape and returns the shape
+//describing that member's value.
+int JsonShape::add_member(int shape, const std::string& key) {
+    assert(shape >= 0 && (size_t) shape < this->shapes.size());
+    std::string token;
+    JsonStringify_string(key.data(), key.size(), token);
+    int member = this->shapes.size();
+    this->shapes.push_back({{}, -1});
+    this->shapes[shape].members.push_back({key, token, member});
+    return member;
+}
+
+//Returns the shape describing every element of the array at shape.
+int JsonShape::set_element(int shape) {
+    assert(shape >= 0 && (size_t) shape < this->shapes.size());
+    if (this->shapes[shape].element < 0) {
+        int element = this->shapes.size();
+        this->shapes.push_back({{}, -1});
+        this->shapes[shape].element = element;
+    }
+    return this->shapes[shape].element;
+}
+
+int JsonShape::get_shape_size() const {
+    return this->shapes.size();
+}
+
+//Takes the member order of "properties" and the element layout of "items"
+//from a JSON Schema; every other keyword is ignored.
+int JsonShape::compile_schema(int shape, const JsonNode* schema) {
+    if (schema->get_type() != JSON_TYPE_OBJECT) {
+        return schema->get_type() == JSON_TYPE_TRUE || schema->get_type() == JSON_TYPE_FALSE ? JSON_SHAPE_OK
+                                                                                              : JSON_SHAPE_INVALID_SCHEMA;
+    }
+    int ret;
+    for (int i = 0; i < schema->get_object_size(); i++) {
+        std::string keyword = schema->get_object_key(i);
+        const JsonNode* value = schema->get_object_value(i);
+        if (keyword == "properties") {
+            if (value->get_type() != JSON_TYPE_OBJECT) {
+                return JSON_SHAPE_INVALID_SCHEMA;
+            }
+            for (int j = 0; j < value->get_object_size(); j++) {
+                int member = this->add_member(shape, value->get_object_key(j));
+                if ((ret = this->compile_schema(member, value->get_object_value(j))) != JSON_SHAPE_OK) {
+                    return ret;
+                }
+            }
+        } else if (keyword == "items" && value->get_type() == JSON_TYPE_OBJECT) {
+            if ((ret = this->compile_schema(this->set_element(shape), value)) != JSON_SHAPE_OK) {
+                return ret;
+            }
+        }
+    }
+    return JSON_SHAPE_OK;
+}
+
+//Replaces the shape with the one described by a JSON Schema.
+int JsonShape::compile(const JsonNode* schema) {
+    assert(schema != nullptr);
+    this->shapes.assign(1, Shape{{}, -1});
+    int ret = this->compile_schema(0, schema);
+    if (ret != JSON_SHAPE_OK) {
+        this->shapes.assign(1, Shape{{}, -1});
+    }
+    return ret;
+}
+
+//Same result and errors as JsonNode::json_parse.
+int JsonShape::parse(const char* json, JsonNode* node) const {
+    assert(node != nullptr);
+    JsonContext ctx{};
+    ctx.json = json;
+    node->json_init();
+    Parser p(ctx);
+    return p.parse(*node, *this);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "tiny_json.h"
+
+//Json shape return
+enum {
+    JSON_SHAPE_OK = 0,
+    JSON_SHAPE_INVALID_SCHEMA
+};
+
+//Expected layout of the documents of one schema: the keys each object
+//usually has, in the order they usually come, and the layout of array
+//elements. A shaped parse checks the next key against the expected one
+//with a single compare and only decodes keys that differ; those still
+//parse correctly, so a shape is a speed hint and never changes the result.
+//Shape 0 is the document root.
+class JsonShape final {
+public:
+    JsonShape();
+    int add_member(int shape, const std::string& key);
+    int set_element(int shape);
+    int get_shape_size() const;
+    int compile(const JsonNode* schema);
+    int parse(const char* json, JsonNode* node) const;
+
+private:
+    friend class Parser;
+    struct Member {
+        std::string key;
+        std::string token;//the key as it appears in compact JSON, quotes included
+        int shape;
+    };
+    struct Shape {
+        std::vector<Member> members;
+        int element;//-1 if elements are not described
+    };
+    int compile_schema(int shape, const JsonNode* schema);
+    std::vector<Shape> shapes;
+};
@@ -0,0 +1,128 @@
+#include "json_sink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//Chunks queued per flush; stays under IOV_MAX on every platform.
+static const int JSON_SINK_MAX_CHUNKS = 64;
+//Runs shorter than this are cheaper to copy than to queue.
+static const size_t JSON_SINK_STABLE_MIN = 1024;
+
+bool JsonFdSink::write(const JsonChunk* chunks, int count) {
+    struct iovec iov[JSON_SINK_MAX_CHUNKS];
+    int n = 0;
+    while (count > 0 || n > 0) {
+        while (count > 0 && n < JSON_SINK_MAX_CHUNKS) {
+            if (chunks->size > 0) {
+                iov[n].iov_base = const_cast<char*>(chunks->data);
+                iov[n].iov_len = chunks->size;
+                n++;
+            }
+            chunks++;
+            count--;
+        }
+        if (n == 0) {
+            break;
+        }
+        ssize_t written = writev(this->fd, iov, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        //Drop what went out and keep the rest of a short write.
+        int done = 0;
+        while (done < n && (size_t) written >= iov[done].iov_len) {
+            written -= iov[done].iov_len;
+            done++;
+        }
+        if (done < n) {
+            iov[done].iov_base = static_cast<char*>(iov[done].iov_base) + written;
+            iov[done].iov_len -= written;
+        }
+        memmove(iov, iov + done, (n - done) * sizeof(struct iovec));
+        n -= done;
+    }
+    return true;
+}
+
+bool JsonFileSink::write(const JsonChunk* chunks, int count) {
+    for (int i = 0; i < count; i++) {
+        if (fwrite(chunks[i].data, 1, chunks[i].size, this->file) != chunks[i].size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonStreamSink::write(const JsonChunk* chunks, int count) {
+    for (int i = 0; i < count; i++) {
+        this->stream.write(chunks[i].data, chunks[i].size);
+    }
+    return !this->stream.fail();
+}
+
+bool JsonCallbackSink::write(const JsonChunk* chunks, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!this->callback(chunks[i].data, chunks[i].size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+JsonSinkBuffer::JsonSinkBuffer(JsonSink& sink, size_t buffer_size) : sink(sink), buffer(buffer_size > 0 ? buffer_size : 1) {
+    this->chunks.reserve(JSON_SINK_MAX_CHUNKS);
+}
+
+void JsonSinkBuffer::append(const char* data, size_t size) {
+    while (size > 0) {
+        if (this->used == this->buffer.size()) {
+            this->flush();
+        }
+        size_t n = std::min(size, this->buffer.size() - this->used);
+        memcpy(this->buffer.data() + this->used, data, n);
+        this->used += n;
+        data += n;
+        size -= n;
+    }
+}
+
+//Queues data by reference; the caller keeps it alive until the next flush.
+void JsonSinkBuffer::append_stable(const char* data, size_t size) {
+    if (size < JSON_SINK_STABLE_MIN) {
+        this->append(data, size);
+        return;
+    }
+    this->seal();
+    this->chunks.push_back({data, size});
+    if (this->chunks.size() + 1 >= JSON_SINK_MAX_CHUNKS) {
+        this->flush();
+    }
+}
+
+//Closes the bytes staged since the last chunk into a chunk of their own.
+void JsonSinkBuffer::seal() {
+    if (this->used > this->sealed) {
+        this->chunks.push_back({this->buffer.data() + this->sealed, this->used - this->sealed});
+        this->sealed = this->used;
+    }
+}
+
+bool JsonSinkBuffer::flush() {
+    this->seal();
+    if (this->ok && !this->chunks.empty()) {
+        this->ok = this->sink.write(this->chunks.data(), this->chunks.size());
+    }
+    this->chunks.clear();
+    this->used = 0;
+    this->sealed = 0;
+    return this->ok;
+}
+
+bool JsonSinkBuffer::is_ok() const {
+    return this->ok;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "tiny_json.h"
+#include <cstdio>
+#include <functional>
+#include <ostream>
+
+//Json stringify return
+enum {
+    JSON_STRINGIFY_OK = 0,
+    JSON_STRINGIFY_SINK_ERROR
+};
+
+//One contiguous piece of output, laid out like struct iovec.
+struct JsonChunk {
+    const char* data;
+    size_t size;
+};
+
+//Destination of streamed output. write receives the pieces of one flush
+//in order and returns false if any byte could not be written.
+class JsonSink {
+public:
+    virtual ~JsonSink() = default;
+    virtual bool write(const JsonChunk* chunks, int count) = 0;
+};
+
+//Writes to a file descriptor with writev, retrying short writes and EINTR.
+class JsonFdSink final : public JsonSink {
+public:
+    explicit JsonFdSink(int fd) : fd(fd) {}
+    bool write(const JsonChunk* chunks, int count) override;
+
+private:
+    int fd;
+};
+
+class JsonFileSink final : public JsonSink {
+public:
+    explicit JsonFileSink(FILE* file) : file(file) {}
+    bool write(const JsonChunk* chunks, int count) override;
+
+private:
+    FILE* file;
+};
+
+class JsonStreamSink final : public JsonSink {
+public:
+    explicit JsonStreamSink(std::ostream& stream) : stream(stream) {}
+    bool write(const JsonChunk* chunks, int count) override;
+
+private:
+    std::ostream& stream;
+};
+
+//Calls back once per chunk; returning false from the callback stops the output.
+class JsonCallbackSink final : public JsonSink {
+public:
+    explicit JsonCallbackSink(std::function<bool(const char*, size_t)> callback) : callback(std::move(callback)) {}
+    bool write(const JsonChunk* chunks, int count) override;
+
+private:
+    std::function<bool(const char*, size_t)> callback;
+};
+
+//Fixed-size staging buffer in front of a sink. Small writes are copied in;
+//long runs whose memory outlives the next flush are queued by reference,
+//so a flush hands the sink a list of chunks it can pass to writev as is.
+//After a sink error further output is dropped and flush returns false.
+class JsonSinkBuffer final {
+public:
+    JsonSinkBuffer(JsonSink& sink, size_t buffer_size);
+    JsonSinkBuffer(const JsonSinkBuffer& buffer) = delete;
+    JsonSinkBuffer& operator=(const JsonSinkBuffer& buffer) = delete;
+
+    void push_back(char ch) {
+        if (this->used == this->buffer.size()) {
+            this->flush();
+        }
+        this->buffer[this->used++] = ch;
+    }
+    void append(const char* data, size_t size);
+    void append_stable(const char* data, size_t size);
+    bool flush();
+    bool is_ok() const;
+
+private:
+    void seal();
+
+    JsonSink& sink;
+    std::vector<char> buffer;
+    size_t used = 0;
+    size_t sealed = 0;
+    std::vector<JsonChunk> chunks;
+    bool ok = true;
+};
+
+//Node strings live until the stringify call returns, so their long runs
+//can skip the copy into the buffer.
+inline void JsonStringify_run(JsonSinkBuffer& out, const char* data, size_t size) {
+    out.append_stable(data, size);
+}
@@ -0,0 +1,347 @@
+#pragma once
+#include "tiny_json.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+//Serializer shared by json_stringify and the streaming writers. Out is any
+//type with push_back(char) and append(const char*, size_t); std::string
+//qualifies as is. Runs of bytes that need no escaping go through
+//JsonStringify_run, which an output type can overload to avoid the copy.
+template <typename Out>
+inline void JsonStringify_run(Out& out, const char* data, size_t size) {
+    if (size > 0) {
+        out.append(data, size);
+    }
+}
+
+//Writes \uXXXX for one UTF-16 code unit.
+template <typename Out>
+void JsonStringify_unit(unsigned unit, Out& out) {
+    static const char hex_digits[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+    out.append("\\u", 2);
+    out.push_back(hex_digits[(unit >> 12) & 15]);
+    out.push_back(hex_digits[(unit >> 8) & 15]);
+    out.push_back(hex_digits[(unit >> 4) & 15]);
+    out.push_back(hex_digits[unit & 15]);
+}
+
+//Escape for a quote, backslash or control character.
+template <typename Out>
+void JsonStringify_escape(unsigned char ch, Out& out) {
+    switch (ch) {
+        case '\"':
+            out.append("\\\"", 2);
+            break;
+        case '\\':
+            out.append("\\\\", 2);
+            break;
+        case '\b':
+            out.append("\\b", 2);
+            break;
+        case '\f':
+            out.append("\\f", 2);
+            break;
+        case '\n':
+            out.append("\\n", 2);
+            break;
+        case '\r':
+            out.append("\\r", 2);
+            break;
+        case '\t':
+            out.append("\\t", 2);
+            break;
+        default:
+            JsonStringify_unit(ch, out);
+    }
+}
+
+template <typename Out>
+void JsonStringify_string(const char* str, size_t length, Out& out) {
+    out.push_back('"');
+    size_t run = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char ch = str[i];
+        if (ch >= 0x20 && ch != '"' && ch != '\\') {
+            continue;
+        }
+        JsonStringify_run(out, str + run, i - run);
+        run = i + 1;
+        JsonStringify_escape(ch, out);
+    }
+    JsonStringify_run(out, str + run, length - run);
+    out.push_back('"');
+}
+
+//Decodes the UTF-8 sequence at str into code_point and returns its length,
+//or 0 if the bytes are not valid UTF-8.
+inline size_t JsonStringify_utf8(const char* str, size_t length, unsigned& code_point) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(str);
+    size_t size;
+    unsigned min;
+    if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+        size = 2;
+        min = 0x80;
+        code_point = p[0] & 0x1F;
+    } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+        size = 3;
+        min = 0x800;
+        code_point = p[0] & 0x0F;
+    } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+        size = 4;
+        min = 0x10000;
+        code_point = p[0] & 0x07;
+    } else {
+        return 0;
+    }
+    if (size > length) {
+        return 0;
+    }
+    for (size_t i = 1; i < size; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        code_point = code_point << 6 | (p[i] & 0x3F);
+    }
+    if (code_point < min || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+        return 0;
+    }
+    return size;
+}
+
+//String with the optional escapes. Bytes that are not valid UTF-8 are
+//copied as they are, even when ascii_only is set.
+template <typename Out>
+void JsonStringify_string(const char* str, size_t length, const JsonStringifyOptions& options, Out& out) {
+    if (!options.ascii_only && !options.escape_slash) {
+        JsonStringify_string(str, length, out);
+        return;
+    }
+    out.push_back('"');
+    size_t run = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char ch = str[i];
+        if (ch >= 0x80) {
+            unsigned code_point;
+            size_t size;
+            if (!options.ascii_only || (size = JsonStringify_utf8(str + i, length - i, code_point)) == 0) {
+                continue;
+            }
+            JsonStringify_run(out, str + run, i - run);
+            if (code_point >= 0x10000) {
+                code_point -= 0x10000;
+                JsonStringify_unit(0xD800 + (code_point >> 10), out);
+                JsonStringify_unit(0xDC00 + (code_point & 0x3FF), out);
+            } else {
+                JsonStringify_unit(code_point, out);
+            }
+            i += size - 1;
+            run = i + 1;
+            continue;
+        }
+        if (ch >= 0x20 && ch != '"' && ch != '\\' && (ch != '/' || !options.escape_slash)) {
+            continue;
+        }
+        JsonStringify_run(out, str + run, i - run);
+        run = i + 1;
+        if (ch == '/') {
+            out.append("\\/", 2);
+        } else {
+            JsonStringify_escape(ch, out);
+        }
+    }
+    JsonStringify_run(out, str + run, length - run);
+    out.push_back('"');
+}
+
+template <typename Out>
+void JsonStringify_integer(bool negative, unsigned long long magnitude, Out& out) {
+    char tmp[24];
+    char* p = tmp + sizeof(tmp);
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (negative) {
+        *--p = '-';
+    }
+    out.append(p, tmp + sizeof(tmp) - p);
+}
+
+template <typename Out>
+void JsonStringify_number(double num, Out& out) {
+    //JSON has no NaN or infinity; they are written as null.
+    if (!std::isfinite(num)) {
+        out.append("null", 4);
+        return;
+    }
+    //Integers below 1e17 print the same as %.17g without the libc call.
+    if (num > -1e17 && num < 1e17 && num == (double) (long long) num && (num != 0 || !std::signbit(num))) {
+        long long integer = (long long) num;
+        JsonStringify_integer(integer < 0, integer < 0 ? 0ULL - integer : integer, out);
+        return;
+    }
+    char tmp[32];
+    int length = snprintf(tmp, sizeof(tmp), "%.17g", num);
+    out.append(tmp, length);
+}
+
+//The elements of a packed array, straight from the doubles.
+template <typename Out>
+void JsonStringify_numbers(const double* numbers, size_t size, Out& out) {
+    for (size_t i = 0; i < size; i++) {
+        if (i > 0) {
+            out.push_back(',');
+        }
+        JsonStringify_number(numbers[i], out);
+    }
+}
+
+template <typename Out>
+void JsonStringify_value(const JsonNode* node, Out& out) {
+    switch (node->type) {
+        case JSON_TYPE_NULL:
+            out.append("null", 4);
+            break;
+        case JSON_TYPE_TRUE:
+            out.append("true", 4);
+            break;
+        case JSON_TYPE_FALSE:
+            out.append("false", 5);
+            break;
+        case JSON_TYPE_NUMBER:
+            if (!node->string.empty()) {
+                JsonStringify_run(out, node->string.data(), node->string.size());//raw, as parsed
+            } else {
+                JsonStringify_number(node->number, out);
+            }
+            break;
+        case JSON_TYPE_STRING:
+            JsonStringify_string(node->string.data(), node->string.size(), out);
+            break;
+        case JSON_TYPE_ARRAY:
+            out.push_back('[');
+            if (node->packed != nullptr) {
+                JsonStringify_numbers(node->packed->numbers.data(), node->packed->numbers.size(), out);
+            }
+            for (size_t i = 0; i < node->array.size(); i++) {
+                if (i > 0) {
+                    out.push_back(',');
+                }
+                JsonStringify_value(node->array[i], out);
+            }
+            out.push_back(']');
+            break;
+        case JSON_TYPE_OBJECT:
+            out.push_back('{');
+            for (size_t i = 0; i < node->object.size(); i++) {
+                if (i > 0) {
+                    out.push_back(',');
+                }
+                JsonStringify_string(node->object[i].first.data(), node->object[i].first.size(), out);
+                out.push_back(':');
+                JsonStringify_value(node->object[i].second, out);
+            }
+            out.push_back('}');
+            break;
+    }
+}
+
+//Line break plus indentation for the given depth, in bulk appends.
+template <typename Out>
+void JsonStringify_newline(int depth, const JsonStringifyOptions& options, Out& out) {
+    static const char spaces[] = "                                ";
+    out.push_back('\n');
+    size_t count = (size_t) depth * options.indent;
+    while (count > 0) {
+        size_t n = std::min(count, sizeof(spaces) - 1);
+        out.append(spaces, n);
+        count -= n;
+    }
+}
+
+//Options-driven serializer. keys is scratch space for sorting that every
+//level shares, each one sorting its members at the end and truncating
+//back afterwards, so sorting costs no allocation once keys has grown.
+template <typename Out>
+void JsonStringify_value(const JsonNode* node, const JsonStringifyOptions& options,
+                         std::vector<const std::pair<std::string, JsonNode*>*>& keys, int depth, Out& out) {
+    bool pretty = options.indent > 0;
+    switch (node->type) {
+        case JSON_TYPE_STRING:
+            JsonStringify_string(node->string.data(), node->string.size(), options, out);
+            break;
+        case JSON_TYPE_ARRAY:
+            if (node->get_array_size() == 0) {
+                out.append("[]", 2);
+                break;
+            }
+            out.push_back('[');
+            if (node->packed != nullptr && !pretty) {
+                JsonStringify_numbers(node->packed->numbers.data(), node->packed->numbers.size(), out);
+            } else if (node->packed != nullptr) {
+                for (size_t i = 0; i < node->packed->numbers.size(); i++) {
+                    if (i > 0) {
+                        out.push_back(',');
+                    }
+                    JsonStringify_newline(depth + 1, options, out);
+                    JsonStringify_number(node->packed->numbers[i], out);
+                }
+            }
+            for (size_t i = 0; i < node->array.size(); i++) {
+                if (i > 0) {
+                    out.push_back(',');
+                }
+                if (pretty) {
+                    JsonStringify_newline(depth + 1, options, out);
+                }
+                JsonStringify_value(node->array[i], options, keys, depth + 1, out);
+            }
+            if (pretty) {
+                JsonStringify_newline(depth, options, out);
+            }
+            out.push_back(']');
+            break;
+        case JSON_TYPE_OBJECT: {
+            if (node->object.empty()) {
+                out.append("{}", 2);
+                break;
+            }
+            size_t base = keys.size();
+            if (options.sort_keys) {
+                for (const auto& member : node->object) {
+                    keys.push_back(&member);
+                }
+                std::stable_sort(keys.begin() + base, keys.end(),
+                                 [](const std::pair<std::string, JsonNode*>* a, const std::pair<std::string, JsonNode*>* b) {
+                                     return a->first < b->first;
+                                 });
+            }
+            out.push_back('{');
+            for (size_t i = 0; i < node->object.size(); i++) {
+                const std::pair<std::string, JsonNode*>& member = options.sort_keys ? *keys[base + i] : node->object[i];
+                if (i > 0) {
+                    out.push_back(',');
+                }
+                if (pretty) {
+                    JsonStringify_newline(depth + 1, options, out);
+                }
+                JsonStringify_string(member.first.data(), member.first.size(), options, out);
+                if (pretty) {
+                    out.append(": ", 2);
+                } else {
+                    out.push_back(':');
+                }
+                JsonStringify_value(member.second, options, keys, depth + 1, out);
+            }
+            keys.resize(base);
+            if (pretty) {
+                JsonStringify_newline(depth, options, out);
+            }
+            out.push_back('}');
+            break;
+        }
+        default:
+            JsonStringify_value(node, out);
+    }
+}
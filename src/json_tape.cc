@@ -0,0 +1,407 @@
+#include "json_tape.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t JSON_TAPE_MAGIC = 0x3130455041544A54ULL;//"TJTAPE01"
+static const uint64_t JSON_TAPE_BYTE_ORDER = 0x0102030405060708ULL;
+static const uint64_t JSON_TAPE_PAYLOAD = (1ULL << 56) - 1;
+static const uint64_t JSON_TAPE_COUNT_MAX = 0xFFFFFF;//container counts saturate here
+
+static uint64_t JsonTape_word(char tag, uint64_t payload) {
+    return ((uint64_t) (unsigned char) tag << 56) | (payload & JSON_TAPE_PAYLOAD);
+}
+
+static char JsonTape_tag(uint64_t word) {
+    return (char) (word >> 56);
+}
+
+JsonTape::~JsonTape() {
+    clear();
+}
+
+void JsonTape::clear() {
+    if (this->map != nullptr) {
+        munmap(this->map, this->map_size);
+        this->map = nullptr;
+        this->map_size = 0;
+    }
+    this->words.clear();
+    this->strings.clear();
+    this->tape = nullptr;
+    this->tape_size = 0;
+    this->string_buffer = nullptr;
+    this->string_size = 0;
+}
+
+//Strings are stored as a 32-bit length followed by the bytes.
+size_t JsonTape::append_string(const std::string& str) {
+    size_t offset = this->strings.size();
+    uint32_t length = str.size();
+    assert(length == str.size());
+    this->strings.append((const char*) &length, sizeof(length));
+    this->strings += str;
+    return offset;
+}
+
+void JsonTape::build_number(double num) {
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+    this->words.push_back(JsonTape_word('d', 0));
+    this->words.push_back(bits);
+}
+
+void JsonTape::build_value(const JsonNode* node) {
+    size_t open;
+    switch (node->get_type()) {
+        case JSON_TYPE_NULL:
+            this->words.push_back(JsonTape_word('n', 0));
+            break;
+        case JSON_TYPE_TRUE:
+            this->words.push_back(JsonTape_word('t', 0));
+            break;
+        case JSON_TYPE_FALSE:
+            this->words.push_back(JsonTape_word('f', 0));
+            break;
+        case JSON_TYPE_NUMBER:
+            this->build_number(node->get_number());
+            break;
+        case JSON_TYPE_STRING:
+            this->words.push_back(JsonTape_word('"', append_string(node->get_string())));
+            break;
+        case JSON_TYPE_ARRAY:
+            open = this->words.size();
+            this->words.push_back(0);
+            if (node->is_packed_array()) {
+                for (int i = 0; i < node->get_array_size(); i++) {
+                    this->build_number(node->get_packed_array()[i]);
+                }
+            } else {
+                for (const JsonNode& element : node->elements()) {
+                    build_value(&element);
+                }
+            }
+            this->words.push_back(JsonTape_word(']', open));
+            this->words[open] = JsonTape_word(
+                    '[', std::min<uint64_t>(node->get_array_size(), JSON_TAPE_COUNT_MAX) << 32 | this->words.size());
+            break;
+        case JSON_TYPE_OBJECT:
+            open = this->words.size();
+            this->words.push_back(0);
+            for (auto member : node->members()) {
+                this->words.push_back(JsonTape_word('"', append_string(member.key)));
+                build_value(&member.value);
+            }
+            this->words.push_back(JsonTape_word('}', open));
+            this->words[open] = JsonTape_word(
+                    '{', std::min<uint64_t>(node->get_object_size(), JSON_TAPE_COUNT_MAX) << 32 | this->words.size());
+            break;
+    }
+}
+
+void JsonTape::build(const JsonNode* node) {
+    clear();
+    build_value(node);
+    this->tape = this->words.data();
+    this->tape_size = this->words.size();
+    this->string_buffer = this->strings.data();
+    this->string_size = this->strings.size();
+}
+
+int JsonTape::parse(const char* json) {
+    JsonNode node;
+    node.json_init();
+    int ret = node.json_parse(json);
+    if (ret == JSON_PARSE_OK) {
+        build(&node);
+    } else {
+        clear();
+    }
+    node.json_free();
+    return ret;
+}
+
+//File layout: magic, byte order mark, tape words, string bytes, then the
+//two arrays. The tape starts 32 bytes in, so a mapping keeps it aligned.
+int JsonTape::save(const char* path) const {
+    FILE* fp = fopen(path, "wb");
+    if (fp == nullptr) {
+        return JSON_TAPE_IO_ERROR;
+    }
+    uint64_t header[4] = {JSON_TAPE_MAGIC, JSON_TAPE_BYTE_ORDER, this->tape_size, this->string_size};
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+              fwrite(this->tape, sizeof(uint64_t), this->tape_size, fp) == this->tape_size &&
+              fwrite(this->string_buffer, 1, this->string_size, fp) == this->string_size;
+    ok = fclose(fp) == 0 && ok;
+    return ok ? JSON_TAPE_OK : JSON_TAPE_IO_ERROR;
+}
+
+int JsonTape::load(const char* path) {
+    struct stat st {};
+    clear();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return JSON_TAPE_IO_ERROR;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return JSON_TAPE_IO_ERROR;
+    }
+    size_t size = st.st_size;
+    if (size < 4 * sizeof(uint64_t)) {
+        close(fd);
+        return JSON_TAPE_INVALID_FORMAT;
+    }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return JSON_TAPE_IO_ERROR;
+    }
+    const uint64_t* header = (const uint64_t*) map;
+    if (header[0] != JSON_TAPE_MAGIC || header[1] != JSON_TAPE_BYTE_ORDER || header[2] == 0 ||
+        header[2] > (size - 4 * sizeof(uint64_t)) / sizeof(uint64_t) ||
+        header[3] != size - 4 * sizeof(uint64_t) - header[2] * sizeof(uint64_t)) {
+        munmap(map, size);
+        return JSON_TAPE_INVALID_FORMAT;
+    }
+    this->map = map;
+    this->map_size = size;
+    this->tape = header + 4;
+    this->tape_size = header[2];
+    this->string_buffer = (const char*) (this->tape + this->tape_size);
+    this->string_size = header[3];
+    if (!this->check()) {
+        clear();
+        return JSON_TAPE_INVALID_FORMAT;
+    }
+    return JSON_TAPE_OK;
+}
+
+//One pass over a loaded tape, so that views never read outside it or the
+//string buffer however the file was damaged: one root value filling the
+//tape, strings inside the buffer, containers closed where their first
+//word says with the count it records, and objects made of key and value
+//pairs.
+bool JsonTape::check() const {
+    struct Open {
+        size_t index;
+        size_t end;//one past the closing word
+        uint64_t count;//values inside so far, keys included
+    };
+    std::vector<Open> open;
+    size_t i = 0;
+    while (i < this->tape_size) {
+        uint64_t word = this->tape[i];
+        char tag = JsonTape_tag(word);
+        if (!open.empty() && i + 1 == open.back().end) {
+            Open o = open.back();
+            bool object = JsonTape_tag(this->tape[o.index]) == '{';
+            uint64_t count = object ? o.count / 2 : o.count;
+            if (tag != (object ? '}' : ']') || (word & JSON_TAPE_PAYLOAD) != o.index || (object && o.count % 2 != 0) ||
+                (this->tape[o.index] & JSON_TAPE_PAYLOAD) >> 32 != std::min(count, JSON_TAPE_COUNT_MAX)) {
+                return false;
+            }
+            open.pop_back();
+            if (!open.empty()) {
+                open.back().count++;
+            }
+            i++;
+            continue;
+        }
+        if (i > 0 && open.empty()) {
+            return false;
+        }
+        size_t limit = open.empty() ? this->tape_size : open.back().end - 1;
+        if (!open.empty() && JsonTape_tag(this->tape[open.back().index]) == '{' && open.back().count % 2 == 0 &&
+            tag != '"') {
+            return false;
+        }
+        switch (tag) {
+            case 'n':
+            case 't':
+            case 'f':
+                i++;
+                break;
+            case 'd':
+                if (limit - i < 2) {
+                    return false;
+                }
+                i += 2;
+                break;
+            case '"': {
+                uint64_t offset = word & JSON_TAPE_PAYLOAD;
+                uint32_t length;
+                if (this->string_size < sizeof(length) || offset > this->string_size - sizeof(length)) {
+                    return false;
+                }
+                memcpy(&length, this->string_buffer + offset, sizeof(length));
+                if (length > this->string_size - sizeof(length) - offset) {
+                    return false;
+                }
+                i++;
+                break;
+            }
+            case '[':
+            case '{': {
+                size_t end = word & 0xFFFFFFFF;
+                if (end < i + 2 || end > limit) {
+                    return false;
+                }
+                open.push_back({i, end, 0});
+                i++;
+                continue;
+            }
+            default:
+                return false;
+        }
+        if (!open.empty()) {
+            open.back().count++;
+        }
+    }
+    return open.empty();
+}
+
+JsonTapeView JsonTape::root() const {
+    return this->tape_size == 0 ? JsonTapeView() : JsonTapeView(this, 0);
+}
+
+size_t JsonTape::get_tape_size() const {
+    return this->tape_size;
+}
+
+size_t JsonTape::get_string_size() const {
+    return this->string_size;
+}
+
+bool JsonTapeView::is_valid() const {
+    return this->tape != nullptr;
+}
+
+JsonType JsonTapeView::get_type() const {
+    assert(is_valid());
+    switch (JsonTape_tag(this->tape->tape[this->index])) {
+        case 't':
+            return JSON_TYPE_TRUE;
+        case 'f':
+            return JSON_TYPE_FALSE;
+        case 'd':
+            return JSON_TYPE_NUMBER;
+        case '"':
+            return JSON_TYPE_STRING;
+        case '[':
+            return JSON_TYPE_ARRAY;
+        case '{':
+            return JSON_TYPE_OBJECT;
+        default:
+            return JSON_TYPE_NULL;
+    }
+}
+
+bool JsonTapeView::get_bool() const {
+    assert(get_type() == JSON_TYPE_TRUE || get_type() == JSON_TYPE_FALSE);
+    return get_type() == JSON_TYPE_TRUE;
+}
+
+double JsonTapeView::get_number() const {
+    assert(get_type() == JSON_TYPE_NUMBER);
+    double num;
+    memcpy(&num, &this->tape->tape[this->index + 1], sizeof(num));
+    return num;
+}
+
+const char* JsonTapeView::get_string_data() const {
+    assert(get_type() == JSON_TYPE_STRING);
+    return this->tape->string_buffer + (this->tape->tape[this->index] & JSON_TAPE_PAYLOAD) + sizeof(uint32_t);
+}
+
+int JsonTapeView::get_string_length() const {
+    assert(get_type() == JSON_TYPE_STRING);
+    uint32_t length;
+    memcpy(&length, this->tape->string_buffer + (this->tape->tape[this->index] & JSON_TAPE_PAYLOAD), sizeof(length));
+    return length;
+}
+
+std::string JsonTapeView::get_string() const {
+    return std::string(get_string_data(), get_string_length());
+}
+
+JsonTapeView JsonTapeView::next() const {
+    uint64_t word = this->tape->tape[this->index];
+    switch (JsonTape_tag(word)) {
+        case 'd':
+            return JsonTapeView(this->tape, this->index + 2);
+        case '[':
+        case '{':
+            return JsonTapeView(this->tape, word & 0xFFFFFFFF);
+        default:
+            return JsonTapeView(this->tape, this->index + 1);
+    }
+}
+
+//Counts above JSON_TAPE_COUNT_MAX are recovered by walking the container.
+int JsonTapeView::get_size() const {
+    uint64_t word = this->tape->tape[this->index];
+    uint64_t count = (word & JSON_TAPE_PAYLOAD) >> 32;
+    if (count < JSON_TAPE_COUNT_MAX) {
+        return count;
+    }
+    size_t end = (word & 0xFFFFFFFF) - 1;
+    count = 0;
+    for (JsonTapeView v(this->tape, this->index + 1); v.index < end; v = v.next()) {
+        count++;
+    }
+    return JsonTape_tag(word) == '{' ? count / 2 : count;
+}
+
+int JsonTapeView::get_array_size() const {
+    assert(get_type() == JSON_TYPE_ARRAY);
+    return get_size();
+}
+
+JsonTapeView JsonTapeView::get_array_index(int index) const {
+    assert(get_type() == JSON_TYPE_ARRAY);
+    size_t end = (this->tape->tape[this->index] & 0xFFFFFFFF) - 1;
+    JsonTapeView v(this->tape, this->index + 1);
+    for (int i = 0; i < index && v.index < end; i++) {
+        v = v.next();
+    }
+    return index < 0 || v.index >= end ? JsonTapeView() : v;
+}
+
+int JsonTapeView::get_object_size() const {
+    assert(get_type() == JSON_TYPE_OBJECT);
+    return get_size();
+}
+
+std::string JsonTapeView::get_object_key(int index) const {
+    assert(get_type() == JSON_TYPE_OBJECT && index >= 0 && index < get_object_size());
+    JsonTapeView v(this->tape, this->index + 1);
+    for (int i = 0; i < index; i++) {
+        v = v.next().next();
+    }
+    return v.get_string();
+}
+
+JsonTapeView JsonTapeView::get_object_value(int index) const {
+    assert(get_type() == JSON_TYPE_OBJECT && index >= 0 && index < get_object_size());
+    JsonTapeView v(this->tape, this->index + 1);
+    for (int i = 0; i < index; i++) {
+        v = v.next().next();
+    }
+    return v.next();
+}
+
+JsonTapeView JsonTapeView::find_object_value(const std::string& str) const {
+    assert(get_type() == JSON_TYPE_OBJECT);
+    size_t end = (this->tape->tape[this->index] & 0xFFFFFFFF) - 1;
+    for (JsonTapeView v(this->tape, this->index + 1); v.index < end; v = v.next().next()) {
+        if ((size_t) v.get_string_length() == str.size() && memcmp(v.get_string_data(), str.data(), str.size()) == 0) {
+            return v.next();
+        }
+    }
+    return JsonTapeView();
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "tiny_json.h"
+#include <cstdint>
+
+//Json tape return
+enum {
+    JSON_TAPE_OK = 0,
+    JSON_TAPE_IO_ERROR,
+    JSON_TAPE_INVALID_FORMAT
+};
+
+class JsonTape;
+
+//Read-only cursor into a tape with the JsonNode accessors. A view is two
+//words and is passed by value; an invalid view stands for a missing value.
+class JsonTapeView final {
+public:
+    JsonTapeView() = default;
+    bool is_valid() const;
+    JsonType get_type() const;
+    bool get_bool() const;
+    double get_number() const;
+    std::string get_string() const;
+    const char* get_string_data() const;
+    int get_string_length() const;
+    int get_array_size() const;
+    JsonTapeView get_array_index(int index) const;
+    int get_object_size() const;
+    std::string get_object_key(int index) const;
+    JsonTapeView get_object_value(int index) const;
+    JsonTapeView find_object_value(const std::string& str) const;
+    JsonTapeView next() const;
+
+private:
+    friend class JsonTape;
+    JsonTapeView(const JsonTape* tape, size_t index) : tape(tape), index(index) {}
+    int get_size() const;
+    const JsonTape* tape = nullptr;
+    size_t index = 0;
+};
+
+//Flat encoding of a document: one tagged 64-bit word per value (numbers
+//take a second word), strings in a separate buffer. Containers store the
+//index just past their end, so siblings are one step apart. A tape can be
+//written to disk and mapped back with no parse step, only one pass that
+//checks its words stay in bounds; the file uses the byte order of the
+//machine that wrote it.
+class JsonTape final {
+public:
+    JsonTape() = default;
+    JsonTape(const JsonTape& tape) = delete;
+    JsonTape& operator=(const JsonTape& tape) = delete;
+    ~JsonTape();
+    void build(const JsonNode* node);
+    int parse(const char* json);
+    int save(const char* path) const;
+    int load(const char* path);
+    JsonTapeView root() const;
+    size_t get_tape_size() const;
+    size_t get_string_size() const;
+
+private:
+    friend class JsonTapeView;
+    void clear();
+    bool check() const;
+    void build_value(const JsonNode* node);
+    void build_number(double num);
+    size_t append_string(const std::string& str);
+    std::vector<uint64_t> words;
+    std::string strings;
+    const uint64_t* tape = nullptr;
+    size_t tape_size = 0;
+    const char* string_buffer = nullptr;
+    size_t string_size = 0;
+    void* map = nullptr;
+    size_t map_size = 0;
+};
@@ -0,0 +1,189 @@
+#include "json_writer.h"
+#include "json_stringify.h"
+#include <cassert>
+#include <cstring>
+
+JsonWriter::JsonWriter(JsonSink& sink, size_t buffer_size) : sink(&sink), buffer_size(buffer_size) {
+    this->buffer.reserve(buffer_size);
+}
+
+//Separator and state change owed before any value.
+void JsonWriter::prefix() {
+    if (this->stack.empty()) {
+        assert(!this->complete);
+        return;
+    }
+    Level& level = this->stack.back();
+    if (level.object) {
+        assert(this->after_key);
+        this->after_key = false;
+        return;
+    }
+    if (!level.empty) {
+        this->buffer.push_back(',');
+    }
+    level.empty = false;
+}
+
+void JsonWriter::finish() {
+    if (this->stack.empty()) {
+        this->complete = true;
+    }
+    if (this->sink != nullptr && this->buffer.size() >= this->buffer_size) {
+        this->flush();
+    }
+}
+
+void JsonWriter::begin_object() {
+    this->prefix();
+    this->buffer.push_back('{');
+    this->stack.push_back({true, true});
+}
+
+void JsonWriter::end_object() {
+    assert(!this->stack.empty() && this->stack.back().object && !this->after_key);
+    this->buffer.push_back('}');
+    this->stack.pop_back();
+    this->finish();
+}
+
+void JsonWriter::begin_array() {
+    this->prefix();
+    this->buffer.push_back('[');
+    this->stack.push_back({false, true});
+}
+
+void JsonWriter::end_array() {
+    assert(!this->stack.empty() && !this->stack.back().object);
+    this->buffer.push_back(']');
+    this->stack.pop_back();
+    this->finish();
+}
+
+void JsonWriter::key(const char* str) {
+    this->key(str, strlen(str));
+}
+
+void JsonWriter::key(const char* str, size_t length) {
+    assert(!this->stack.empty() && this->stack.back().object && !this->after_key);
+    Level& level = this->stack.back();
+    if (!level.empty) {
+        this->buffer.push_back(',');
+    }
+    level.empty = false;
+    JsonStringify_string(str, length, this->buffer);
+    this->buffer.push_back(':');
+    this->after_key = true;
+}
+
+void JsonWriter::key(const std::string& str) {
+    this->key(str.data(), str.size());
+}
+
+void JsonWriter::value(std::nullptr_t) {
+    this->prefix();
+    this->buffer.append("null", 4);
+    this->finish();
+}
+
+void JsonWriter::value(bool b) {
+    this->prefix();
+    if (b) {
+        this->buffer.append("true", 4);
+    } else {
+        this->buffer.append("false", 5);
+    }
+    this->finish();
+}
+
+void JsonWriter::value(double num) {
+    this->prefix();
+    JsonStringify_number(num, this->buffer);
+    this->finish();
+}
+
+void JsonWriter::value_integer(bool negative, unsigned long long magnitude) {
+    this->prefix();
+    JsonStringify_integer(negative, magnitude, this->buffer);
+    this->finish();
+}
+
+void JsonWriter::value(const char* str) {
+    this->value(str, strlen(str));
+}
+
+void JsonWriter::value(const char* str, size_t length) {
+    this->prefix();
+    JsonStringify_string(str, length, this->buffer);
+    this->finish();
+}
+
+void JsonWriter::value(const std::string& str) {
+    this->value(str.data(), str.size());
+}
+
+//Embeds an existing tree as the next value.
+void JsonWriter::value(const JsonNode* node) {
+    assert(node != nullptr);
+    this->prefix();
+    JsonStringify_value(node, this->buffer);
+    this->finish();
+}
+
+JsonObjectScope JsonWriter::object() {
+    return JsonObjectScope(this);
+}
+
+JsonArrayScope JsonWriter::array() {
+    return JsonArrayScope(this);
+}
+
+//True once a whole top-level value has been written.
+bool JsonWriter::is_complete() const {
+    return this->complete;
+}
+
+//Text written since the last clear() or flush().
+const std::string& JsonWriter::get_string() const {
+    return this->buffer;
+}
+
+//Starts a new document, keeping the buffer's capacity.
+void JsonWriter::clear() {
+    this->buffer.clear();
+    this->stack.clear();
+    this->after_key = false;
+    this->complete = false;
+    this->ok = true;
+}
+
+//Hands the buffered text to the sink; false once the sink has failed.
+bool JsonWriter::flush() {
+    if (this->sink == nullptr) {
+        return true;
+    }
+    if (this->ok && !this->buffer.empty()) {
+        JsonChunk chunk = {this->buffer.data(), this->buffer.size()};
+        this->ok = this->sink->write(&chunk, 1);
+    }
+    this->buffer.clear();
+    return this->ok;
+}
+
+JsonObjectScope JsonObjectScope::object(const char* key) {
+    this->writer->key(key);
+    return JsonObjectScope(this->writer);
+}
+
+JsonArrayScope JsonObjectScope::array(const char* key) {
+    this->writer->key(key);
+    return JsonArrayScope(this->writer);
+}
+
+JsonObjectScope JsonArrayScope::object() {
+    return JsonObjectScope(this->writer);
+}
+
+JsonArrayScope JsonArrayScope::array() {
+    return JsonArrayScope(this->writer);
+}
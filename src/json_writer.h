@@ -0,0 +1,127 @@
+#pragma once
+#include "json_sink.h"
+#include "tiny_json.h"
+#include <cstdint>
+#include <type_traits>
+
+class JsonObjectScope;
+class JsonArrayScope;
+
+//Emits JSON text directly, with no JsonNode in between. Output collects in
+//a buffer that keeps its capacity across clear(), so a writer reused per
+//response stops allocating once warm. With a sink the buffer is flushed
+//whenever it passes buffer_size. Calls out of order trip an assert; the
+//scopes returned by object() and array() make the nesting type-checked:
+//an object scope only takes key/value members and closes itself.
+class JsonWriter final {
+public:
+    JsonWriter() = default;
+    explicit JsonWriter(JsonSink& sink, size_t buffer_size = 16384);
+    JsonWriter(const JsonWriter& writer) = delete;
+    JsonWriter& operator=(const JsonWriter& writer) = delete;
+
+    void begin_object();
+    void end_object();
+    void begin_array();
+    void end_array();
+    void key(const char* str);
+    void key(const char* str, size_t length);
+    void key(const std::string& str);
+
+    void value(std::nullptr_t);
+    void value(bool b);
+    void value(double num);
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    void value(T num) {
+        this->value_integer(num < 0, num < 0 ? 0ULL - (unsigned long long) num : (unsigned long long) num);
+    }
+    void value(const char* str);
+    void value(const char* str, size_t length);
+    void value(const std::string& str);
+    void value(const JsonNode* node);
+
+    JsonObjectScope object();
+    JsonArrayScope array();
+
+    bool is_complete() const;
+    const std::string& get_string() const;
+    void clear();
+    bool flush();
+
+private:
+    void prefix();
+    void finish();
+    void value_integer(bool negative, unsigned long long magnitude);
+
+    struct Level {
+        bool object;
+        bool empty;
+    };
+
+    JsonSink* sink = nullptr;
+    size_t buffer_size = 0;
+    bool ok = true;
+    std::string buffer;
+    std::vector<Level> stack;
+    bool after_key = false;
+    bool complete = false;
+};
+
+//Open object inside a writer; closes it when the scope ends.
+class JsonObjectScope final {
+public:
+    JsonObjectScope(JsonObjectScope&& scope) : writer(scope.writer) { scope.writer = nullptr; }
+    JsonObjectScope(const JsonObjectScope& scope) = delete;
+    ~JsonObjectScope() {
+        if (this->writer != nullptr) {
+            this->writer->end_object();
+        }
+    }
+
+    template <typename T>
+    JsonObjectScope& member(const char* key, const T& value) {
+        this->writer->key(key);
+        this->writer->value(value);
+        return *this;
+    }
+    template <typename T>
+    JsonObjectScope& member(const std::string& key, const T& value) {
+        this->writer->key(key);
+        this->writer->value(value);
+        return *this;
+    }
+    JsonObjectScope object(const char* key);
+    JsonArrayScope array(const char* key);
+
+private:
+    friend class JsonWriter;
+    friend class JsonArrayScope;
+    explicit JsonObjectScope(JsonWriter* writer) : writer(writer) { writer->begin_object(); }
+    JsonWriter* writer;
+};
+
+//Open array inside a writer; closes it when the scope ends.
+class JsonArrayScope final {
+public:
+    JsonArrayScope(JsonArrayScope&& scope) : writer(scope.writer) { scope.writer = nullptr; }
+    JsonArrayScope(const JsonArrayScope& scope) = delete;
+    ~JsonArrayScope() {
+        if (this->writer != nullptr) {
+            this->writer->end_array();
+        }
+    }
+
+    template <typename T>
+    JsonArrayScope& element(const T& value) {
+        this->writer->value(value);
+        return *this;
+    }
+    JsonObjectScope object();
+    JsonArrayScope array();
+
+private:
+    friend class JsonWriter;
+    friend class JsonObjectScope;
+    explicit JsonArrayScope(JsonWriter* writer) : writer(writer) { writer->begin_array(); }
+    JsonWriter* writer;
+};
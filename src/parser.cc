@@ -1,8 +1,37 @@
 #include "parser.h"
+#include "json_document.h"
+#include "json_pointer.h"
+#include "json_schema.h"
+#include "json_select.h"
+#include "json_shape.h"
+#include <algorithm>
+#include <cassert>
 #include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <new>
 
 Parser::Parser(const JsonContext& c) {
     ctx.json = c.json;
+    start = c.json;
+}
+
+Parser::Parser(const JsonContext& c, const JsonParseOptions& options) {
+    ctx.json = c.json;
+    start = c.json;
+    this->options = options;
+}
+
+Parser::Parser(const JsonContext& c, const JsonParseOptions& options, JsonRecycle* recycle) {
+    ctx.json = c.json;
+    start = c.json;
+    this->options = options;
+    this->recycle = recycle;
+}
+
+//Bytes consumed so far; after a failed parse, where the error is.
+size_t Parser::get_offset() const {
+    return ctx.json - start;
 }
 
 void Parser::parse_whitespace() {
@@ -47,8 +76,8 @@ int Parser::parse_false(JsonNode* node) {
 
 #define ISDIGIT1TO9(ch) (((ch) >= '1') && ((ch) <= '9'))
 #define ISDIGIT(ch) (((ch) >= '0') && ((ch) <= '9'))
-int Parser::parse_number(JsonNode* node) {
-    const char* p = ctx.json;
+//Returns the end of the number starting at p, or nullptr if it is malformed.
+const char* Parser::scan_number(const char* p) {
     if (*p == '-') {
         p++;
     }
@@ -56,7 +85,7 @@ int Parser::parse_number(JsonNode* node) {
         p++;
     } else {
         if (!ISDIGIT1TO9(*p)) {
-            return JSON_PARSE_INVALID_VALUE;
+            return nullptr;
         }
         while (ISDIGIT(*p)) {
             p++;
@@ -66,7 +95,7 @@ int Parser::parse_number(JsonNode* node) {
     if (*p == '.') {
         p++;
         if (!ISDIGIT(*p)) {
-            return JSON_PARSE_INVALID_VALUE;
+            return nullptr;
         }
         while (ISDIGIT(*p)) {
             p++;
@@ -79,18 +108,61 @@ int Parser::parse_number(JsonNode* node) {
             p++;
         }
         if (!ISDIGIT(*p)) {
-            return JSON_PARSE_INVALID_VALUE;
+            return nullptr;
         }
         while (ISDIGIT(*p)) {
             p++;
         }
     }
+    return p;
+}
+
+int Parser::parse_number_raw(double& num) {
+    const char* p = scan_number(ctx.json);
+    if (p == nullptr) {
+        return JSON_PARSE_INVALID_VALUE;
+    }
     errno = 0;
     double num_str = strtod(ctx.json, nullptr);//str to double
     if (errno == ERANGE && (num_str == HUGE_VAL || num_str == -HUGE_VAL)) {
         return JSON_PARSE_NUMBER_TOO_BIG;
     }
-    node->set_number(num_str);
+    num = num_str;
+    ctx.json = p;
+    return JSON_PARSE_OK;
+}
+
+int Parser::parse_number(JsonNode* node) {
+    int ret;
+    double num;
+    if (options.raw_numbers) {
+        return parse_number_text(node);
+    }
+    if ((ret = parse_number_raw(num)) == JSON_PARSE_OK) {
+        node->set_number(num);
+    }
+    return ret;
+}
+
+//Keeps the token instead of converting it. Only a number with an exponent
+//or over 308 digits can be too big for a double, so only those are
+//converted here, to report JSON_PARSE_NUMBER_TOO_BIG as an eager parse would.
+int Parser::parse_number_text(JsonNode* node) {
+    const char* p = scan_number(ctx.json);
+    if (p == nullptr) {
+        return JSON_PARSE_INVALID_VALUE;
+    }
+    const char* start = ctx.json;
+    size_t length = p - start;
+    if (length > 308 || memchr(start, 'e', length) != nullptr || memchr(start, 'E', length) != nullptr) {
+        double num;
+        int ret = parse_number_raw(num);
+        if (ret != JSON_PARSE_OK) {
+            return ret;
+        }
+    }
+    node->set_number(0);
+    node->string.assign(start, length);
     ctx.json = p;
     return JSON_PARSE_OK;
 }
@@ -138,7 +210,14 @@ int Parser::parse_string_raw(std::string& str) {
     unsigned u, u2;
     ctx.json++;
     const char* p = ctx.json;
+    const char* escape = nullptr;
     while (true) {
+        //Only the closing quote may follow a string that reached the limit.
+        if (str.size() >= options.max_string_length && (str.size() > options.max_string_length || *p != '\"')) {
+            str.clear();
+            ctx.json = p;
+            return JSON_PARSE_STRING_TOO_LONG;
+        }
         char ch = *p++;
         switch (ch) {
             case '\"':
@@ -146,8 +225,10 @@ int Parser::parse_string_raw(std::string& str) {
                 return JSON_PARSE_OK;
             case '\0':
                 str.clear();
+                ctx.json = p - 1;
                 return JSON_PARSE_MISS_DOUBLEDUOTE;
             case '\\':
+                escape = p - 1;
                 switch (*p++) {
                     case '\"':
                         str.push_back('\"');
@@ -175,20 +256,25 @@ int Parser::parse_string_raw(std::string& str) {
                         break;
                     case 'u':
                         if (!(p = parse_hex4(p, &u))) {
+                            ctx.json = escape;
                             return JSON_PARSE_INVALID_UNICODE_HEX;
                         }
                         /* surrogate pair */
                         if (u >= 0xD800 && u <= 0xDBFF) {
                             if (*p++ != '\\') {
+                                ctx.json = escape;
                                 return JSON_PARSE_INVALID_UNICODE_SURROGATE;
                             }
                             if (*p++ != 'u') {
+                                ctx.json = escape;
                                 return JSON_PARSE_INVALID_UNICODE_SURROGATE;
                             }
                             if (!(p = parse_hex4(p, &u2))) {
+                                ctx.json = escape;
                                 return JSON_PARSE_INVALID_UNICODE_SURROGATE;
                             }
                             if (u2 < 0xDC00 || u2 > 0xDFFF) {
+                                ctx.json = escape;
                                 return JSON_PARSE_INVALID_UNICODE_SURROGATE;
                             }
                             u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
@@ -197,12 +283,14 @@ int Parser::parse_string_raw(std::string& str) {
                         break;
                     default:
                         str.clear();
+                        ctx.json = escape;
                         return JSON_PARSE_INVALID_STRING_ESCAPEVALUE;
                 }
                 break;
             default:
                 if ((unsigned char) ch < 0x20) {
                     str.clear();
+                    ctx.json = p - 1;
                     return JSON_PARSE_INVALID_STRING_CHAR;
                 }
                 str.push_back(ch);
@@ -210,30 +298,105 @@ int Parser::parse_string_raw(std::string& str) {
     }
 }
 
+//Decodes straight into the node's own buffer, which a recycled node brings
+//with its old capacity.
 int Parser::parse_string(JsonNode* node) {
     int ret;
-    std::string s;
-    if ((ret = parse_string_raw(s)) == JSON_PARSE_OK) {
-        node->set_string(s);
+    node->json_free();
+    node->string.clear();
+    if ((ret = parse_string_raw(node->string)) == JSON_PARSE_OK) {
+        node->type = JSON_TYPE_STRING;
+        if (options.shrink_to_fit) {
+            node->string.shrink_to_fit();
+        }
     }
     return ret;
 }
 
+//Reads numbers into packed storage for as long as the elements are numbers.
+//Returns JSON_PARSE_OK with ctx.json after the ']' when the whole array
+//was packed, or JSON_PARSE_UNEXPECTED_TYPE at the first other element,
+//after giving the numbers read so far their own nodes.
+int Parser::parse_packed_array(JsonNode* node, size_t size) {
+    int ret;
+    std::vector<double> numbers;
+    numbers.reserve(size);
+    while (true) {
+        double num;
+        if ((int) numbers.size() >= options.max_members) {//never past max_members, so it fits
+            return JSON_PARSE_TOO_MANY_MEMBERS;
+        }
+        if (nodes >= options.max_nodes) {
+            return JSON_PARSE_TOO_MANY_NODES;
+        }
+        if ((ret = parse_number_raw(num)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        nodes++;
+        numbers.push_back(num);
+        parse_whitespace();
+        if (*ctx.json == ']') {
+            ctx.json++;
+            if (options.shrink_to_fit) {
+                numbers.shrink_to_fit();
+            }
+            node->set_packed_array(std::move(numbers));
+            node->packed->allocator = options.allocator;
+            return JSON_PARSE_OK;
+        }
+        if (*ctx.json != ',') {
+            return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+        ctx.json++;
+        parse_whitespace();
+        if (*ctx.json != '-' && !ISDIGIT(*ctx.json)) {
+            break;
+        }
+    }
+    node->reserve_array(std::max(size, numbers.size() + 1));
+    for (double num : numbers) {
+        JsonNode* n = new (options.allocator) JsonNode();
+        if (n == nullptr) {
+            return JSON_PARSE_OUT_OF_MEMORY;
+        }
+        n->set_number(num);
+        node->pushback_array_element(n);
+    }
+    return JSON_PARSE_UNEXPECTED_TYPE;
+}
+
 int Parser::parse_array(JsonNode* node) {
     assert(*ctx.json == '[');
     node->set_array();
+    size_t size = next_size();
     ctx.json++;
     parse_whitespace();
     if (*ctx.json == ']') {
-        node->set_array({});
         ctx.json++;
         return JSON_PARSE_OK;
     }
     int ret;
+    if (options.pack_numbers && (*ctx.json == '-' || ISDIGIT(*ctx.json))) {
+        if ((ret = parse_packed_array(node, size)) != JSON_PARSE_UNEXPECTED_TYPE) {
+            if (ret != JSON_PARSE_OK) {
+                node->json_free();
+            }
+            return ret;
+        }
+    } else {
+        node->array.reserve(size);
+    }
     while (true) {
-        auto n = new JsonNode();
-        n->json_init();
+        JsonNode* n;
+        if (node->get_array_size() >= options.max_members) {
+            ret = JSON_PARSE_TOO_MANY_MEMBERS;
+            break;
+        }
+        if ((ret = new_node(n)) != JSON_PARSE_OK) {
+            break;
+        }
         if ((ret = parse_value(n)) != JSON_PARSE_OK) {
+            delete n;
             break;
         }
         node->pushback_array_element(n);
@@ -242,20 +405,16 @@ int Parser::parse_array(JsonNode* node) {
             ctx.json++;
             parse_whitespace();
         } else if (*ctx.json == ']') {
-            node->set_array();
             ctx.json++;
+            if (options.shrink_to_fit) {
+                node->array.shrink_to_fit();
+            }
             return JSON_PARSE_OK;
         } else {
-            for (int i = 0; i < node->get_array_size(); i++) {
-                node->get_array_index(i)->json_free();
-            }
-            node->json_free();
-            return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
         }
     }
-    for (int i = 0; i < node->get_array_size(); i++) {
-        node->get_array_index(i)->json_free();
-    }
     node->json_free();
     return ret;
 }
@@ -264,18 +423,20 @@ int Parser::parse_object(JsonNode* node) {
     int ret;
     assert(*ctx.json == '{');
     node->set_object();
+    node->object.reserve(next_size());
     ctx.json++;
-    std::string str;
-    JsonNode* n;
     parse_whitespace();
     if (*ctx.json == '}') {
         ctx.json++;
-        node->set_object();
         return JSON_PARSE_OK;
     }
     while (true) {
-        n = new JsonNode();
-        str.clear();
+        std::string str;
+        new_key(str);
+        if (node->get_object_size() >= options.max_members) {
+            ret = JSON_PARSE_TOO_MANY_MEMBERS;
+            break;
+        }
         if (*ctx.json != '"') {
             ret = JSON_PARSE_NOT_EXIST_KEY;
             break;
@@ -290,31 +451,132 @@ int Parser::parse_object(JsonNode* node) {
         }
         ctx.json++;
         parse_whitespace();
+        JsonNode* n;
+        if ((ret = new_node(n)) != JSON_PARSE_OK) {
+            break;
+        }
         if ((ret = parse_value(n)) != JSON_PARSE_OK) {
+            delete n;
             break;
         }
-        node->pushback_object_element(str, n);
+        if (options.shrink_to_fit) {
+            str.shrink_to_fit();
+        }
+        n->parent = node;
+        node->object.emplace_back(std::move(str), n);
         parse_whitespace();
         if (*ctx.json == ',') {
             ctx.json++;
             parse_whitespace();
         } else if (*ctx.json == '}') {
             ctx.json++;
-            node->set_object();
+            if (options.shrink_to_fit) {
+                node->object.shrink_to_fit();
+            }
             return JSON_PARSE_OK;
         } else {
             ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
             break;
         }
     }
-    for (int i = 0; i < node->get_object_size(); i++) {
-        node->get_object_value(i)->json_free();
-    }
     node->json_free();
-    n->json_free();
     return ret;
 }
 
+//A node from the parse's allocator, within the node limit.
+int Parser::new_node(JsonNode*& node) {
+    if (nodes >= options.max_nodes) {
+        return JSON_PARSE_TOO_MANY_NODES;
+    }
+    if (recycle != nullptr && !recycle->nodes.empty()) {
+        node = recycle->nodes.back();
+        recycle->nodes.pop_back();
+    } else if ((node = new (options.allocator) JsonNode()) == nullptr) {
+        return JSON_PARSE_OUT_OF_MEMORY;
+    }
+    nodes++;
+    return JSON_PARSE_OK;
+}
+
+//Counts the members of every array and object in one pass, recording them
+//in the order the parse will meet the containers. Only brackets, commas
+//and strings are looked at, so malformed input can give wrong counts. A
+//count is kept only once its container closes, and never exceeds what its
+//bytes could hold, so reserving it costs no more than parsing the members
+//would. The scan is advisory: if it runs out of memory the parse goes on
+//without sizes.
+void Parser::scan_sizes() {
+    try {
+        scan_sizes(ctx.json);
+    } catch (const std::bad_alloc&) {
+        std::vector<uint32_t>().swap(sizes);
+    }
+}
+
+void Parser::scan_sizes(const char* p) {
+    std::vector<std::pair<size_t, const char*>> open;
+    for (; *p != '\0'; p++) {
+        switch (*p) {
+            case '"':
+                for (p++; *p != '"' && *p != '\0'; p++) {
+                    if (*p == '\\' && p[1] != '\0') {
+                        p++;
+                    }
+                }
+                if (*p == '\0') {
+                    p--;
+                }
+                break;
+            case '[':
+            case '{': {
+                open.emplace_back(sizes.size(), p);
+                const char* q = p + 1;
+                while (*q == ' ' || *q == '\r' || *q == '\n' || *q == '\t') {
+                    q++;
+                }
+                sizes.push_back(*q != ']' && *q != '}');
+                break;
+            }
+            case ']':
+            case '}':
+                if (!open.empty()) {
+                    //n members take at least 2n - 1 bytes between the brackets.
+                    size_t span = p - open.back().second - 1;
+                    uint32_t& size = sizes[open.back().first];
+                    size = std::min<size_t>(size, (span + 1) / 2);
+                    open.pop_back();
+                }
+                break;
+            case ',':
+                if (!open.empty()) {
+                    sizes[open.back().first]++;
+                }
+                break;
+        }
+    }
+    for (const auto& unclosed : open) {
+        sizes[unclosed.first] = 0;
+    }
+}
+
+//Reserve size for the next array or object, within max_members; 0 without
+//a pre-scan.
+size_t Parser::next_size() {
+    if (container >= sizes.size()) {
+        return 0;
+    }
+    return std::min<size_t>(sizes[container++], options.max_members);
+}
+
+//An empty key, in a recycled buffer when there is one.
+void Parser::new_key(std::string& key) {
+    if (recycle != nullptr && !recycle->keys.empty()) {
+        key.swap(recycle->keys.back());
+        recycle->keys.pop_back();
+        key.clear();
+    }
+}
+
 int Parser::parse_value(JsonNode* node) {
     switch (*(ctx.json)) {
         case '\0':
@@ -328,15 +590,28 @@ int Parser::parse_value(JsonNode* node) {
         case '\"':
             return parse_string(node);
         case '[':
-            return parse_array(node);
-        case '{':
-            return parse_object(node);
+        case '{': {
+            if (depth >= options.max_depth) {
+                return JSON_PARSE_TOO_DEEP;
+            }
+            depth++;
+            int ret = *ctx.json == '[' ? parse_array(node) : parse_object(node);
+            depth--;
+            return ret;
+        }
         default:
             return parse_number(node);
     }
 }
 
 int Parser::parse(JsonNode& node) {
+    if (options.max_input_bytes != SIZE_MAX && strnlen(ctx.json, options.max_input_bytes + 1) > options.max_input_bytes) {
+        ctx.json += options.max_input_bytes;
+        return JSON_PARSE_INPUT_TOO_LARGE;
+    }
+    if (options.reserve_exact) {
+        scan_sizes();
+    }
     parse_whitespace();
     int ret;
     if ((ret = parse_value(&node)) == JSON_PARSE_OK) {
@@ -348,3 +623,580 @@ int Parser::parse(JsonNode& node) {
     }
     return ret;
 }
+
+//Skipping validates the same grammar as parsing but builds no nodes.
+int Parser::skip_string() {
+    assert(*ctx.json == '\"');
+    unsigned u;
+    const char* p = ctx.json + 1;
+    const char* escape = nullptr;
+    while (true) {
+        char ch = *p++;
+        switch (ch) {
+            case '\"':
+                ctx.json = p;
+                return JSON_PARSE_OK;
+            case '\0':
+                ctx.json = p - 1;
+                return JSON_PARSE_MISS_DOUBLEDUOTE;
+            case '\\':
+                escape = p - 1;
+                switch (*p++) {
+                    case '\"':
+                    case '\\':
+                    case '/':
+                    case 'b':
+                    case 'f':
+                    case 'n':
+                    case 'r':
+                    case 't':
+                        break;
+                    case 'u':
+                        if (!(p = parse_hex4(p, &u))) {
+                            ctx.json = escape;
+                            return JSON_PARSE_INVALID_UNICODE_HEX;
+                        }
+                        if (u >= 0xD800 && u <= 0xDBFF) {
+                            if (*p++ != '\\' || *p++ != 'u' || !(p = parse_hex4(p, &u)) || u < 0xDC00 || u > 0xDFFF) {
+                                ctx.json = escape;
+                                return JSON_PARSE_INVALID_UNICODE_SURROGATE;
+                            }
+                        }
+                        break;
+                    default:
+                        ctx.json = escape;
+                        return JSON_PARSE_INVALID_STRING_ESCAPEVALUE;
+                }
+                break;
+            default:
+                if ((unsigned char) ch < 0x20) {
+                    ctx.json = p - 1;
+                    return JSON_PARSE_INVALID_STRING_CHAR;
+                }
+        }
+    }
+}
+
+int Parser::skip_array() {
+    int ret;
+    assert(*ctx.json == '[');
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == ']') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        if ((ret = skip_value()) != JSON_PARSE_OK) {
+            return ret;
+        }
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == ']') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+    }
+}
+
+int Parser::skip_object() {
+    int ret;
+    assert(*ctx.json == '{');
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == '}') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        if (*ctx.json != '"') {
+            return JSON_PARSE_NOT_EXIST_KEY;
+        }
+        if ((ret = skip_string()) != JSON_PARSE_OK) {
+            return ret;
+        }
+        parse_whitespace();
+        if (*ctx.json != ':') {
+            return JSON_PARSE_MISS_COLON;
+        }
+        ctx.json++;
+        parse_whitespace();
+        if ((ret = skip_value()) != JSON_PARSE_OK) {
+            return ret;
+        }
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == '}') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        }
+    }
+}
+
+int Parser::skip_value() {
+    const char* p;
+    switch (*ctx.json) {
+        case '\0':
+            return JSON_PARSE_EXPECT_VALUE;
+        case 'n':
+            return strncmp(ctx.json, "null", 4) == 0 ? (ctx.json += 4, JSON_PARSE_OK) : JSON_PARSE_INVALID_VALUE;
+        case 't':
+            return strncmp(ctx.json, "true", 4) == 0 ? (ctx.json += 4, JSON_PARSE_OK) : JSON_PARSE_EXPECT_VALUE;
+        case 'f':
+            return strncmp(ctx.json, "false", 5) == 0 ? (ctx.json += 5, JSON_PARSE_OK) : JSON_PARSE_INVALID_VALUE;
+        case '\"':
+            return skip_string();
+        case '[':
+            return skip_array();
+        case '{':
+            return skip_object();
+        default:
+            if ((p = scan_number(ctx.json)) == nullptr) {
+                return JSON_PARSE_INVALID_VALUE;
+            }
+            ctx.json = p;
+            return JSON_PARSE_OK;
+    }
+}
+
+//Only values reached by a selector path become nodes; everything else is skipped.
+int Parser::select_value(const JsonSelector& selector, const std::vector<int>& steps, std::string& pointer,
+                         std::vector<JsonSelection>& out) {
+    int ret;
+    if (steps.empty()) {
+        return skip_value();
+    }
+    for (int s : steps) {
+        if (selector.steps[s].path < 0) {
+            continue;
+        }
+        JsonNode* node;
+        if ((ret = new_node(node)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        if ((ret = parse_value(node)) != JSON_PARSE_OK) {
+            delete node;
+            return ret;
+        }
+        if (steps.size() == 1 && selector.steps[s].children.empty()) {
+            out.push_back({selector.steps[s].path, pointer, node});
+        } else {
+            selector.select_tree(node, steps, pointer, out);
+            delete node;
+        }
+        return JSON_PARSE_OK;
+    }
+    switch (*ctx.json) {
+        case '[':
+            return select_array(selector, steps, pointer, out);
+        case '{':
+            return select_object(selector, steps, pointer, out);
+        default:
+            return skip_value();
+    }
+}
+
+int Parser::select_array(const JsonSelector& selector, const std::vector<int>& steps, std::string& pointer,
+                         std::vector<JsonSelection>& out) {
+    int ret;
+    int index = 0;
+    std::vector<int> next;
+    size_t length = pointer.size();
+    assert(*ctx.json == '[');
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == ']') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        std::string token = std::to_string(index++);
+        next.clear();
+        selector.match(steps, token, next);
+        if (!next.empty()) {
+            JsonPointer::append_token(pointer, token);
+        }
+        ret = select_value(selector, next, pointer, out);
+        pointer.resize(length);
+        if (ret != JSON_PARSE_OK) {
+            return ret;
+        }
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == ']') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+        }
+    }
+}
+
+int Parser::select_object(const JsonSelector& selector, const std::vector<int>& steps, std::string& pointer,
+                          std::vector<JsonSelection>& out) {
+    int ret;
+    std::string key;
+    std::vector<int> next;
+    size_t length = pointer.size();
+    assert(*ctx.json == '{');
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == '}') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        if (*ctx.json != '"') {
+            return JSON_PARSE_NOT_EXIST_KEY;
+        }
+        key.clear();
+        if ((ret = parse_string_raw(key)) != JSON_PARSE_OK) {
+            return ret;
+        }
+        parse_whitespace();
+        if (*ctx.json != ':') {
+            return JSON_PARSE_MISS_COLON;
+        }
+        ctx.json++;
+        parse_whitespace();
+        next.clear();
+        selector.match(steps, key, next);
+        if (!next.empty()) {
+            JsonPointer::append_token(pointer, key);
+        }
+        ret = select_value(selector, next, pointer, out);
+        pointer.resize(length);
+        if (ret != JSON_PARSE_OK) {
+            return ret;
+        }
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == '}') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            return JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+        }
+    }
+}
+
+int Parser::select(const JsonSelector& selector, std::vector<JsonSelection>& out) {
+    std::vector<int> steps(1, 0);
+    std::string pointer;
+    int ret;
+    parse_whitespace();
+    if ((ret = select_value(selector, steps, pointer, out)) == JSON_PARSE_OK) {
+        parse_whitespace();
+        if (*(ctx.json) != '\0') {
+            ret = JSON_PARSE_NOT_SINGLE_VALUE;
+        }
+    }
+    return ret;
+}
+
+//Shaped parsing falls back to parse_value wherever the shape says nothing.
+int Parser::parse_shape_value(const JsonShape& shape, int index, JsonNode* node) {
+    const JsonShape::Shape& s = shape.shapes[index];
+    if (*ctx.json == '{' && !s.members.empty()) {
+        return parse_shape_object(shape, index, node);
+    }
+    if (*ctx.json == '[' && s.element >= 0) {
+        return parse_shape_array(shape, index, node);
+    }
+    return parse_value(node);
+}
+
+int Parser::parse_shape_array(const JsonShape& shape, int index, JsonNode* node) {
+    int ret;
+    int element = shape.shapes[index].element;
+    assert(*ctx.json == '[');
+    node->set_array();
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == ']') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        JsonNode* n;
+        if ((ret = new_node(n)) != JSON_PARSE_OK) {
+            break;
+        }
+        if ((ret = parse_shape_value(shape, element, n)) != JSON_PARSE_OK) {
+            delete n;
+            break;
+        }
+        node->pushback_array_element(n);
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == ']') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+    }
+    node->json_free();
+    return ret;
+}
+
+//The next key is first compared with the expected one. On a miss it is
+//decoded as usual and looked up among the remaining members, so input with
+//reordered or extra keys resynchronizes instead of losing the shape.
+int Parser::parse_shape_object(const JsonShape& shape, int index, JsonNode* node) {
+    int ret;
+    const std::vector<JsonShape::Member>& members = shape.shapes[index].members;
+    size_t expect = 0;
+    std::string str;
+    assert(*ctx.json == '{');
+    node->set_object();
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == '}') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    node->reserve_object(members.size());
+    while (true) {
+        int value_shape = -1;
+        const std::string* key = &str;
+        if (expect < members.size() &&
+            strncmp(ctx.json, members[expect].token.data(), members[expect].token.size()) == 0) {
+            ctx.json += members[expect].token.size();
+            key = &members[expect].key;
+            value_shape = members[expect++].shape;
+        } else {
+            if (*ctx.json != '"') {
+                ret = JSON_PARSE_NOT_EXIST_KEY;
+                break;
+            }
+            str.clear();
+            if ((ret = parse_string_raw(str)) != JSON_PARSE_OK) {
+                break;
+            }
+            for (size_t i = expect; i < members.size(); i++) {
+                if (members[i].key == str) {
+                    value_shape = members[i].shape;
+                    expect = i + 1;
+                    break;
+                }
+            }
+        }
+        parse_whitespace();
+        if (*ctx.json != ':') {
+            ret = JSON_PARSE_MISS_COLON;
+            break;
+        }
+        ctx.json++;
+        parse_whitespace();
+        JsonNode* n;
+        if ((ret = new_node(n)) != JSON_PARSE_OK) {
+            break;
+        }
+        if ((ret = value_shape < 0 ? parse_value(n) : parse_shape_value(shape, value_shape, n)) != JSON_PARSE_OK) {
+            delete n;
+            break;
+        }
+        node->pushback_object_element(*key, n);
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == '}') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+    node->json_free();
+    return ret;
+}
+
+int Parser::parse(JsonNode& node, const JsonShape& shape) {
+    parse_whitespace();
+    int ret;
+    if ((ret = parse_shape_value(shape, 0, &node)) == JSON_PARSE_OK) {
+        parse_whitespace();
+        if (*(ctx.json) != '\0') {
+            node.set_null();
+            ret = JSON_PARSE_NOT_SINGLE_VALUE;
+        }
+    }
+    return ret;
+}
+
+//Validating parse: a value is checked against its rule as soon as it is
+//complete, and a container's type before any of its contents are read.
+//A failure unwinds with JSON_PARSE_SCHEMA_MISMATCH, each level prefixing
+//its token to error.pointer.
+int Parser::parse_schema_value(const JsonSchema& schema, int rule, JsonNode* node, JsonSchemaError& error) {
+    int ret;
+    char ch = *ctx.json;
+    bool value_start = ch == 'n' || ch == 't' || ch == 'f' || ch == '"' || ch == '[' || ch == '{' || ch == '-' ||
+                       ISDIGIT(ch);
+    if (value_start && !schema.accepts(rule, ch)) {
+        error.pointer.clear();
+        error.keyword = schema.rules[rule].never ? "false" : "type";
+        error.message = schema.rules[rule].never ? "no value is allowed" : "value has the wrong type";
+        return JSON_PARSE_SCHEMA_MISMATCH;
+    }
+    if (ch == '[') {
+        ret = parse_schema_array(schema, rule, node, error);
+    } else if (ch == '{') {
+        ret = parse_schema_object(schema, rule, node, error);
+    } else {
+        ret = parse_value(node);
+    }
+    if (ret != JSON_PARSE_OK) {
+        return ret;
+    }
+    std::string pointer;
+    std::vector<JsonSchemaError> errors;
+    if (!schema.check(rule, node, false, pointer, &errors, false)) {
+        error = errors[0];
+        node->json_free();
+        return JSON_PARSE_SCHEMA_MISMATCH;
+    }
+    return JSON_PARSE_OK;
+}
+
+int Parser::parse_schema_array(const JsonSchema& schema, int rule, JsonNode* node, JsonSchemaError& error) {
+    int ret;
+    int index = 0;
+    long max_items = schema.rules[rule].max_items;
+    assert(*ctx.json == '[');
+    node->set_array();
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == ']') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        if (max_items >= 0 && index >= max_items) {
+            error.pointer.clear();
+            error.keyword = "maxItems";
+            error.message = "array size is out of range";
+            ret = JSON_PARSE_SCHEMA_MISMATCH;
+            break;
+        }
+        int item = schema.get_item(rule, index);
+        JsonNode* n;
+        if ((ret = new_node(n)) != JSON_PARSE_OK) {
+            break;
+        }
+        if ((ret = item < 0 ? parse_value(n) : parse_schema_value(schema, item, n, error)) != JSON_PARSE_OK) {
+            if (ret == JSON_PARSE_SCHEMA_MISMATCH) {
+                std::string token;
+                JsonPointer::append_token(token, std::to_string(index));
+                error.pointer.insert(0, token);
+            }
+            delete n;
+            break;
+        }
+        node->pushback_array_element(n);
+        index++;
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == ']') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
+            break;
+        }
+    }
+    node->json_free();
+    return ret;
+}
+
+int Parser::parse_schema_object(const JsonSchema& schema, int rule, JsonNode* node, JsonSchemaError& error) {
+    int ret;
+    int hint = 0;
+    std::string str;
+    assert(*ctx.json == '{');
+    node->set_object();
+    ctx.json++;
+    parse_whitespace();
+    if (*ctx.json == '}') {
+        ctx.json++;
+        return JSON_PARSE_OK;
+    }
+    while (true) {
+        if (*ctx.json != '"') {
+            ret = JSON_PARSE_NOT_EXIST_KEY;
+            break;
+        }
+        str.clear();
+        if ((ret = parse_string_raw(str)) != JSON_PARSE_OK) {
+            break;
+        }
+        parse_whitespace();
+        if (*ctx.json != ':') {
+            ret = JSON_PARSE_MISS_COLON;
+            break;
+        }
+        ctx.json++;
+        parse_whitespace();
+        int property = schema.find_property(rule, str, hint);
+        JsonNode* n;
+        if ((ret = new_node(n)) != JSON_PARSE_OK) {
+            break;
+        }
+        if ((ret = property < 0 ? parse_value(n) : parse_schema_value(schema, property, n, error)) != JSON_PARSE_OK) {
+            if (ret == JSON_PARSE_SCHEMA_MISMATCH) {
+                std::string token;
+                JsonPointer::append_token(token, str);
+                error.pointer.insert(0, token);
+            }
+            delete n;
+            break;
+        }
+        node->pushback_object_element(str, n);
+        parse_whitespace();
+        if (*ctx.json == ',') {
+            ctx.json++;
+            parse_whitespace();
+        } else if (*ctx.json == '}') {
+            ctx.json++;
+            return JSON_PARSE_OK;
+        } else {
+            ret = JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            break;
+        }
+    }
+    node->json_free();
+    return ret;
+}
+
+int Parser::parse(JsonNode& node, const JsonSchema& schema, JsonSchemaError& error) {
+    parse_whitespace();
+    int ret;
+    if ((ret = parse_schema_value(schema, 0, &node, error)) == JSON_PARSE_OK) {
+        parse_whitespace();
+        if (*(ctx.json) != '\0') {
+            node.set_null();
+            ret = JSON_PARSE_NOT_SINGLE_VALUE;
+        }
+    }
+    return ret;
+}
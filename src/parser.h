@@ -1,28 +1,73 @@
 #pragma once
 #include "tiny_json.h"
 
+class JsonSelector;
+class JsonSchema;
+struct JsonSchemaError;
+class JsonShape;
+struct JsonSelection;
+struct JsonRecycle;
 
 class Parser final {
 public:
     Parser() = default;
     Parser(const JsonContext& c);
+    Parser(const JsonContext& c, const JsonParseOptions& options);
+    Parser(const JsonContext& c, const JsonParseOptions& options, JsonRecycle* recycle);
     Parser(const Parser& parse) = delete;
     Parser& operator=(const Parser& parse) = delete;
     ~Parser() = default;
     int parse(JsonNode& node);
+    size_t get_offset() const;
+    int parse(JsonNode& node, const JsonShape& shape);
+    int parse(JsonNode& node, const JsonSchema& schema, JsonSchemaError& error);
+    int select(const JsonSelector& selector, std::vector<JsonSelection>& out);
 
 private:
+    friend class JsonReader;
     void parse_whitespace();
     int parse_null(JsonNode* node);
     int parse_true(JsonNode* node);
     int parse_false(JsonNode* node);
+    const char* scan_number(const char* p);
+    int parse_number_raw(double& num);
     int parse_number(JsonNode* node);
+    int parse_number_text(JsonNode* node);
     const char* parse_hex4(const char* p, unsigned* u);
     void encode_utf8(std::string& str, unsigned u);
     int parse_string_raw(std::string& str);
     int parse_string(JsonNode* node);
+    int parse_packed_array(JsonNode* node, size_t size);
     int parse_array(JsonNode* node);
     int parse_object(JsonNode* node);
     int parse_value(JsonNode* node);
+    int new_node(JsonNode*& node);
+    void new_key(std::string& key);
+    void scan_sizes();
+    void scan_sizes(const char* p);
+    size_t next_size();
+    int skip_string();
+    int skip_array();
+    int skip_object();
+    int skip_value();
+    int select_value(const JsonSelector& selector, const std::vector<int>& steps, std::string& pointer,
+                     std::vector<JsonSelection>& out);
+    int select_array(const JsonSelector& selector, const std::vector<int>& steps, std::string& pointer,
+                     std::vector<JsonSelection>& out);
+    int select_object(const JsonSelector& selector, const std::vector<int>& steps, std::string& pointer,
+                      std::vector<JsonSelection>& out);
+    int parse_shape_value(const JsonShape& shape, int index, JsonNode* node);
+    int parse_shape_array(const JsonShape& shape, int index, JsonNode* node);
+    int parse_shape_object(const JsonShape& shape, int index, JsonNode* node);
+    int parse_schema_value(const JsonSchema& schema, int rule, JsonNode* node, JsonSchemaError& error);
+    int parse_schema_array(const JsonSchema& schema, int rule, JsonNode* node, JsonSchemaError& error);
+    int parse_schema_object(const JsonSchema& schema, int rule, JsonNode* node, JsonSchemaError& error);
     JsonContext ctx;
+    const char* start = nullptr;
+    JsonParseOptions options;
+    int depth = 0;
+    size_t nodes = 0;
+    JsonRecycle* recycle = nullptr;//spare nodes and keys to build from before allocating
+    std::vector<uint32_t> sizes;//members of each array and object in document order, from scan_sizes
+    size_t container = 0;//next entry of sizes
 };
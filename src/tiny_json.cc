@@ -1,43 +1,203 @@
 #include "tiny_json.h"
+#include "json_alloc.h"
+#include "json_pointer.h"
+#include "json_sink.h"
+#include "json_stringify.h"
 #include "parser.h"
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
 JsonNode::JsonNode(const JsonNode& node) {
-    this->json_free();
     this->json_copy(&node);
 }
 
 JsonNode& JsonNode::operator=(const JsonNode& node) {
-    this->json_free();
-    this->json_copy(&node);
+    if (this != &node) {
+        this->json_copy(&node);
+    }
     return *this;
 }
 
 JsonNode::~JsonNode() {
-    this->json_free();
+    this->free_children();
+}
+
+//Every heap node is preceded by the allocator it came from, nullptr for
+//operator new, so it is returned to the right place wherever it is freed:
+//by delete, json_free, a patch rollback or a recycling document, none of
+//which know how the tree was parsed. The 8 bytes mostly cost nothing; a
+//node is 112 bytes on 64-bit builds and glibc malloc hands out 120 usable
+//bytes for that request anyway.
+static const size_t JsonNode_header = sizeof(JsonAllocator*);
+
+void* JsonNode::operator new(size_t size) {
+    static_assert(alignof(JsonNode) <= JsonNode_header, "the header must keep nodes aligned");
+    auto base = static_cast<JsonAllocator**>(::operator new(size + JsonNode_header));
+    *base = nullptr;
+    return base + 1;
+}
+
+//Returns nullptr instead of throwing, so the parser can report the failure.
+void* JsonNode::operator new(size_t size, JsonAllocator* allocator) noexcept {
+    void* ptr = allocator != nullptr ? allocator->allocate(size + JsonNode_header)
+                                     : ::operator new(size + JsonNode_header, std::nothrow);
+    if (ptr == nullptr) {
+        return nullptr;
+    }
+    auto base = static_cast<JsonAllocator**>(ptr);
+    *base = allocator;
+    return base + 1;
+}
+
+void JsonNode::operator delete(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto base = static_cast<JsonAllocator**>(ptr) - 1;
+    if (*base != nullptr) {
+        (*base)->deallocate(base, size + JsonNode_header);
+    } else {
+        ::operator delete(base);
+    }
+}
+
+void JsonNode::operator delete(void* ptr, JsonAllocator*) noexcept {
+    JsonNode::operator delete(ptr, sizeof(JsonNode));
 }
 
+//Drops one owner of node, deleting it with the last.
+void JsonNode::release(JsonNode* node) {
+    if (node != nullptr && node->shares > 0) {
+        node->shares--;
+    } else {
+        delete node;
+    }
+}
+
+//Turns an owner's reference to node into a node the owner holds alone: node
+//itself, or a copy when others share it.
+JsonNode* JsonNode::unshare(JsonNode* node) {
+    if (node == nullptr || node->shares == 0) {
+        return node;
+    }
+    node->shares--;
+    auto copy = new JsonNode();
+    copy->json_copy(node);
+    return copy;
+}
+
+//Deletes every child this node owns and leaves it null.
 void JsonNode::json_free() {
-    switch (this->type) {
-        case JSON_TYPE_ARRAY:
-            for (auto node : this->array) {
-                node->json_free();
-                free(node);
-            }
-            this->array.clear();
-            break;
-        case JSON_TYPE_OBJECT:
-            for (auto node : this->object) {
-                node.second->json_free();
-                free(node.second);
-            }
-            this->object.clear();
-            break;
-        default:
-            break;
+    this->invalidate();
+    this->drop_cache();
+    this->free_children();
+    this->string.clear();
+}
+
+//json_free without the cache bookkeeping, for a node going away with its parent.
+void JsonNode::free_children() {
+    for (auto node : this->array) {
+        JsonNode::release(node);
     }
+    this->array.clear();
+    delete this->packed;
+    this->packed = nullptr;
+    for (auto& member : this->object) {
+        JsonNode::release(member.second);
+    }
+    this->object.clear();
     this->type = JSON_TYPE_NULL;
 }
 
+//Set in cache_length once the cached text no longer matches the node.
+static const uint32_t JsonNode_stale = 0x80000000u;
+
+//Marks the cached text of this node and of every ancestor stale. The old
+//text stays where it is, since unchanged children are still copied from
+//it. An ancestor without valid text has none above it either, because
+//json_stringify_cached caches a node only together with everything under
+//it, so the walk stops there.
+void JsonNode::invalidate() {
+    if (this->cache_length() != 0) {
+        this->set_cache_length(this->cache_length() | JsonNode_stale);
+    }
+    for (JsonNode* node = this->parent; node != nullptr && node->cache_valid(); node = node->parent) {
+        node->set_cache_length(node->cache_length() | JsonNode_stale);
+    }
+}
+
+//Records this as the parent of a node it has just taken in. A node shared
+//by JsonDedup has no single parent and keeps none. Any cached position
+//the node had was in another parent's text.
+void JsonNode::adopt(JsonNode* node) const {
+    if (node != nullptr && node->shares == 0) {
+        node->parent = const_cast<JsonNode*>(this);
+        node->drop_cache();
+    }
+}
+
+//For a node its parent has just let go of.
+void JsonNode::leave_parent() {
+    this->parent = nullptr;
+    this->drop_cache();
+}
+
+//The offset and length that string holds for an array or object; the text
+//of the node json_stringify_cached was called on follows them.
+static const size_t JsonNode_cache_record = 2 * sizeof(uint32_t);
+
+uint32_t JsonNode::cache_offset() const {
+    uint32_t offset = 0;
+    if ((this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT) &&
+        this->string.size() >= JsonNode_cache_record) {
+        memcpy(&offset, this->string.data(), sizeof(offset));
+    }
+    return offset;
+}
+
+uint32_t JsonNode::cache_length() const {
+    uint32_t length = 0;
+    if ((this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT) &&
+        this->string.size() >= JsonNode_cache_record) {
+        memcpy(&length, this->string.data() + sizeof(uint32_t), sizeof(length));
+    }
+    return length;
+}
+
+void JsonNode::set_cache_offset(uint32_t offset) {
+    assert(this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT);
+    if (this->string.size() < JsonNode_cache_record) {
+        this->string.assign(JsonNode_cache_record, '\0');
+    }
+    memcpy(&this->string[0], &offset, sizeof(offset));
+}
+
+void JsonNode::set_cache_length(uint32_t length) {
+    assert(this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT);
+    if (this->string.size() < JsonNode_cache_record) {
+        this->string.assign(JsonNode_cache_record, '\0');
+    }
+    memcpy(&this->string[sizeof(uint32_t)], &length, sizeof(length));
+}
+
+bool JsonNode::owns_text() const {
+    return (this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT) &&
+           this->string.size() > JsonNode_cache_record;
+}
+
+//Forgets the place and frees the text of an array or object; other nodes
+//keep their string.
+void JsonNode::drop_cache() {
+    if (this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT) {
+        std::string().swap(this->string);
+    }
+}
+
+//Resets a node that owns nothing; use json_free on one that may have children.
 void JsonNode::json_init() {
     this->type = JSON_TYPE_NULL;
 }
@@ -45,13 +205,74 @@ void JsonNode::json_init() {
 int JsonNode::json_parse(const char* json) {
     JsonContext ctx{};
     ctx.json = json;
-    this->json_init();
+    this->json_free();
     Parser p(ctx);
     int ret;
     ret = p.parse(*this);
     return ret;
 }
 
+//Fills in line, column and context from offset. Only called on error, so
+//successful parses never scan for line breaks.
+static void JsonParse_locate(const char* json, JsonParseResult& result) {
+    const char* error = json + result.offset;
+    const char* line_start = json;
+    result.line = 1;
+    for (const char* p = json; (p = static_cast<const char*>(memchr(p, '\n', error - p))) != nullptr; p++) {
+        result.line++;
+        line_start = p + 1;
+    }
+    result.column = error - line_start + 1;
+    const char* begin = error - line_start > 20 ? error - 20 : line_start;
+    const char* end = error;
+    while (end < error + 20 && *end != '\0' && *end != '\n' && *end != '\r') {
+        end++;
+    }
+    result.context.assign(begin, end);
+    for (char& ch : result.context) {
+        if ((unsigned char) ch < 0x20) {
+            ch = ' ';
+        }
+    }
+    result.context_offset = error - begin;
+}
+
+int JsonNode::json_parse(const char* json, JsonParseResult& result) {
+    JsonContext ctx{};
+    ctx.json = json;
+    this->json_free();
+    Parser p(ctx);
+    result = JsonParseResult();
+    result.code = p.parse(*this);
+    result.offset = p.get_offset();
+    if (result.code != JSON_PARSE_OK) {
+        JsonParse_locate(json, result);
+    }
+    return result.code;
+}
+
+int JsonNode::json_parse(const char* json, const JsonParseOptions& options) {
+    JsonContext ctx{};
+    ctx.json = json;
+    this->json_free();
+    Parser p(ctx, options);
+    return p.parse(*this);
+}
+
+int JsonNode::json_parse(const char* json, const JsonParseOptions& options, JsonParseResult& result) {
+    JsonContext ctx{};
+    ctx.json = json;
+    this->json_free();
+    Parser p(ctx, options);
+    result = JsonParseResult();
+    result.code = p.parse(*this);
+    result.offset = p.get_offset();
+    if (result.code != JSON_PARSE_OK) {
+        JsonParse_locate(json, result);
+    }
+    return result.code;
+}
+
 JsonType JsonNode::get_type() const {
     return this->type;
 }
@@ -71,16 +292,63 @@ void JsonNode::set_bool(bool b) {
     b ? this->type = JSON_TYPE_TRUE : this->type = JSON_TYPE_FALSE;
 }
 
+//A raw number is converted from its token on every read, which leaves the
+//node untouched for other readers. set_number(get_number()) converts it
+//for good.
 double JsonNode::get_number() const {
     assert(this->type == JSON_TYPE_NUMBER);
+    if (!this->string.empty()) {
+        return strtod(this->string.c_str(), nullptr);
+    }
     return this->number;
 }
 void JsonNode::set_number(double num) {
+    this->json_free();
     this->type = JSON_TYPE_NUMBER;
     this->number = num;
+    this->string.clear();
+}
+
+//Exact for any integer token of a raw number in the range of long long,
+//including those a double cannot hold. False for a fraction or a value
+//out of range.
+bool JsonNode::get_integer(long long& value) const {
+    assert(this->type == JSON_TYPE_NUMBER);
+    if (!this->string.empty() && this->string.find_first_of(".eE") == std::string::npos) {
+        errno = 0;
+        long long integer = strtoll(this->string.c_str(), nullptr, 10);
+        if (errno == ERANGE) {
+            return false;
+        }
+        value = integer;
+        return true;
+    }
+    double num = this->get_number();
+    if (num != std::floor(num) || num < -9223372036854775808.0 || num >= 9223372036854775808.0) {
+        return false;
+    }
+    value = (long long) num;
+    return true;
+}
+
+//Whether the number still has the text it was parsed from.
+bool JsonNode::is_raw_number() const {
+    return this->type == JSON_TYPE_NUMBER && !this->string.empty();
+}
+
+//The number as json_stringify writes it: the original token of a raw number.
+std::string JsonNode::get_number_text() const {
+    assert(this->type == JSON_TYPE_NUMBER);
+    if (!this->string.empty()) {
+        return this->string;
+    }
+    std::string s;
+    JsonStringify_number(this->number, s);
+    return s;
 }
 
 void JsonNode::set_string(const std::string& str) {
+    this->json_free();
     this->string = str;
     this->type = JSON_TYPE_STRING;
 }
@@ -93,15 +361,23 @@ int JsonNode::get_string_length() const {
     return this->string.size();
 }
 
+//Keeps the elements of a node that already is an array.
 void JsonNode::set_array() {
-    this->type = JSON_TYPE_ARRAY;
+    if (this->type != JSON_TYPE_ARRAY) {
+        this->json_free();
+        this->type = JSON_TYPE_ARRAY;
+    }
 }
 
 void JsonNode::set_array(const std::vector<JsonNode*>& arr) {
     JsonNode* node_tmp;
+    this->set_array();
+    this->unpack_array();
+    this->invalidate();
     for (auto node : arr) {
         node_tmp = new JsonNode();
         node_tmp->json_copy(node);
+        this->adopt(node_tmp);
         this->array.emplace_back(node_tmp);
     }
     this->type = JSON_TYPE_ARRAY;
@@ -109,12 +385,21 @@ void JsonNode::set_array(const std::vector<JsonNode*>& arr) {
 
 int JsonNode::get_array_size() const {
     assert(this->type == JSON_TYPE_ARRAY);
-    return this->array.size();
+    return this->packed != nullptr ? this->packed->numbers.size() : this->array.size();
 }
 
+//Unpacks a packed array, since the element has to be a node.
+JsonNode* JsonNode::get_array_index(int index) {
+    assert(this->type == JSON_TYPE_ARRAY);
+    this->unpack_array();
+    return static_cast<const JsonNode*>(this)->get_array_index(index);
+}
+
+//Leaves a packed array as it is, so it has no element nodes to return;
+//read its numbers with get_array_number or get_packed_array.
 JsonNode* JsonNode::get_array_index(int index) const {
     assert(this->type == JSON_TYPE_ARRAY);
-    if (index < 0 || index >= this->array.size()) {
+    if (index < 0 || (size_t) index >= this->array.size()) {
         return nullptr;
     }
     return this->array[index];
@@ -122,55 +407,187 @@ JsonNode* JsonNode::get_array_index(int index) const {
 
 void JsonNode::erase_array_element(int index, int count) {
     assert(this->type == JSON_TYPE_ARRAY);
-    auto iter_b = this->array.begin();
-    int i = 0;
-    int j = 0;
     if (count <= 0) {
         return;
     }
-    while (i++ < index) {
-        iter_b++;
+    assert(index >= 0 && index + count <= this->get_array_size());
+    this->invalidate();
+    if (this->packed != nullptr) {
+        std::vector<double>& numbers = this->packed->numbers;
+        numbers.erase(numbers.begin() + index, numbers.begin() + index + count);
+        return;
     }
-    auto iter_e = iter_b;
-    while (j++ < count) {
-        iter_e++;
+    for (int i = index; i < index + count; i++) {
+        JsonNode::release(this->array[i]);
     }
-    this->array.erase(iter_b, iter_e);
+    this->array.erase(this->array.begin() + index, this->array.begin() + index + count);
 }
 
 void JsonNode::pushback_array_element(JsonNode* node) {
     assert(this->type == JSON_TYPE_ARRAY);
+    this->unpack_array();
+    this->invalidate();
+    this->adopt(node);
     this->array.push_back(node);
 }
 
 void JsonNode::popback_array_element() {
     assert(this->type == JSON_TYPE_ARRAY);
-    this->array[this->array.size() - 1]->json_free();
+    this->invalidate();
+    if (this->packed != nullptr) {
+        this->packed->numbers.pop_back();
+        return;
+    }
+    JsonNode::release(this->array.back());
     this->array.pop_back();
 }
 
 void JsonNode::insert_array_element(JsonNode* node, int index) {
     assert(this->type == JSON_TYPE_ARRAY);
+    this->unpack_array();
+    this->invalidate();
+    this->adopt(node);
     this->array.insert(this->array.begin() + index, node);
 }
 
-void JsonNode::clear_array() {
+void JsonNode::reserve_array(int capacity) {
+    assert(this->type == JSON_TYPE_ARRAY && capacity >= 0);
+    if (this->packed != nullptr) {
+        this->packed->numbers.reserve(capacity);
+        return;
+    }
+    this->array.reserve(capacity);
+}
+
+//Removes the element without freeing it; the caller takes ownership.
+JsonNode* JsonNode::detach_array_element(int index) {
+    this->unpack_array();
+    assert(this->type == JSON_TYPE_ARRAY && index >= 0 && (size_t) index < this->array.size());
+    JsonNode* node = this->array[index];
+    this->invalidate();
+    this->array.erase(this->array.begin() + index);
+    if (node->parent == this) {
+        node->leave_parent();
+    }
+    return JsonNode::unshare(node);
+}
+
+//Puts node at index and hands the previous element back to the caller.
+JsonNode* JsonNode::replace_array_element(int index, JsonNode* node) {
+    this->unpack_array();
+    assert(this->type == JSON_TYPE_ARRAY && index >= 0 && (size_t) index < this->array.size());
+    JsonNode* old = this->array[index];
+    this->invalidate();
+    this->adopt(node);
+    this->array[index] = node;
+    if (old->parent == this) {
+        old->leave_parent();
+    }
+    return JsonNode::unshare(old);
+}
+
+//Makes this an array that stores numbers contiguously, without a node per
+//element. Non-const node accessors such as get_array_index unpack it first.
+void JsonNode::set_packed_array(std::vector<double> numbers) {
+    this->json_free();
+    this->type = JSON_TYPE_ARRAY;
+    this->packed = new JsonPackedArray();
+    this->packed->numbers = std::move(numbers);
+}
+
+bool JsonNode::is_packed_array() const {
     assert(this->type == JSON_TYPE_ARRAY);
-    for (auto node : this->array) {
-        node->json_free();
+    return this->packed != nullptr;
+}
+
+//The numbers of a packed array, get_array_size of them.
+const double* JsonNode::get_packed_array() const {
+    assert(this->type == JSON_TYPE_ARRAY && this->packed != nullptr);
+    return this->packed->numbers.data();
+}
+
+//Reads a number element of either kind of array without unpacking.
+double JsonNode::get_array_number(int index) const {
+    assert(this->type == JSON_TYPE_ARRAY && index >= 0 && index < this->get_array_size());
+    if (this->packed != nullptr) {
+        return this->packed->numbers[index];
     }
-    this->array.clear();
+    return this->array[index]->get_number();
+}
+
+//Stays packed when the array is packed; otherwise appends a number node.
+void JsonNode::pushback_array_number(double num) {
+    assert(this->type == JSON_TYPE_ARRAY);
+    this->invalidate();
+    if (this->packed != nullptr) {
+        this->packed->numbers.push_back(num);
+        return;
+    }
+    auto node = new JsonNode();
+    node->set_number(num);
+    this->adopt(node);
+    this->array.push_back(node);
+}
+
+//Gives each number of a packed array its own node, from the allocator of
+//the parse that packed it. Nodes handed out afterwards stay valid as long
+//as the array does.
+void JsonNode::unpack_array() {
+    if (this->packed == nullptr) {
+        return;
+    }
+    this->array.reserve(this->packed->numbers.size());
+    for (double num : this->packed->numbers) {
+        auto node = new (this->packed->allocator) JsonNode();
+        if (node == nullptr) {
+            throw std::bad_alloc();
+        }
+        node->set_number(num);
+        this->adopt(node);
+        this->array.push_back(node);
+    }
+    delete this->packed;
+    this->packed = nullptr;
+}
+
+//The element nodes, in order; a packed array is unpacked first. The const
+//form does not unpack, and a packed array has no nodes to visit there.
+JsonRange<JsonElementIterator> JsonNode::elements() {
+    assert(this->type == JSON_TYPE_ARRAY);
+    this->unpack_array();
+    JsonNode* const* data = this->array.data();
+    return JsonRange<JsonElementIterator>(JsonElementIterator(data), JsonElementIterator(data + this->array.size()));
+}
+
+JsonRange<JsonConstElementIterator> JsonNode::elements() const {
+    assert(this->type == JSON_TYPE_ARRAY && this->packed == nullptr);
+    JsonNode* const* data = this->array.data();
+    return JsonRange<JsonConstElementIterator>(JsonConstElementIterator(data),
+                                               JsonConstElementIterator(data + this->array.size()));
 }
 
+void JsonNode::clear_array() {
+    assert(this->type == JSON_TYPE_ARRAY);
+    this->json_free();
+    this->type = JSON_TYPE_ARRAY;
+}
+
+//Keeps the members of a node that already is an object.
 void JsonNode::set_object() {
-    this->type = JSON_TYPE_OBJECT;
+    if (this->type != JSON_TYPE_OBJECT) {
+        this->json_free();
+        this->type = JSON_TYPE_OBJECT;
+    }
 }
 
 void JsonNode::set_object(const std::vector<std::pair<std::string, JsonNode*>>& obj) {
     JsonNode* node_tmp;
+    this->set_object();
+    this->invalidate();
     for (auto node : obj) {
         node_tmp = new JsonNode();
         node_tmp->json_copy(node.second);
+        this->adopt(node_tmp);
         this->object.emplace_back(std::pair<std::string, JsonNode*>(node.first, node_tmp));
     }
     this->type = JSON_TYPE_OBJECT;
@@ -183,39 +600,26 @@ int JsonNode::get_object_size() const {
 
 std::string JsonNode::get_object_key(int index) const {
     assert(this->type == JSON_TYPE_OBJECT && index >= 0 && index < this->object.size());
-    int i = 0;
-    auto iter = this->object.begin();
-    while (i++ < index) {
-        iter++;
-    }
-    return iter->first;
+    return this->object[index].first;
 }
 int JsonNode::get_object_key_length(int index) const {
     assert(this->type == JSON_TYPE_OBJECT && index >= 0 && index < this->object.size());
-    int i = 0;
-    auto iter = this->object.begin();
-    while (i++ < index) {
-        iter++;
-    }
-    return iter->first.size();
+    return this->object[index].first.size();
 }
 
 JsonNode* JsonNode::get_object_value(int index) const {
     assert(this->type == JSON_TYPE_OBJECT && index >= 0 && index < this->object.size());
-    int i = 0;
-    auto iter = this->object.begin();
-    while (i++ < index) {
-        iter++;
-    }
-    return iter->second;
+    return this->object[index].second;
 }
 
 void JsonNode::set_object_value(const std::string& key, JsonNode* node) {
     assert(this->type == JSON_TYPE_OBJECT);
+    this->invalidate();
+    this->adopt(node);
     auto iter = this->object.begin();
     while (iter != this->object.end()) {
         if (iter->first == key) {
-            iter->second->json_free();
+            JsonNode::release(iter->second);
             iter->second = node;
             return;
         }
@@ -246,10 +650,34 @@ JsonNode* JsonNode::find_object_value(const std::string& str) {
     return nullptr;
 }
 
+//Checks the member at hint first, then scans. Returns -1 if the key does not exist.
+int JsonNode::find_object_index(const std::string& str, int hint) const {
+    assert(this->type == JSON_TYPE_OBJECT);
+    int size = this->object.size();
+    if (hint >= 0 && hint < size && this->object[hint].first == str) {
+        return hint;
+    }
+    for (int i = 0; i < size; i++) {
+        if (this->object[i].first == str) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//Like find_object_index with a hint, and remembers where the key was found.
+JsonNode* JsonNode::find_object_value(const std::string& str, int& hint) {
+    int index = this->find_object_index(str, hint);
+    if (index < 0) {
+        return nullptr;
+    }
+    hint = index;
+    return this->object[index].second;
+}
+
 void JsonNode::clear_object() {
     assert(this->type == JSON_TYPE_OBJECT);
     this->json_free();
-    this->object.clear();
     this->type = JSON_TYPE_OBJECT;
 }
 
@@ -260,135 +688,247 @@ void JsonNode::remove_object_value(int index) {
     while (i++ < index) {
         iter++;
     }
-    iter->second->json_free();
+    this->invalidate();
+    JsonNode::release(iter->second);
     this->object.erase(iter);
 }
 
 void JsonNode::pushback_object_element(const std::string& key, JsonNode* node) {
     assert(this->type == JSON_TYPE_OBJECT);
+    this->invalidate();
+    this->adopt(node);
     this->object.emplace_back(std::pair<std::string, JsonNode*>(key, node));
 }
 
-static void JsonStringify_string(const JsonNode* node, std::string& str) {
-    static const char hex_digits[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-    assert(node->get_type() == JSON_TYPE_STRING);
-    str.push_back('"');
-    for (int i = 0; i < node->get_string_length(); i++) {
-        char ch = node->get_string()[i];
-        switch (ch) {
-            case '\"':
-                str += '\\';
-                str += '\"';
-                break;
-            case '\\':
-                str += '\\';
-                str += '\\';
-                break;
-            case '\b':
-                str += '\\';
-                str += 'b';
-                break;
-            case '\f':
-                str += '\\';
-                str += 'f';
-                break;
-            case '\n':
-                str += '\\';
-                str += 'n';
-                break;
-            case '\r':
-                str += '\\';
-                str += 'r';
-                break;
-            case '\t':
-                str += '\\';
-                str += 't';
-                break;
-            default:
-                if (ch < 0x20) {
-                    str += '\\';
-                    str += 'u';
-                    str += '0';
-                    str += '0';
-                    str += hex_digits[ch >> 4];
-                    str += hex_digits[ch & 15];
-                } else
-                    str += node->get_string()[i];
-        }
+JsonNode* JsonNode::json_pointer_get(const std::string& pointer) {
+    JsonPointer p;
+    if (p.compile(pointer) != JSON_POINTER_OK) {
+        return nullptr;
     }
-    str.push_back('"');
+    return p.resolve(this);
 }
-static void JsonStringify_number(const JsonNode* node, std::string& str) {
-    char tmp[32];
-    sprintf(tmp, "%.17g", node->get_number());
-    str += tmp;
+
+void JsonNode::insert_object_element(int index, const std::string& key, JsonNode* node) {
+    assert(this->type == JSON_TYPE_OBJECT && index >= 0 && (size_t) index <= this->object.size());
+    this->invalidate();
+    this->adopt(node);
+    this->object.emplace(this->object.begin() + index, key, node);
 }
 
-static void JsonStringify_value(const JsonNode* node, std::string& str) {
-    switch (node->get_type()) {
-        case JSON_TYPE_NULL:
-            str += "null";
-            break;
-        case JSON_TYPE_TRUE:
-            str += "true";
-            break;
-        case JSON_TYPE_FALSE:
-            str += "false";
-            break;
-        case JSON_TYPE_NUMBER:
-            JsonStringify_number(node, str);
-            break;
-        case JSON_TYPE_STRING:
-            JsonStringify_string(node, str);
-            break;
-        case JSON_TYPE_ARRAY:
-            str += '[';
-            for (int i = 0; i < node->get_array_size(); i++) {
-                if (i > 0) {
-                    str += ',';
-                }
-                JsonStringify_value(node->get_array_index(i), str);
-            }
-            str += ']';
-            break;
-        case JSON_TYPE_OBJECT:
-            str += '{';
-            for (int i = 0; i < node->get_object_size(); i++) {
-                if (i > 0) {
-                    str += ',';
-                }
-                str += '"';
-                str += node->get_object_key(i);
-                str += '"';
-                str += ':';
-                JsonStringify_value(node->get_object_value(i), str);
-            }
-            str += '}';
-            break;
+void JsonNode::reserve_object(int capacity) {
+    assert(this->type == JSON_TYPE_OBJECT && capacity >= 0);
+    this->object.reserve(capacity);
+}
+
+//Removes the member without freeing its value; the caller takes ownership.
+JsonNode* JsonNode::detach_object_value(int index) {
+    assert(this->type == JSON_TYPE_OBJECT && index >= 0 && (size_t) index < this->object.size());
+    JsonNode* node = this->object[index].second;
+    this->invalidate();
+    this->object.erase(this->object.begin() + index);
+    if (node->parent == this) {
+        node->leave_parent();
     }
+    return JsonNode::unshare(node);
+}
+
+//Puts node under the key at index and hands the previous value back to the caller.
+JsonNode* JsonNode::replace_object_value(int index, JsonNode* node) {
+    assert(this->type == JSON_TYPE_OBJECT && index >= 0 && (size_t) index < this->object.size());
+    JsonNode* old = this->object[index].second;
+    this->invalidate();
+    this->adopt(node);
+    this->object[index].second = node;
+    if (old->parent == this) {
+        old->leave_parent();
+    }
+    return JsonNode::unshare(old);
+}
+
+//Keys can be read but not changed through the range; values can.
+JsonRange<JsonMemberIterator> JsonNode::members() {
+    assert(this->type == JSON_TYPE_OBJECT);
+    const std::pair<std::string, JsonNode*>* data = this->object.data();
+    return JsonRange<JsonMemberIterator>(JsonMemberIterator(data), JsonMemberIterator(data + this->object.size()));
 }
+
+JsonRange<JsonConstMemberIterator> JsonNode::members() const {
+    assert(this->type == JSON_TYPE_OBJECT);
+    const std::pair<std::string, JsonNode*>* data = this->object.data();
+    return JsonRange<JsonConstMemberIterator>(JsonConstMemberIterator(data),
+                                              JsonConstMemberIterator(data + this->object.size()));
+}
+
 std::string JsonNode::json_stringify() const {
     std::string s;
     JsonStringify_value(this, s);
     return s;
 }
 
+//Streams the text through a buffer of buffer_size bytes, so memory stays
+//bounded however large the document is.
+int JsonNode::json_stringify(JsonSink& sink, size_t buffer_size) const {
+    JsonSinkBuffer buffer(sink, buffer_size);
+    JsonStringify_value(this, buffer);
+    return buffer.flush() ? JSON_STRINGIFY_OK : JSON_STRINGIFY_SINK_ERROR;
+}
+
+std::string JsonNode::json_stringify(const JsonStringifyOptions& options) const {
+    std::string s;
+    std::vector<const std::pair<std::string, JsonNode*>*> keys;
+    JsonStringify_value(this, options, keys, 0, s);
+    return s;
+}
+
+int JsonNode::json_stringify(JsonSink& sink, const JsonStringifyOptions& options, size_t buffer_size) const {
+    JsonSinkBuffer buffer(sink, buffer_size);
+    std::vector<const std::pair<std::string, JsonNode*>*> keys;
+    JsonStringify_value(this, options, keys, 0, buffer);
+    return buffer.flush() ? JSON_STRINGIFY_OK : JSON_STRINGIFY_SINK_ERROR;
+}
+
+//Same text as json_stringify, but the arrays and objects below remember
+//where their text is, and later calls copy out the text of whatever has
+//not changed. Setters mark stale the node they change and its ancestors,
+//so after editing one leaf only the containers on its path are encoded
+//again and the rest is spliced in. The text is kept once, by the node this
+//is called on, so the cache is about the size of the document; a cached
+//node moved into another tree is encoded again there, and
+//clear_stringify_cache frees the text. Edits to a node shared by JsonDedup
+//do not reach the cache above it.
+std::string JsonNode::json_stringify_cached() {
+    const char* old = this->cache_start();
+    if (old != nullptr && this->cache_valid()) {
+        return std::string(old, this->cache_length());
+    }
+    std::string s;
+    this->stringify_cached(s, old);
+    if (this->cache_length() != 0) {
+        this->string.append(s);
+    }
+    return s;
+}
+
+//Frees the cached text of this node and everything under it.
+void JsonNode::clear_stringify_cache() {
+    this->invalidate();
+    this->forget_cache();
+}
+
+void JsonNode::forget_cache() {
+    this->drop_cache();
+    for (auto node : this->array) {
+        node->forget_cache();
+    }
+    for (auto& member : this->object) {
+        member.second->forget_cache();
+    }
+}
+
+bool JsonNode::cache_valid() const {
+    uint32_t length = this->cache_length();
+    return length != 0 && (length & JsonNode_stale) == 0;
+}
+
+//Where this node's last cached text begins, up in the text of the nearest
+//node holding one; nullptr if it has none.
+const char* JsonNode::cache_start() const {
+    size_t offset = 0;
+    for (const JsonNode* node = this; node != nullptr && node->shares == 0; node = node->parent) {
+        if (node->owns_text()) {
+            return node->string.data() + JsonNode_cache_record + offset;
+        }
+        if (node->cache_length() == 0) {
+            return nullptr;
+        }
+        offset += node->cache_offset();
+    }
+    return nullptr;
+}
+
+//Appends this node's text to out. old is where its text began in the
+//previous cached text, or nullptr if unknown; children that have not
+//changed are copied from there. Afterwards the node and every container
+//under it know their place in out, and only the caller keeps the text.
+void JsonNode::stringify_cached(std::string& out, const char* old) {
+    if ((this->type != JSON_TYPE_ARRAY && this->type != JSON_TYPE_OBJECT) || this->shares > 0) {
+        JsonStringify_value(this, out);
+        return;
+    }
+    if (this->owns_text()) {
+        old = this->string.data() + JsonNode_cache_record;
+    }
+    size_t start = out.size();
+    auto child = [&](JsonNode* node) {
+        size_t at = out.size();
+        bool placed = old != nullptr && !node->owns_text() && node->cache_length() != 0;
+        node->stringify_cached(out, placed ? old + node->cache_offset() : nullptr);
+        if (node->cache_length() != 0) {
+            node->set_cache_offset(at - start);
+        }
+    };
+    if (old != nullptr && this->cache_valid()) {
+        out.append(old, this->cache_length());
+    } else if (this->type == JSON_TYPE_ARRAY) {
+        out.push_back('[');
+        if (this->packed != nullptr) {
+            JsonStringify_numbers(this->packed->numbers.data(), this->packed->numbers.size(), out);
+        }
+        for (size_t i = 0; i < this->array.size(); i++) {
+            if (i > 0) {
+                out.push_back(',');
+            }
+            child(this->array[i]);
+        }
+        out.push_back(']');
+    } else {
+        out.push_back('{');
+        for (size_t i = 0; i < this->object.size(); i++) {
+            if (i > 0) {
+                out.push_back(',');
+            }
+            JsonStringify_string(this->object[i].first.data(), this->object[i].first.size(), out);
+            out.push_back(':');
+            child(this->object[i].second);
+        }
+        out.push_back('}');
+    }
+    size_t length = out.size() - start;
+    if (this->owns_text()) {
+        std::string(this->string, 0, JsonNode_cache_record).swap(this->string);
+    }
+    this->set_cache_length(length < JsonNode_stale ? length : 0);
+}
+
+//Subtrees shared by JsonDedup compare equal by pointer without a walk.
 int JsonNode::json_is_equal(JsonNode* rhs) const {
     assert(rhs != nullptr);
+    if (this == rhs) {
+        return 1;
+    }
     if (this->type != rhs->type) {
         return 0;
     }
-    auto iter = this->object.begin();
-    auto iter_rhs = rhs->object.begin();
     switch (this->type) {
         case JSON_TYPE_STRING:
             return this->string == rhs->string;
         case JSON_TYPE_NUMBER:
-            return this->number == rhs->number;
+            return this->get_number() == rhs->get_number();
         case JSON_TYPE_ARRAY:
-            if (this->array.size() != rhs->array.size()) {
+            if (this->get_array_size() != rhs->get_array_size()) {
                 return 0;
             }
+            if (this->packed != nullptr || rhs->packed != nullptr) {
+                for (int i = 0; i < this->get_array_size(); i++) {
+                    const JsonNode* a = this->packed != nullptr ? nullptr : this->array[i];
+                    const JsonNode* b = rhs->packed != nullptr ? nullptr : rhs->array[i];
+                    if ((a != nullptr && a->type != JSON_TYPE_NUMBER) || (b != nullptr && b->type != JSON_TYPE_NUMBER) ||
+                        this->get_array_number(i) != rhs->get_array_number(i)) {
+                        return 0;
+                    }
+                }
+                return 1;
+            }
             for (int i = 0; i < this->array.size(); i++)
                 if (!this->array[i]->json_is_equal(rhs->array[i])) {
                     return 0;
@@ -398,10 +938,11 @@ int JsonNode::json_is_equal(JsonNode* rhs) const {
             if (this->object.size() != rhs->object.size()) {
                 return 0;
             }
-            int index;
-            for (; iter != this->object.end(); iter++) {
-                index = rhs->find_object_index(iter->first);
-                if (!iter->second->json_is_equal(rhs->object[index].second)) {
+            //Members usually come in the same order, so each key is looked
+            //for at its own index first.
+            for (size_t i = 0; i < this->object.size(); i++) {
+                int index = rhs->find_object_index(this->object[i].first, (int) i);
+                if (index < 0 || !this->object[i].second->json_is_equal(rhs->object[index].second)) {
                     return 0;
                 }
             }
@@ -414,6 +955,7 @@ int JsonNode::json_is_equal(JsonNode* rhs) const {
 void JsonNode::json_copy(const JsonNode* src) {
     int i;
     assert(src != this);
+    this->json_free();
     auto iter = src->object.begin();
     switch (src->type) {
         case JSON_TYPE_STRING:
@@ -421,10 +963,15 @@ void JsonNode::json_copy(const JsonNode* src) {
             break;
         case JSON_TYPE_ARRAY:
             this->type = JSON_TYPE_ARRAY;
+            if (src->packed != nullptr) {
+                this->packed = new JsonPackedArray();
+                this->packed->numbers = src->packed->numbers;
+                break;
+            }
             JsonNode* tmp_array;
             for (i = 0; i < src->array.size(); i++) {
                 tmp_array = new JsonNode();
-                memcpy(tmp_array, src->array[i], sizeof(JsonNode));
+                tmp_array->json_copy(src->array[i]);
                 this->pushback_array_element(tmp_array);
             }
             break;
@@ -438,8 +985,11 @@ void JsonNode::json_copy(const JsonNode* src) {
             }
             break;
         default:
-            this->json_free();
-            memcpy(this, src, sizeof(JsonNode));
+            this->type = src->type;
+            this->number = src->number;
+            if (src->type == JSON_TYPE_NUMBER) {
+                this->string = src->string;
+            }
             break;
     }
 }
@@ -447,17 +997,89 @@ void JsonNode::json_copy(const JsonNode* src) {
 void JsonNode::json_move(JsonNode* src) {
     assert(src != nullptr && src != this);
     this->json_free();
-    this->json_copy(src);
-    src->json_init();
+    this->json_swap(src);
 }
 
 void JsonNode::json_swap(JsonNode* rhs) {
     assert(rhs != nullptr);
     if (this != rhs) {
-        auto* tmp = new JsonNode();
-        tmp->json_move(this);
-        this->json_move(rhs);
-        rhs->json_move(tmp);
-        tmp->json_free();
+        this->invalidate();
+        rhs->invalidate();
+        this->drop_cache();
+        rhs->drop_cache();
+        std::swap(this->type, rhs->type);
+        std::swap(this->number, rhs->number);
+        this->string.swap(rhs->string);
+        this->array.swap(rhs->array);
+        std::swap(this->packed, rhs->packed);
+        this->object.swap(rhs->object);
+        //The children changed hands, so they need their new parent.
+        for (const JsonNode* node : {this, rhs}) {
+            for (auto child : node->array) {
+                node->adopt(child);
+            }
+            for (const auto& member : node->object) {
+                node->adopt(member.second);
+            }
+        }
     }
-}
\ No newline at end of file
+}
+
+//Heap bytes behind a string; none while it fits in the small-string buffer.
+static size_t JsonNode_string_heap(const std::string& str) {
+    const char* self = reinterpret_cast<const char*>(&str);
+    if (str.data() >= self && str.data() < self + sizeof(str)) {
+        return 0;
+    }
+    return str.capacity() + 1;
+}
+
+static void JsonNode_string_stats(const std::string& str, bool counted, JsonMemoryStats& stats) {
+    size_t heap = JsonNode_string_heap(str);
+    if (counted) {
+        stats.string_length += str.size();
+    }
+    stats.string_bytes += heap;
+    stats.string_slack += heap > 0 ? heap - str.size() - 1 : 0;
+}
+
+//Adds this tree to stats, which may already hold other trees.
+void JsonNode::json_memory_stats(JsonMemoryStats& stats) const {
+    this->node_memory_stats(stats);
+    for (auto node : this->array) {
+        node->json_memory_stats(stats);
+    }
+    for (const auto& member : this->object) {
+        member.second->json_memory_stats(stats);
+    }
+}
+
+//This node alone, without its children.
+void JsonNode::node_memory_stats(JsonMemoryStats& stats) const {
+    stats.nodes[this->type]++;
+    stats.node_count++;
+    stats.node_bytes += sizeof(JsonNode) + JsonNode_header;
+    stats.total_bytes += sizeof(JsonNode) + JsonNode_header;
+    size_t string_bytes = stats.string_bytes;
+    size_t container_bytes = stats.container_bytes + stats.container_slack;
+    if (this->type == JSON_TYPE_ARRAY || this->type == JSON_TYPE_OBJECT) {
+        stats.cache_bytes += JsonNode_string_heap(this->string);
+        stats.total_bytes += JsonNode_string_heap(this->string);
+    } else {
+        JsonNode_string_stats(this->string, this->type == JSON_TYPE_STRING, stats);
+    }
+    stats.container_bytes += this->array.size() * sizeof(JsonNode*);
+    stats.container_slack += (this->array.capacity() - this->array.size()) * sizeof(JsonNode*);
+    if (this->packed != nullptr) {
+        stats.packed_numbers += this->packed->numbers.size();
+        stats.container_bytes += sizeof(*this->packed) + this->packed->numbers.size() * sizeof(double);
+        stats.container_slack += (this->packed->numbers.capacity() - this->packed->numbers.size()) * sizeof(double);
+    }
+    stats.container_bytes += this->object.size() * sizeof(this->object[0]);
+    stats.container_slack += (this->object.capacity() - this->object.size()) * sizeof(this->object[0]);
+    for (const auto& member : this->object) {
+        JsonNode_string_stats(member.first, true, stats);
+    }
+    stats.total_bytes += stats.string_bytes - string_bytes;
+    stats.total_bytes += stats.container_bytes + stats.container_slack - container_bytes;
+}
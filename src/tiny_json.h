@@ -1,6 +1,12 @@
 #pragma once
 
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 //Json tpye：null,true,false,number,string,array,object
@@ -29,21 +35,256 @@ enum {
     JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     JSON_PARSE_MISS_COLON,
     JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
-    JSON_PARSE_NOT_EXIST_KEY
+    JSON_PARSE_NOT_EXIST_KEY,
+    JSON_PARSE_UNEXPECTED_TYPE,
+    JSON_PARSE_SCHEMA_MISMATCH,
+    JSON_PARSE_OUT_OF_MEMORY,
+    JSON_PARSE_INPUT_TOO_LARGE,
+    JSON_PARSE_TOO_DEEP,
+    JSON_PARSE_TOO_MANY_MEMBERS,
+    JSON_PARSE_STRING_TOO_LONG,
+    JSON_PARSE_TOO_MANY_NODES
+};
+
+class JsonAllocator;
+class JsonSink;
+
+//Serializer settings; the defaults give the compact output of json_stringify().
+//indent > 0 puts each member and element on its own line, indented by that
+//many spaces per level. ascii_only writes non-ASCII characters as \uXXXX.
+struct JsonStringifyOptions {
+    int indent = 0;
+    bool sort_keys = false;
+    bool ascii_only = false;
+    bool escape_slash = false;
+};
+
+//Where and why a parse stopped. offset is always set: the error position,
+//or the end of the input on success. The rest is filled in only on error.
+struct JsonParseResult {
+    int code = JSON_PARSE_OK;
+    size_t offset = 0;
+    int line = 0;//1-based
+    int column = 0;//1-based, in bytes
+    std::string context;//up to 20 bytes either side of offset on its line
+    size_t context_offset = 0;//position of offset within context
+};
+
+//Parse settings; the defaults give the behaviour of json_parse(json). The
+//limits bound what untrusted input can make the parser allocate, and each
+//has its own error code.
+struct JsonParseOptions {
+    JsonAllocator* allocator = nullptr;//where parsed nodes come from; nullptr is operator new
+    size_t max_input_bytes = SIZE_MAX;
+    int max_depth = INT_MAX;//nested arrays and objects
+    int max_members = INT_MAX;//elements of one array or members of one object
+    size_t max_string_length = SIZE_MAX;//decoded bytes of one string value or key
+    size_t max_nodes = SIZE_MAX;//values created, not counting the root
+    bool pack_numbers = false;//store arrays of numbers only as packed arrays
+    bool reserve_exact = false;//count every array's and object's members in one pass first and reserve that
+    bool shrink_to_fit = false;//give back unused string and container capacity as each value is finished
+    bool raw_numbers = false;//keep each number's text, converted only when read and written back as is
+};
+
+//Footprint of a tree as reported by json_memory_stats. The byte counts are
+//heap bytes, so a short string kept inside its node adds nothing to them.
+//A subtree shared by JsonDedup is counted everywhere it appears.
+struct JsonMemoryStats {
+    size_t nodes[JSON_TYPE_OBJECT + 1] = {};//indexed by JsonType
+    size_t node_count = 0;
+    size_t node_bytes = 0;
+    size_t string_length = 0;//characters in string values and object keys
+    size_t string_bytes = 0;
+    size_t string_slack = 0;//allocated but unused string capacity
+    size_t container_bytes = 0;//array and object storage in use
+    size_t container_slack = 0;//allocated but unused array and object storage
+    size_t packed_numbers = 0;//elements of packed arrays, which have no nodes
+    size_t cache_bytes = 0;//serialized text kept by json_stringify_cached
+    size_t total_bytes = 0;
 };
 
 struct JsonContext {
     const char* json;
 };
 
+//Storage of a packed array, with the allocator its element nodes come from
+//once it is unpacked.
+struct JsonPackedArray {
+    std::vector<double> numbers;
+    JsonAllocator* allocator = nullptr;
+};
+
+class JsonNode;
+
+//One object member as seen through a member iterator: the key and the value
+//themselves, not copies.
+template <typename Node>
+struct JsonMember {
+    const std::string& key;
+    Node& value;
+};
+
+template <typename Node>
+inline Node& JsonIterator_get(JsonNode* const* slot) {
+    return **slot;
+}
+
+template <typename Node>
+inline JsonMember<Node> JsonIterator_get(const std::pair<std::string, JsonNode*>* slot) {
+    return {slot->first, *slot->second};
+}
+
+//What operator-> of a member iterator returns, so that iter->key works.
+template <typename Node>
+struct JsonMemberArrow {
+    JsonMember<Node> member;
+    const JsonMember<Node>* operator->() const {
+        return &this->member;
+    }
+};
+
+template <typename Node>
+inline Node* JsonIterator_arrow(Node& node) {
+    return &node;
+}
+
+template <typename Node>
+inline JsonMemberArrow<Node> JsonIterator_arrow(JsonMember<Node> member) {
+    return {member};
+}
+
+//Random-access iterator over the slots of an array or object. Elements come
+//out as Node&, members as a JsonMember<Node>, so a full walk is linear and
+//copies nothing. Adding or removing elements or members invalidates the
+//container's iterators.
+template <typename Node, typename Slot>
+class JsonIterator {
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using reference = decltype(JsonIterator_get<Node>(std::declval<Slot*>()));
+    using value_type = typename std::remove_cv<typename std::remove_reference<reference>::type>::type;
+    using pointer = decltype(JsonIterator_arrow(std::declval<reference>()));
+
+    JsonIterator() = default;
+    explicit JsonIterator(Slot* slot) : slot(slot) {}
+    //A mutable iterator converts to the matching const one.
+    template <typename Other, typename = typename std::enable_if<!std::is_same<Other, Node>::value &&
+                                                                 std::is_convertible<Other*, Node*>::value>::type>
+    JsonIterator(const JsonIterator<Other, Slot>& iter) : slot(iter.get_slot()) {}
+
+    reference operator*() const {
+        return JsonIterator_get<Node>(this->slot);
+    }
+    pointer operator->() const {
+        return JsonIterator_arrow(**this);
+    }
+    reference operator[](difference_type n) const {
+        return JsonIterator_get<Node>(this->slot + n);
+    }
+    JsonIterator& operator++() {
+        ++this->slot;
+        return *this;
+    }
+    JsonIterator operator++(int) {
+        return JsonIterator(this->slot++);
+    }
+    JsonIterator& operator--() {
+        --this->slot;
+        return *this;
+    }
+    JsonIterator operator--(int) {
+        return JsonIterator(this->slot--);
+    }
+    JsonIterator& operator+=(difference_type n) {
+        this->slot += n;
+        return *this;
+    }
+    JsonIterator& operator-=(difference_type n) {
+        this->slot -= n;
+        return *this;
+    }
+    JsonIterator operator+(difference_type n) const {
+        return JsonIterator(this->slot + n);
+    }
+    friend JsonIterator operator+(difference_type n, const JsonIterator& iter) {
+        return iter + n;
+    }
+    JsonIterator operator-(difference_type n) const {
+        return JsonIterator(this->slot - n);
+    }
+    difference_type operator-(const JsonIterator& rhs) const {
+        return this->slot - rhs.slot;
+    }
+    bool operator==(const JsonIterator& rhs) const {
+        return this->slot == rhs.slot;
+    }
+    bool operator!=(const JsonIterator& rhs) const {
+        return this->slot != rhs.slot;
+    }
+    bool operator<(const JsonIterator& rhs) const {
+        return this->slot < rhs.slot;
+    }
+    bool operator>(const JsonIterator& rhs) const {
+        return this->slot > rhs.slot;
+    }
+    bool operator<=(const JsonIterator& rhs) const {
+        return this->slot <= rhs.slot;
+    }
+    bool operator>=(const JsonIterator& rhs) const {
+        return this->slot >= rhs.slot;
+    }
+    Slot* get_slot() const {
+        return this->slot;
+    }
+
+private:
+    Slot* slot = nullptr;
+};
+
+using JsonElementIterator = JsonIterator<JsonNode, JsonNode* const>;
+using JsonConstElementIterator = JsonIterator<const JsonNode, JsonNode* const>;
+using JsonMemberIterator = JsonIterator<JsonNode, const std::pair<std::string, JsonNode*>>;
+using JsonConstMemberIterator = JsonIterator<const JsonNode, const std::pair<std::string, JsonNode*>>;
+
+//begin and end of a container, for range-for and the standard algorithms.
+template <typename Iterator>
+class JsonRange {
+public:
+    JsonRange(Iterator first, Iterator last) : first(first), last(last) {}
+    Iterator begin() const {
+        return this->first;
+    }
+    Iterator end() const {
+        return this->last;
+    }
+    size_t size() const {
+        return this->last - this->first;
+    }
+    bool empty() const {
+        return this->first == this->last;
+    }
+
+private:
+    Iterator first;
+    Iterator last;
+};
+
 class JsonNode {
 public:
     JsonNode() = default;
     JsonNode(const JsonNode& node);
     JsonNode& operator=(const JsonNode& node);
     ~JsonNode();
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, JsonAllocator* allocator) noexcept;
+    static void operator delete(void* ptr, size_t size);
+    static void operator delete(void* ptr, JsonAllocator* allocator) noexcept;
 
     int json_parse(const char* json);
+    int json_parse(const char* json, JsonParseResult& result);
+    int json_parse(const char* json, const JsonParseOptions& options);
+    int json_parse(const char* json, const JsonParseOptions& options, JsonParseResult& result);
     JsonType get_type() const;
 
     void json_free();
@@ -55,6 +296,9 @@ public:
 
     double get_number() const;
     void set_number(double num);
+    bool get_integer(long long& value) const;
+    bool is_raw_number() const;
+    std::string get_number_text() const;
 
     void set_string(const std::string& str);
     std::string get_string() const;
@@ -63,12 +307,23 @@ public:
     void set_array();
     void set_array(const std::vector<JsonNode*>& arr);
     int get_array_size() const;
+    JsonNode* get_array_index(int index);
     JsonNode* get_array_index(int index) const;
     void erase_array_element(int index, int count);
     void clear_array();
     void pushback_array_element(JsonNode* node);
     void popback_array_element();
     void insert_array_element(JsonNode* node, int index);
+    void reserve_array(int capacity);
+    JsonNode* detach_array_element(int index);
+    JsonNode* replace_array_element(int index, JsonNode* node);
+    void set_packed_array(std::vector<double> numbers);
+    bool is_packed_array() const;
+    const double* get_packed_array() const;
+    double get_array_number(int index) const;
+    void pushback_array_number(double num);
+    JsonRange<JsonElementIterator> elements();
+    JsonRange<JsonConstElementIterator> elements() const;
 
     void set_object();
     void set_object(const std::vector<std::pair<std::string, JsonNode*>>& obj);
@@ -78,22 +333,82 @@ public:
     JsonNode* get_object_value(int index) const;
     void set_object_value(const std::string& key, JsonNode* node);
     int find_object_index(const std::string& str) const;
+    int find_object_index(const std::string& str, int hint) const;
     JsonNode* find_object_value(const std::string& str);
+    JsonNode* find_object_value(const std::string& str, int& hint);
     void clear_object();
     void remove_object_value(int index);
     void pushback_object_element(const std::string& key, JsonNode* node);
+    void insert_object_element(int index, const std::string& key, JsonNode* node);
+    void reserve_object(int capacity);
+    JsonNode* detach_object_value(int index);
+    JsonNode* replace_object_value(int index, JsonNode* node);
+    JsonRange<JsonMemberIterator> members();
+    JsonRange<JsonConstMemberIterator> members() const;
+
+    JsonNode* json_pointer_get(const std::string& pointer);
 
     std::string json_stringify() const;
+    int json_stringify(JsonSink& sink, size_t buffer_size = 16384) const;
+    std::string json_stringify(const JsonStringifyOptions& options) const;
+    int json_stringify(JsonSink& sink, const JsonStringifyOptions& options, size_t buffer_size = 16384) const;
+    std::string json_stringify_cached();
+    void clear_stringify_cache();
 
     int json_is_equal(JsonNode* rhs) const;
     void json_copy(const JsonNode* src);
     void json_move(JsonNode* src);
     void json_swap(JsonNode* rhs);
+    void json_memory_stats(JsonMemoryStats& stats) const;
 
 private:
-    JsonType type;
-    double number;
+    friend class Parser;
+    friend class JsonDocument;
+    friend class JsonDedup;
+    template <typename Out>
+    friend void JsonStringify_value(const JsonNode* node, Out& out);
+    template <typename Out>
+    friend void JsonStringify_value(const JsonNode* node, const JsonStringifyOptions& options,
+                                    std::vector<const std::pair<std::string, JsonNode*>*>& keys, int depth, Out& out);
+
+    void unpack_array();
+    void node_memory_stats(JsonMemoryStats& stats) const;
+    void free_children();
+    void invalidate();
+    void adopt(JsonNode* node) const;
+    void leave_parent();
+    uint32_t cache_offset() const;
+    uint32_t cache_length() const;
+    void set_cache_offset(uint32_t offset);
+    void set_cache_length(uint32_t length);
+    bool owns_text() const;
+    void drop_cache();
+    bool cache_valid() const;
+    const char* cache_start() const;
+    void forget_cache();
+    void stringify_cached(std::string& out, const char* old);
+    static void release(JsonNode* node);
+    static JsonNode* unshare(JsonNode* node);
+
+    JsonType type = JSON_TYPE_NULL;
+    uint32_t shares = 0;//owners beyond the first, for subtrees shared by JsonDedup
+    //A raw number keeps its token in string, which get_number converts,
+    //and 0 here.
+    double number = 0;
+    //An array or object keeps here where json_stringify_cached last wrote
+    //it: an offset into its parent's text and a length that is 0 for none
+    //and has a flag bit set once an edit makes it stale, 4 bytes each, so
+    //it fits in the string without a heap block. Only the node it was
+    //called on keeps the text itself, after them, so every byte is stored
+    //once. Empty for a container that was never written.
     std::string string;
+    //A packed array keeps its numbers here and has no element nodes until
+    //something asks for one.
+    JsonPackedArray* packed = nullptr;
     std::vector<JsonNode*> array;
     std::vector<std::pair<std::string, JsonNode*>> object;
+    //The array or object holding this node, so an edit can drop the cached
+    //text of everything above it. nullptr for a root, a detached node, or a
+    //node deduplicated by JsonDedup, which may have more than one.
+    JsonNode* parent = nullptr;
 };
@@ -0,0 +1,708 @@
+#include "json_alloc.h"
+#include "json_batch.h"
+#include "json_binary.h"
+#include "json_schema.h"
+#include "json_shape.h"
+#include "json_bind.h"
+#include "json_columnar.h"
+#include "json_dedup.h"
+#include "json_document.h"
+#include "json_sink.h"
+#include "json_tape.h"
+#include "json_writer.h"
+#include "tiny_json.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+//Benchmarks run with the unit tests and print their numbers; select them with --gtest_filter=BenchJson.*
+
+//An array of records shaped like a typical API response.
+static std::string BenchJson_document(int records) {
+    std::string json = "[";
+    char buf[256];
+    for (int i = 0; i < records; i++) {
+        snprintf(buf, sizeof(buf),
+                 "%s{\"id\":%d,\"name\":\"item-%d\",\"price\":%d.%02d,\"active\":%s,\"tags\":[\"a\",\"b\",\"c\"],"
+                 "\"dims\":{\"w\":%d,\"h\":%d,\"unit\":\"cm\"},\"note\":null}",
+                 i == 0 ? "" : ",", i, i, i % 1000, i % 100, i % 2 ? "true" : "false", i % 50, i % 70);
+        json += buf;
+    }
+    json += "]";
+    return json;
+}
+
+//Runs f rounds times and returns the mean seconds per round.
+template <typename F>
+static double BenchJson_time(int rounds, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        f();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds;
+}
+
+static void BenchJson_report(const char* name, size_t bytes, double seconds) {
+    printf("[ BENCH    ] %-28s %10zu bytes %10.1f MB/s\n", name, bytes, bytes / seconds / 1e6);
+}
+
+TEST(BenchJson, bench_binary) {
+    std::string json = BenchJson_document(5000);
+    std::string cbor, msgpack;
+    JsonNode n;
+    n.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str()));
+    const int rounds = 5;
+
+    BenchJson_report("text parse", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_init();
+                         t.json_parse(json.c_str());
+                     }));
+    BenchJson_report("text stringify", json.size(), BenchJson_time(rounds, [&]() { n.json_stringify(); }));
+    BenchJson_report("cbor encode", json.size(), BenchJson_time(rounds, [&]() {
+                         cbor.clear();
+                         json_to_cbor(&n, cbor);
+                     }));
+    BenchJson_report("cbor decode", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         json_from_cbor(cbor.data(), cbor.size(), &t);
+                     }));
+    BenchJson_report("msgpack encode", json.size(), BenchJson_time(rounds, [&]() {
+                         msgpack.clear();
+                         json_to_msgpack(&n, msgpack);
+                     }));
+    BenchJson_report("msgpack decode", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         json_from_msgpack(msgpack.data(), msgpack.size(), &t);
+                     }));
+    printf("[ BENCH    ] sizes: text %zu, cbor %zu, msgpack %zu\n", json.size(), cbor.size(), msgpack.size());
+    n.json_free();
+}
+
+TEST(BenchJson, bench_tape) {
+    std::string json = BenchJson_document(20000);
+    char path[] = "/tmp/tiny_json_bench_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    JsonTape tape;
+    ASSERT_EQ(JSON_PARSE_OK, tape.parse(json.c_str()));
+    ASSERT_EQ(JSON_TAPE_OK, tape.save(path));
+    const int rounds = 5;
+
+    BenchJson_report("text parse", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_init();
+                         t.json_parse(json.c_str());
+                     }));
+    BenchJson_report("tape load (mmap)", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonTape t;
+                         t.load(path);
+                     }));
+    double sum = 0;
+    BenchJson_report("tape load + scan prices", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonTape t;
+                         t.load(path);
+                         JsonTapeView root = t.root();
+                         int size = root.get_array_size();
+                         JsonTapeView v = root.get_array_index(0);
+                         for (int i = 0; i < size; i++, v = v.next()) {
+                             sum += v.find_object_value("price").get_number();
+                         }
+                     }));
+    EXPECT_GT(sum, 0);
+    unlink(path);
+}
+
+TEST(BenchJson, bench_stringify_sink) {
+    std::string json = BenchJson_document(20000);
+    JsonNode n;
+    n.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str()));
+    const int rounds = 5;
+    int fd = open("/dev/null", O_WRONLY);
+    ASSERT_GE(fd, 0);
+
+    BenchJson_report("stringify to string", json.size(), BenchJson_time(rounds, [&]() {
+                         std::string s = n.json_stringify();
+                         write(fd, s.data(), s.size());
+                     }));
+    JsonFdSink sink(fd);
+    BenchJson_report("stringify to fd (16 KB)", json.size(), BenchJson_time(rounds, [&]() { n.json_stringify(sink); }));
+    BenchJson_report("stringify to fd (256 KB)", json.size(), BenchJson_time(rounds, [&]() { n.json_stringify(sink, 1 << 18); }));
+    close(fd);
+    n.json_free();
+}
+
+//Builds the BenchJson_document records once as a tree, once with the writer.
+TEST(BenchJson, bench_writer) {
+    const int records = 20000;
+    const int rounds = 5;
+    size_t bytes = 0;
+    static const char* const tags[] = {"a", "b", "c"};
+
+    double tree = BenchJson_time(rounds, [&]() {
+        JsonNode root;
+        root.json_init();
+        root.set_array();
+        char name[32];
+        for (int i = 0; i < records; i++) {
+            JsonNode* record = new JsonNode();
+            record->json_init();
+            record->set_object();
+            JsonNode* n = new JsonNode();
+            n->json_init();
+            n->set_number(i);
+            record->pushback_object_element("id", n);
+            snprintf(name, sizeof(name), "item-%d", i);
+            n = new JsonNode();
+            n->json_init();
+            n->set_string(name);
+            record->pushback_object_element("name", n);
+            n = new JsonNode();
+            n->json_init();
+            n->set_number(i % 1000 + i % 100 / 100.0);
+            record->pushback_object_element("price", n);
+            n = new JsonNode();
+            n->json_init();
+            n->set_bool(i % 2);
+            record->pushback_object_element("active", n);
+            JsonNode* list = new JsonNode();
+            list->json_init();
+            list->set_array();
+            for (const char* tag : tags) {
+                n = new JsonNode();
+                n->json_init();
+                n->set_string(tag);
+                list->pushback_array_element(n);
+            }
+            record->pushback_object_element("tags", list);
+            root.pushback_array_element(record);
+        }
+        bytes = root.json_stringify().size();
+    });
+    BenchJson_report("tree + stringify", bytes, tree);
+
+    JsonWriter w;
+    double writer = BenchJson_time(rounds, [&]() {
+        w.clear();
+        auto root = w.array();
+        char name[32];
+        for (int i = 0; i < records; i++) {
+            auto record = root.object();
+            record.member("id", i);
+            snprintf(name, sizeof(name), "item-%d", i);
+            record.member("name", name);
+            record.member("price", i % 1000 + i % 100 / 100.0);
+            record.member("active", i % 2 == 1);
+            auto list = record.array("tags");
+            for (const char* tag : tags) {
+                list.element(tag);
+            }
+        }
+    });
+    EXPECT_EQ(bytes, w.get_string().size());
+    BenchJson_report("writer", bytes, writer);
+}
+
+TEST(BenchJson, bench_stringify_options) {
+    std::string json = BenchJson_document(20000);
+    JsonNode n;
+    n.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str()));
+    const int rounds = 5;
+    JsonStringifyOptions options;
+    size_t bytes = n.json_stringify().size();
+    BenchJson_report("compact", bytes, BenchJson_time(rounds, [&]() { n.json_stringify(options); }));
+    options.indent = 2;
+    bytes = n.json_stringify(options).size();
+    BenchJson_report("pretty (indent 2)", bytes, BenchJson_time(rounds, [&]() { n.json_stringify(options); }));
+    options.sort_keys = true;
+    BenchJson_report("pretty + sort_keys", bytes, BenchJson_time(rounds, [&]() { n.json_stringify(options); }));
+    options.ascii_only = true;
+    options.escape_slash = true;
+    bytes = n.json_stringify(options).size();
+    BenchJson_report("pretty + all escapes", bytes, BenchJson_time(rounds, [&]() { n.json_stringify(options); }));
+    n.json_free();
+}
+
+struct BenchJsonDims {
+    int w = 0;
+    int h = 0;
+    std::string unit;
+};
+TINY_JSON_BIND(BenchJsonDims, w, h, unit)
+
+struct BenchJsonRecord {
+    int id = 0;
+    std::string name;
+    double price = 0;
+    bool active = false;
+    std::vector<std::string> tags;
+    BenchJsonDims dims;
+};
+TINY_JSON_BIND(BenchJsonRecord, id, name, price, active, tags, dims)
+
+TEST(BenchJson, bench_bind) {
+    std::string json = BenchJson_document(20000);
+    const int rounds = 5;
+    std::vector<BenchJsonRecord> records;
+
+    BenchJson_report("parse + walk", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode root;
+                         root.json_init();
+                         root.json_parse(json.c_str());
+                         records.clear();
+                         for (int i = 0; i < root.get_array_size(); i++) {
+                             JsonNode* n = root.get_array_index(i);
+                             int hint = 0;
+                             BenchJsonRecord r;
+                             r.id = (int) n->find_object_value("id", hint)->get_number();
+                             r.name = n->find_object_value("name", hint)->get_string();
+                             r.price = n->find_object_value("price", hint)->get_number();
+                             r.active = n->find_object_value("active", hint)->get_bool();
+                             JsonNode* tags = n->find_object_value("tags", hint);
+                             for (int j = 0; j < tags->get_array_size(); j++) {
+                                 r.tags.push_back(tags->get_array_index(j)->get_string());
+                             }
+                             JsonNode* dims = n->find_object_value("dims", hint);
+                             int dims_hint = 0;
+                             r.dims.w = (int) dims->find_object_value("w", dims_hint)->get_number();
+                             r.dims.h = (int) dims->find_object_value("h", dims_hint)->get_number();
+                             r.dims.unit = dims->find_object_value("unit", dims_hint)->get_string();
+                             records.push_back(std::move(r));
+                         }
+                         root.json_free();
+                     }));
+    EXPECT_EQ(20000, records.size());
+    BenchJson_report("json_bind_parse", json.size(), BenchJson_time(rounds, [&]() {
+                         records.clear();
+                         json_bind_parse(json.c_str(), records);
+                     }));
+    EXPECT_EQ(20000, records.size());
+    EXPECT_EQ("item-19999", records.back().name);
+    std::string out;
+    BenchJson_report("json_bind_stringify", json.size(), BenchJson_time(rounds, [&]() { out = json_bind_stringify(records); }));
+}
+
+TEST(BenchJson, bench_shape) {
+    std::string json = BenchJson_document(20000);
+    const int rounds = 5;
+    JsonNode schema;
+    schema.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"type\":\"array\",\"items\":{\"type\":\"object\",\"properties\":{"
+                                               "\"id\":{},\"name\":{},\"price\":{},\"active\":{},\"tags\":{},"
+                                               "\"dims\":{\"properties\":{\"w\":{},\"h\":{},\"unit\":{}}},\"note\":{}}}}"));
+    JsonShape shape;
+    ASSERT_EQ(JSON_SHAPE_OK, shape.compile(&schema));
+    schema.json_free();
+    //The same records with every object's keys in reverse order.
+    JsonShape reversed;
+    int item = reversed.set_element(0);
+    for (const char* key : {"note", "dims", "tags", "active", "price", "name", "id"}) {
+        reversed.add_member(item, key);
+    }
+
+    BenchJson_report("parse_object (generic)", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_init();
+                         t.json_parse(json.c_str());
+                         t.json_free();
+                     }));
+    BenchJson_report("shaped parse", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         shape.parse(json.c_str(), &t);
+                         t.json_free();
+                     }));
+    BenchJson_report("shaped parse, all misses", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         reversed.parse(json.c_str(), &t);
+                         t.json_free();
+                     }));
+}
+
+TEST(BenchJson, bench_schema) {
+    std::string json = BenchJson_document(20000);
+    //The same document with the first record's id turned into a string.
+    std::string invalid = json;
+    invalid.replace(invalid.find("\"id\":0"), 6, "\"id\":\"0\"");
+    const int rounds = 5;
+    JsonNode schema;
+    schema.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"type\":\"array\",\"items\":{\"type\":\"object\",\"required\":[\"id\",\"name\"],"
+                                               "\"properties\":{\"id\":{\"type\":\"integer\",\"minimum\":0},"
+                                               "\"name\":{\"type\":\"string\",\"maxLength\":32},\"price\":{\"type\":\"number\"},"
+                                               "\"tags\":{\"type\":\"array\",\"items\":{\"enum\":[\"a\",\"b\",\"c\"]}}}}}"));
+    JsonSchema validator;
+    ASSERT_EQ(JSON_SCHEMA_OK, validator.compile(&schema));
+    schema.json_free();
+
+    for (const std::string* doc : {&json, &invalid}) {
+        const char* label = doc == &json ? "valid" : "bad head";
+        char name[64];
+        snprintf(name, sizeof(name), "parse+validate, %s", label);
+        BenchJson_report(name, doc->size(), BenchJson_time(rounds, [&]() {
+                             JsonNode t;
+                             t.json_init();
+                             t.json_parse(doc->c_str());
+                             validator.validate(&t);
+                             t.json_free();
+                         }));
+        snprintf(name, sizeof(name), "streaming, %s", label);
+        BenchJson_report(name, doc->size(), BenchJson_time(rounds, [&]() {
+                             JsonNode t;
+                             validator.parse(doc->c_str(), &t);
+                             t.json_free();
+                         }));
+    }
+}
+
+TEST(BenchJson, bench_memory) {
+    std::string json = BenchJson_document(20000);
+    const int rounds = 5;
+    JsonCountingAllocator allocator;
+    JsonParseOptions options;
+    options.allocator = &allocator;
+
+    BenchJson_report("parse", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_parse(json.c_str());
+                     }));
+    BenchJson_report("parse, counting allocator", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_parse(json.c_str(), options);
+                     }));
+
+    JsonCountingAllocator once;
+    options.allocator = &once;
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str(), options));
+    JsonMemoryStats stats;
+    n.json_memory_stats(stats);
+    printf("[ BENCH    ] %zu nodes, peak node bytes %zu in %zu calls, tree %zu bytes (%zu strings, %zu slack)\n",
+           stats.node_count, once.get_peak_bytes(), once.get_allocations(), stats.total_bytes,
+           stats.string_bytes, stats.string_slack + stats.container_slack);
+}
+
+TEST(BenchJson, bench_parse_limits) {
+    std::string json = BenchJson_document(20000);
+    const int rounds = 5;
+    JsonParseOptions limits;
+    limits.max_input_bytes = 64 << 20;
+    limits.max_depth = 64;
+    limits.max_members = 1 << 20;
+    limits.max_string_length = 1 << 16;
+    limits.max_nodes = 1 << 22;
+
+    BenchJson_report("parse, no limits", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_parse(json.c_str());
+                     }));
+    BenchJson_report("parse, all limits", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_parse(json.c_str(), limits);
+                     }));
+}
+
+TEST(BenchJson, bench_packed) {
+    //A time series: one long array of readings.
+    std::string json = "[";
+    char buf[32];
+    for (int i = 0; i < 500000; i++) {
+        snprintf(buf, sizeof(buf), "%s%d.%02d", i == 0 ? "" : ",", i % 9973, i % 100);
+        json += buf;
+    }
+    json += "]";
+    const int rounds = 5;
+    JsonParseOptions options;
+    options.pack_numbers = true;
+
+    BenchJson_report("parse, nodes", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_parse(json.c_str());
+                     }));
+    BenchJson_report("parse, packed", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonNode t;
+                         t.json_parse(json.c_str(), options);
+                     }));
+    JsonNode nodes, packed;
+    ASSERT_EQ(JSON_PARSE_OK, nodes.json_parse(json.c_str()));
+    ASSERT_EQ(JSON_PARSE_OK, packed.json_parse(json.c_str(), options));
+    BenchJson_report("stringify, nodes", json.size(), BenchJson_time(rounds, [&]() { nodes.json_stringify(); }));
+    BenchJson_report("stringify, packed", json.size(), BenchJson_time(rounds, [&]() { packed.json_stringify(); }));
+    double sum = 0;
+    BenchJson_report("sum, get_array_number", json.size(), BenchJson_time(rounds, [&]() {
+                         for (int i = 0; i < nodes.get_array_size(); i++) {
+                             sum += nodes.get_array_number(i);
+                         }
+                     }));
+    BenchJson_report("sum, packed span", json.size(), BenchJson_time(rounds, [&]() {
+                         const double* numbers = packed.get_packed_array();
+                         for (int i = 0; i < packed.get_array_size(); i++) {
+                             sum += numbers[i];
+                         }
+                     }));
+    JsonMemoryStats a, b;
+    nodes.json_memory_stats(a);
+    packed.json_memory_stats(b);
+    printf("[ BENCH    ] tree bytes: nodes %zu, packed %zu (sum %g)\n", a.total_bytes, b.total_bytes, sum);
+}
+
+TEST(BenchJson, bench_columnar) {
+    std::string json = BenchJson_document(100000);
+    const int rounds = 5;
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str()));
+
+    BenchJson_report("columnar convert", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonColumnar c;
+                         c.convert(&n);
+                     }));
+    BenchJson_report("columnar parse", json.size(), BenchJson_time(rounds, [&]() {
+                         JsonColumnar c;
+                         c.parse(json.c_str());
+                     }));
+    JsonColumnar c;
+    ASSERT_EQ(JSON_PARSE_OK, c.parse(json.c_str()));
+    //sum(price) where active and dims.w > 25, over the tree and over columns.
+    double tree = 0, columns = 0;
+    BenchJson_report("filtered sum, tree", json.size(), BenchJson_time(rounds, [&]() {
+                         tree = 0;
+                         for (int i = 0; i < n.get_array_size(); i++) {
+                             JsonNode* record = n.get_array_index(i);
+                             if (record->find_object_value("active")->get_type() == JSON_TYPE_TRUE &&
+                                 record->find_object_value("dims")->find_object_value("w")->get_number() > 25) {
+                                 tree += record->find_object_value("price")->get_number();
+                             }
+                         }
+                     }));
+    BenchJson_report("filtered sum, columnar", json.size(), BenchJson_time(rounds, [&]() {
+                         std::vector<uint64_t> selection;
+                         c.filter("/dims/w", JSON_COMPARE_GT, 25, selection);
+                         const JsonColumn* active = c.find_column("/active");
+                         for (size_t w = 0; w < selection.size(); w++) {
+                             uint64_t bits = 0;
+                             for (size_t j = 0; j < 64 && w * 64 + j < active->size; j++) {
+                                 bits |= (uint64_t) active->booleans[w * 64 + j] << j;
+                             }
+                             selection[w] &= bits;
+                         }
+                         c.sum("/price", columns, &selection);
+                     }));
+    EXPECT_DOUBLE_EQ(tree, columns);
+}
+
+TEST(BenchJson, bench_document) {
+    //A stream of small messages of one shape.
+    std::vector<std::string> messages;
+    size_t bytes = 0;
+    char buf[256];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf),
+                 "{\"event\":\"page_view\",\"user_id\":%d,\"session\":\"s-%08d-%08d\",\"ts\":%d.%03d,"
+                 "\"referrer_url\":\"https://example.com/p/%d\",\"tags\":[\"x\",\"y\"],\"geo\":{\"lat\":%d.5,\"lon\":%d.25}}",
+                 i, i, i * 7, 1700000000 + i, i % 1000, i, i % 90, i % 180);
+        messages.push_back(buf);
+        bytes += messages.back().size();
+    }
+    const int rounds = 50;
+
+    BenchJson_report("new node per message", bytes, BenchJson_time(rounds, [&]() {
+                         for (const auto& message : messages) {
+                             JsonNode n;
+                             n.json_parse(message.c_str());
+                         }
+                     }));
+    JsonNode reused;
+    BenchJson_report("one node, reparsed", bytes, BenchJson_time(rounds, [&]() {
+                         for (const auto& message : messages) {
+                             reused.json_parse(message.c_str());
+                         }
+                     }));
+    JsonDocument document;
+    BenchJson_report("document", bytes, BenchJson_time(rounds, [&]() {
+                         for (const auto& message : messages) {
+                             document.parse(message.c_str());
+                         }
+                     }));
+    JsonCountingAllocator counting;
+    JsonParseOptions options;
+    options.allocator = &counting;
+    for (const auto& message : messages) {
+        document.parse(message.c_str(), options);
+    }
+    printf("[ BENCH    ] document node allocations over %zu messages: %zu\n", messages.size(),
+           counting.get_allocations());
+}
+
+TEST(BenchJson, bench_batch) {
+    //Message-queue sized documents, about 200 bytes each.
+    std::vector<std::string> messages;
+    size_t bytes = 0;
+    char buf[256];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(buf, sizeof(buf),
+                 "{\"topic\":\"orders\",\"partition\":%d,\"offset\":%d,\"key\":\"k-%06d\",\"payload\":{\"sku\":\"SKU-%05d\","
+                 "\"qty\":%d,\"price\":%d.%02d,\"flags\":[%s,%s]}}",
+                 i % 16, i, i, i % 50000, i % 9 + 1, i % 500, i % 100, i % 2 ? "true" : "false", i % 3 ? "true" : "false");
+        messages.push_back(buf);
+        bytes += messages.back().size();
+    }
+    std::vector<const char*> documents;
+    for (const auto& message : messages) {
+        documents.push_back(message.c_str());
+    }
+    const int rounds = 10;
+
+    BenchJson_report("one at a time", bytes, BenchJson_time(rounds, [&]() {
+                         for (const auto& message : messages) {
+                             JsonNode n;
+                             n.json_parse(message.c_str());
+                         }
+                     }));
+    //Powers of two up to the hardware threads, then all of them.
+    int hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> counts;
+    for (int threads = 1; threads < hardware; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(hardware);
+    for (int threads : counts) {
+        JsonBatch batch(threads);
+        char name[32];
+        snprintf(name, sizeof(name), "batch, %d threads", threads);
+        BenchJson_report(name, bytes, BenchJson_time(rounds, [&]() { batch.parse(documents.data(), documents.size()); }));
+    }
+}
+
+TEST(BenchJson, bench_reserve_exact) {
+    std::string numbers = "[";
+    for (int i = 0; i < 1000000; i++) {
+        numbers += (i ? "," : "") + std::to_string(i % 1000);
+    }
+    numbers += "]";
+    std::string records = BenchJson_document(50000);
+    const int rounds = 5;
+    JsonParseOptions reserve, shrink;
+    reserve.reserve_exact = true;
+    shrink.shrink_to_fit = true;
+    struct Case {
+        const char* name;
+        const std::string* json;
+        JsonParseOptions options;
+    } cases[] = {
+        {"numbers, growth", &numbers, JsonParseOptions()}, {"numbers, reserve_exact", &numbers, reserve},
+        {"numbers, shrink_to_fit", &numbers, shrink},      {"records, growth", &records, JsonParseOptions()},
+        {"records, reserve_exact", &records, reserve},     {"records, shrink_to_fit", &records, shrink},
+    };
+    for (const auto& c : cases) {
+        BenchJson_report(c.name, c.json->size(), BenchJson_time(rounds, [&]() {
+                             JsonNode t;
+                             t.json_parse(c.json->c_str(), c.options);
+                         }));
+        JsonNode t;
+        t.json_parse(c.json->c_str(), c.options);
+        JsonMemoryStats stats;
+        t.json_memory_stats(stats);
+        printf("[ BENCH    ] %-28s container slack %zu bytes, string slack %zu bytes\n", c.name, stats.container_slack,
+               stats.string_slack);
+    }
+}
+
+TEST(BenchJson, bench_iterator) {
+    //One wide object, the worst case for index-based member access.
+    std::string json = "{";
+    for (int i = 0; i < 200000; i++) {
+        json += (i ? ",\"member_key_" : "\"member_key_") + std::to_string(i) + "\":" + std::to_string(i);
+    }
+    json += "}";
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str()));
+    const int rounds = 10;
+    size_t length = 0;
+    double sum = 0;
+    BenchJson_report("get_object_key/value(i)", json.size(), BenchJson_time(rounds, [&]() {
+                         for (int i = 0; i < n.get_object_size(); i++) {
+                             length += n.get_object_key(i).size();
+                             sum += n.get_object_value(i)->get_number();
+                         }
+                     }));
+    BenchJson_report("members()", json.size(), BenchJson_time(rounds, [&]() {
+                         for (auto member : n.members()) {
+                             length += member.key.size();
+                             sum += member.value.get_number();
+                         }
+                     }));
+    printf("[ BENCH    ] (checksum %zu %g)\n", length, sum);
+}
+
+TEST(BenchJson, bench_dedup) {
+    std::string json = BenchJson_document(50000);
+    JsonNode a, b;
+    ASSERT_EQ(JSON_PARSE_OK, a.json_parse(json.c_str()));
+    ASSERT_EQ(JSON_PARSE_OK, b.json_parse(json.c_str()));
+    const int rounds = 5;
+    int equal = 0;
+    BenchJson_report("json_is_equal", json.size(), BenchJson_time(rounds, [&]() { equal += a.json_is_equal(&b); }));
+    JsonMemoryStats before;
+    a.json_memory_stats(before);
+
+    JsonDedup dedup;
+    JsonDedupStats stats;
+    auto start = std::chrono::steady_clock::now();
+    dedup.dedup(&a, stats);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    BenchJson_report("dedup", json.size(), elapsed.count());
+    dedup.dedup(&b);
+    BenchJson_report("json_is_equal (deduped)", json.size(),
+                     BenchJson_time(rounds, [&]() { equal += a.json_is_equal(&b); }));
+    printf("[ BENCH    ] %zu of %zu nodes shared, pool %zu nodes, tree %zu -> %zu bytes (%d)\n", stats.shared,
+           stats.nodes, dedup.get_size(), before.total_bytes, before.total_bytes - stats.bytes_saved, equal);
+}
+
+TEST(BenchJson, bench_stringify_cached) {
+    std::string json = BenchJson_document(50000);
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json.c_str()));
+    const int rounds = 20;
+    size_t length = 0;
+    int price = 0;
+    //One leaf changes between every two serializations.
+    BenchJson_report("edit + json_stringify", json.size(), BenchJson_time(rounds, [&]() {
+                         n.get_array_index(price % 50000)->find_object_value("price")->set_number(price);
+                         price++;
+                         length += n.json_stringify().size();
+                     }));
+    n.json_stringify_cached();
+    BenchJson_report("edit + json_stringify_cached", json.size(), BenchJson_time(rounds, [&]() {
+                         n.get_array_index(price % 50000)->find_object_value("price")->set_number(price);
+                         price++;
+                         length += n.json_stringify_cached().size();
+                     }));
+    JsonMemoryStats stats;
+    n.json_memory_stats(stats);
+    printf("[ BENCH    ] cache %zu bytes for %zu bytes of text (%zu)\n", stats.cache_bytes, json.size(), length);
+}
+
+TEST(BenchJson, bench_raw_numbers) {
+    std::string json = BenchJson_document(50000);
+    JsonParseOptions raw;
+    raw.raw_numbers = true;
+    JsonDocument document;
+    const int rounds = 5;
+    size_t length = 0;
+    //Parse and forward: nothing reads the numbers.
+    BenchJson_report("parse + stringify", json.size(), BenchJson_time(rounds, [&]() {
+                         document.parse(json.c_str());
+                         length += document.get_root().json_stringify().size();
+                     }));
+    BenchJson_report("parse + stringify, raw", json.size(), BenchJson_time(rounds, [&]() {
+                         document.parse(json.c_str(), raw);
+                         length += document.get_root().json_stringify().size();
+                     }));
+    printf("[ BENCH    ] raw output identical: %s (%zu)\n", document.get_root().json_stringify() == json ? "yes" : "no", length);
+}
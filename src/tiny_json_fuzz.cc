@@ -0,0 +1,73 @@
+#include "tiny_json.h"
+#include "json_dedup.h"
+#include "json_document.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+//libFuzzer entry point; build with -DTINY_JSON_FUZZ=ON (clang only). Every
+//input must parse or fail cleanly, and whatever parses must survive a
+//stringify round trip and a deep copy unchanged. Leaks and double frees are
+//reported by the sanitizers the target is built with.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    std::string json(reinterpret_cast<const char*>(data), size);
+    JsonNode node;
+    JsonParseResult result;
+    if (node.json_parse(json.c_str(), result) != JSON_PARSE_OK) {
+        if (result.offset > json.size()) {
+            abort();
+        }
+        return 0;
+    }
+    std::string text = node.json_stringify();
+    JsonNode again;
+    if (again.json_parse(text.c_str()) != JSON_PARSE_OK || again.json_stringify() != text) {
+        abort();
+    }
+    JsonNode copy(node);
+    if (copy.json_stringify() != text) {
+        abort();
+    }
+    //Kept across inputs, so each parse builds from the last input's nodes.
+    static JsonDocument document;
+    if (document.parse(json.c_str()) != JSON_PARSE_OK || document.get_root().json_stringify() != text) {
+        abort();
+    }
+    //Pre-sized and shrunk containers hold the same values.
+    JsonParseOptions sized;
+    sized.reserve_exact = true;
+    sized.shrink_to_fit = true;
+    if (again.json_parse(json.c_str(), sized) != JSON_PARSE_OK || again.json_stringify() != text) {
+        abort();
+    }
+    //Raw numbers convert to the same values, and their text reads back the same.
+    JsonParseOptions raw;
+    raw.raw_numbers = true;
+    if (again.json_parse(json.c_str(), raw) != JSON_PARSE_OK || !again.json_is_equal(&node) ||
+        copy.json_parse(again.json_stringify().c_str()) != JSON_PARSE_OK || copy.json_stringify() != text) {
+        abort();
+    }
+    copy.json_copy(&node);
+    //Cached text is the same text, built fresh or spliced from the cache.
+    if (node.json_stringify_cached() != text || node.json_stringify_cached() != text || node.json_stringify() != text) {
+        abort();
+    }
+    //Sharing equal subtrees changes neither the text nor equality.
+    JsonDedup dedup;
+    dedup.dedup(&node);
+    if (node.json_stringify() != text || !node.json_is_equal(&copy)) {
+        abort();
+    }
+    //Tight limits must only ever turn success into a limit error.
+    JsonParseOptions options;
+    options.max_depth = 3;
+    options.max_members = 4;
+    options.max_string_length = 8;
+    options.max_nodes = 16;
+    int ret = copy.json_parse(json.c_str(), options);
+    if (ret != JSON_PARSE_OK && ret < JSON_PARSE_TOO_DEEP) {
+        abort();
+    }
+    return 0;
+}
@@ -1,6 +1,26 @@
 #include "tiny_json.h"
-
+#include "json_alloc.h"
+#include "json_batch.h"
+#include "json_pointer.h"
+#include "json_binary.h"
+#include "json_bind.h"
+#include "json_columnar.h"
+#include "json_dedup.h"
+#include "json_diff.h"
+#include "json_document.h"
+#include "json_patch.h"
+#include "json_schema.h"
+#include "json_select.h"
+#include "json_shape.h"
+#include "json_sink.h"
+#include "json_tape.h"
+#include "json_writer.h"
+
+#include <algorithm>
 #include <gtest/gtest.h>
+#include <limits>
+#include <sstream>
+#include <unistd.h>
 
 TEST(TestJson, test_parse_null) {
     JsonNode v;
@@ -538,7 +558,8 @@ TEST(TestJson, test_access) {
     a->clear_array();
     EXPECT_EQ(0, a->get_array_size());
 
-    a->json_free();
+    delete a;
+    delete e;
 
     /* test_access_object */
     auto* o = new JsonNode();
@@ -586,6 +607,8 @@ TEST(TestJson, test_access) {
         EXPECT_DOUBLE_EQ((double) i + 1, o->get_object_value(o->find_object_index(key))->get_number());
     }
 
+    v = new JsonNode();
+    v->json_init();
     v->set_string("Hello");
     o->set_object_value("World", v);
 
@@ -596,7 +619,1808 @@ TEST(TestJson, test_access) {
     o->clear_object();
     EXPECT_EQ(0, o->get_object_size());
 
-    o->json_free();
+    delete o;
+}
+
+TEST(TestJson, test_pointer) {
+    JsonNode n;
+    n.json_init();
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(
+                                     "{\"foo\":[\"bar\",\"baz\"],\"\":0,\"a/b\":1,\"c%d\":2,"
+                                     "\"e^f\":3,\"g|h\":4,\"i\\\\j\":5,\"k\\\"l\":6,\" \":7,\"m~n\":8}"));
+    EXPECT_EQ(&n, n.json_pointer_get(""));
+    EXPECT_EQ(JSON_TYPE_ARRAY, n.json_pointer_get("/foo")->get_type());
+    EXPECT_EQ("bar", n.json_pointer_get("/foo/0")->get_string());
+    EXPECT_DOUBLE_EQ(0.0, n.json_pointer_get("/")->get_number());
+    EXPECT_DOUBLE_EQ(1.0, n.json_pointer_get("/a~1b")->get_number());
+    EXPECT_DOUBLE_EQ(2.0, n.json_pointer_get("/c%d")->get_number());
+    EXPECT_DOUBLE_EQ(3.0, n.json_pointer_get("/e^f")->get_number());
+    EXPECT_DOUBLE_EQ(4.0, n.json_pointer_get("/g|h")->get_number());
+    EXPECT_DOUBLE_EQ(5.0, n.json_pointer_get("/i\\j")->get_number());
+    EXPECT_DOUBLE_EQ(6.0, n.json_pointer_get("/k\"l")->get_number());
+    EXPECT_DOUBLE_EQ(7.0, n.json_pointer_get("/ ")->get_number());
+    EXPECT_DOUBLE_EQ(8.0, n.json_pointer_get("/m~0n")->get_number());
+    EXPECT_EQ(nullptr, n.json_pointer_get("foo"));
+    EXPECT_EQ(nullptr, n.json_pointer_get("/m~2n"));
+    EXPECT_EQ(nullptr, n.json_pointer_get("/foo/2"));
+    EXPECT_EQ(nullptr, n.json_pointer_get("/foo/-"));
+    EXPECT_EQ(nullptr, n.json_pointer_get("/foo/01"));
+    EXPECT_EQ(nullptr, n.json_pointer_get("/foo/0/x"));
+    n.json_free();
+
+    JsonPointer p;
+    JsonNode n1, n2;
+    n1.json_init();
+    n2.json_init();
+    EXPECT_EQ(JSON_POINTER_OK, p.compile("/a/x~1y/1"));
+    EXPECT_EQ(3, p.get_token_size());
+    EXPECT_EQ("x/y", p.get_token(1));
+    EXPECT_EQ(JSON_PARSE_OK, n1.json_parse("{\"b\":0,\"a\":{\"z\":1,\"x/y\":[1,2]}}"));
+    EXPECT_EQ(JSON_PARSE_OK, n2.json_parse("{\"b\":0,\"a\":{\"x/y\":[3,4]}}"));
+    EXPECT_DOUBLE_EQ(2.0, p.resolve(&n1)->get_number());
+    EXPECT_DOUBLE_EQ(4.0, p.resolve(&n2)->get_number());
+    EXPECT_DOUBLE_EQ(2.0, p.resolve(&n1)->get_number());
+    EXPECT_EQ(JSON_POINTER_INVALID_SYNTAX, p.compile("a"));
+    EXPECT_EQ(JSON_POINTER_INVALID_ESCAPE, p.compile("/a~"));
+
+    std::string s;
+    JsonPointer::append_token(s, "a/b~c");
+    EXPECT_EQ("/a~1b~0c", s);
+    n1.json_free();
+    n2.json_free();
+}
+
+TEST(TestJson, test_select) {
+    JsonSelector sel;
+    std::vector<JsonSelection> out;
+    EXPECT_EQ(JSON_POINTER_OK, sel.add_path("/user/id"));
+    EXPECT_EQ(JSON_POINTER_OK, sel.add_path("/items/*/price"));
+    EXPECT_EQ(JSON_POINTER_INVALID_SYNTAX, sel.add_path("items"));
+    EXPECT_EQ(2, sel.get_path_size());
+    EXPECT_EQ(JSON_PARSE_OK, sel.extract(
+                                     "{\"meta\":{\"skip\":[1,{\"a\":\"\\u00A2\"},null,true,false]},"
+                                     "\"user\":{\"name\":\"x\",\"id\":42},"
+                                     "\"items\":[{\"price\":1.5,\"qty\":2},{\"qty\":1},{\"price\":[3]}]}",
+                                     out));
+    EXPECT_EQ(3, out.size());
+    EXPECT_EQ(0, out[0].path);
+    EXPECT_EQ("/user/id", out[0].pointer);
+    EXPECT_DOUBLE_EQ(42.0, out[0].value->get_number());
+    EXPECT_EQ(1, out[1].path);
+    EXPECT_EQ("/items/0/price", out[1].pointer);
+    EXPECT_DOUBLE_EQ(1.5, out[1].value->get_number());
+    EXPECT_EQ("/items/2/price", out[2].pointer);
+    EXPECT_EQ("[3]", out[2].value->json_stringify());
+    for (auto& s : out) {
+        delete s.value;
+    }
+    out.clear();
+
+    /* errors in skipped parts are still reported */
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, sel.extract("{\"user\":{\"id\":1},\"x\":[1 2]}", out));
+    EXPECT_EQ(JSON_PARSE_INVALID_STRING_ESCAPEVALUE, sel.extract("{\"x\":\"\\v\"}", out));
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, sel.extract("{} x", out));
+    EXPECT_EQ(0, out.size());
+
+    /* nested matches */
+    JsonSelector nested;
+    nested.add_path("/a");
+    nested.add_path("/a/b");
+    EXPECT_EQ(JSON_PARSE_OK, nested.extract("{\"a\":{\"b\":[true]}}", out));
+    EXPECT_EQ(2, out.size());
+    EXPECT_EQ("{\"b\":[true]}", out[0].value->json_stringify());
+    EXPECT_EQ("/a/b", out[1].pointer);
+    EXPECT_EQ("[true]", out[1].value->json_stringify());
+    for (auto& s : out) {
+        delete s.value;
+    }
+}
+
+#define TEST_PATCH(json, patch, error, expect)                \
+    do {                                                     \
+        JsonNode n, p, e;                                    \
+        JsonPatch jp;                                        \
+        n.json_init();                                       \
+        p.json_init();                                       \
+        e.json_init();                                       \
+        EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json));        \
+        EXPECT_EQ(JSON_PARSE_OK, p.json_parse(patch));       \
+        EXPECT_EQ(JSON_PARSE_OK, e.json_parse(expect));      \
+        EXPECT_EQ(JSON_PATCH_OK, jp.compile(&p));            \
+        EXPECT_EQ(error, jp.apply(&n));                      \
+        EXPECT_TRUE(n.json_is_equal(&e));                    \
+        n.json_free();                                       \
+        p.json_free();                                       \
+        e.json_free();                                       \
+    } while (0)
+
+TEST(TestJson, test_patch) {
+    TEST_PATCH("{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz\",\"value\":\"qux\"}]", JSON_PATCH_OK,
+               "{\"baz\":\"qux\",\"foo\":\"bar\"}");
+    TEST_PATCH("{\"foo\":[\"bar\",\"baz\"]}", "[{\"op\":\"add\",\"path\":\"/foo/1\",\"value\":\"qux\"}]", JSON_PATCH_OK,
+               "{\"foo\":[\"bar\",\"qux\",\"baz\"]}");
+    TEST_PATCH("{\"foo\":[\"bar\"]}", "[{\"op\":\"add\",\"path\":\"/foo/-\",\"value\":[\"abc\"]}]", JSON_PATCH_OK,
+               "{\"foo\":[\"bar\",[\"abc\"]]}");
+    TEST_PATCH("{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"remove\",\"path\":\"/baz\"}]", JSON_PATCH_OK,
+               "{\"foo\":\"bar\"}");
+    TEST_PATCH("{\"foo\":[\"bar\",\"qux\",\"baz\"]}", "[{\"op\":\"remove\",\"path\":\"/foo/1\"}]", JSON_PATCH_OK,
+               "{\"foo\":[\"bar\",\"baz\"]}");
+    TEST_PATCH("{\"baz\":\"qux\",\"foo\":\"bar\"}", "[{\"op\":\"replace\",\"path\":\"/baz\",\"value\":\"boo\"}]",
+               JSON_PATCH_OK, "{\"baz\":\"boo\",\"foo\":\"bar\"}");
+    TEST_PATCH("{\"foo\":{\"bar\":\"baz\",\"waldo\":\"fred\"},\"qux\":{\"corge\":\"grault\"}}",
+               "[{\"op\":\"move\",\"from\":\"/foo/waldo\",\"path\":\"/qux/thud\"}]", JSON_PATCH_OK,
+               "{\"foo\":{\"bar\":\"baz\"},\"qux\":{\"corge\":\"grault\",\"thud\":\"fred\"}}");
+    TEST_PATCH("{\"foo\":[\"all\",\"grass\",\"cows\",\"eat\"]}", "[{\"op\":\"move\",\"from\":\"/foo/1\",\"path\":\"/foo/3\"}]",
+               JSON_PATCH_OK, "{\"foo\":[\"all\",\"cows\",\"eat\",\"grass\"]}");
+    TEST_PATCH("{\"a\":{\"b\":1}}", "[{\"op\":\"copy\",\"from\":\"/a\",\"path\":\"/c\"}]", JSON_PATCH_OK,
+               "{\"a\":{\"b\":1},\"c\":{\"b\":1}}");
+    TEST_PATCH("{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}",
+               "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"qux\"},{\"op\":\"test\",\"path\":\"/foo/1\",\"value\":2}]",
+               JSON_PATCH_OK, "{\"baz\":\"qux\",\"foo\":[\"a\",2,\"c\"]}");
+    TEST_PATCH("{\"a\":1}", "[{\"op\":\"replace\",\"path\":\"\",\"value\":[1]}]", JSON_PATCH_OK, "[1]");
+
+    /* failures roll back every operation applied before them */
+    TEST_PATCH("{\"baz\":\"qux\"}", "[{\"op\":\"test\",\"path\":\"/baz\",\"value\":\"bar\"}]", JSON_PATCH_TEST_FAILED,
+               "{\"baz\":\"qux\"}");
+    TEST_PATCH("{\"foo\":\"bar\"}", "[{\"op\":\"add\",\"path\":\"/baz/bat\",\"value\":\"qux\"}]", JSON_PATCH_PATH_NOT_FOUND,
+               "{\"foo\":\"bar\"}");
+    TEST_PATCH("{\"a\":[1,2,3],\"b\":{\"c\":0},\"d\":true}",
+               "[{\"op\":\"remove\",\"path\":\"/a/0\"},"
+               "{\"op\":\"replace\",\"path\":\"/b/c\",\"value\":\"x\"},"
+               "{\"op\":\"move\",\"from\":\"/d\",\"path\":\"/a/0\"},"
+               "{\"op\":\"add\",\"path\":\"/e\",\"value\":{}},"
+               "{\"op\":\"copy\",\"from\":\"/b\",\"path\":\"/e/b\"},"
+               "{\"op\":\"replace\",\"path\":\"\",\"value\":null},"
+               "{\"op\":\"remove\",\"path\":\"/missing\"}]",
+               JSON_PATCH_PATH_NOT_FOUND, "{\"a\":[1,2,3],\"b\":{\"c\":0},\"d\":true}");
+    TEST_PATCH("{\"a\":{\"b\":1}}", "[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b/c\"}]", JSON_PATCH_INVALID_POINTER,
+               "{\"a\":{\"b\":1}}");
+    TEST_PATCH("[1]", "[{\"op\":\"replace\",\"path\":\"/1\",\"value\":2}]", JSON_PATCH_PATH_NOT_FOUND, "[1]");
+
+    JsonNode p;
+    JsonPatch jp;
+    p.json_init();
+    EXPECT_EQ(JSON_PARSE_OK, p.json_parse("[{\"op\":\"add\",\"path\":\"/a\"}]"));
+    EXPECT_EQ(JSON_PATCH_INVALID_OPERATION, jp.compile(&p));
+    p.json_free();
+    EXPECT_EQ(JSON_PARSE_OK, p.json_parse("[{\"op\":\"jump\",\"path\":\"/a\"}]"));
+    EXPECT_EQ(JSON_PATCH_INVALID_OPERATION, jp.compile(&p));
+    p.json_free();
+    EXPECT_EQ(JSON_PARSE_OK, p.json_parse("[{\"op\":\"remove\",\"path\":\"a\"}]"));
+    EXPECT_EQ(JSON_PATCH_INVALID_POINTER, jp.compile(&p));
+    EXPECT_EQ(0, jp.get_operation_size());
+    p.json_free();
+}
+
+#define TEST_MERGE_PATCH(json, patch, expect)           \
+    do {                                                \
+        JsonNode n, p, e;                               \
+        n.json_init();                                  \
+        p.json_init();                                  \
+        e.json_init();                                  \
+        EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json));   \
+        EXPECT_EQ(JSON_PARSE_OK, p.json_parse(patch));  \
+        EXPECT_EQ(JSON_PARSE_OK, e.json_parse(expect)); \
+        JsonPatch::merge(&n, &p);                       \
+        EXPECT_TRUE(n.json_is_equal(&e));               \
+        n.json_free();                                  \
+        p.json_free();                                  \
+        e.json_free();                                  \
+    } while (0)
+
+TEST(TestJson, test_merge_patch) {
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "{\"a\":null}", "{}");
+    TEST_MERGE_PATCH("{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}");
+    TEST_MERGE_PATCH("{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}");
+    TEST_MERGE_PATCH("{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}");
+    TEST_MERGE_PATCH("{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}");
+    TEST_MERGE_PATCH("[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]");
+    TEST_MERGE_PATCH("{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]");
+    TEST_MERGE_PATCH("{\"a\":\"foo\"}", "null", "null");
+    TEST_MERGE_PATCH("{\"a\":\"foo\"}", "\"bar\"", "\"bar\"");
+    TEST_MERGE_PATCH("{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}");
+    TEST_MERGE_PATCH("[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}");
+    TEST_MERGE_PATCH("{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}");
+}
+
+#define TEST_DIFF(json1, json2, expect_size)             \
+    do {                                                 \
+        JsonNode a, b, d;                                \
+        JsonPatch jp;                                    \
+        a.json_init();                                   \
+        b.json_init();                                   \
+        d.json_init();                                   \
+        EXPECT_EQ(JSON_PARSE_OK, a.json_parse(json1));   \
+        EXPECT_EQ(JSON_PARSE_OK, b.json_parse(json2));   \
+        json_diff(&a, &b, &d);                           \
+        EXPECT_EQ(expect_size, d.get_array_size());      \
+        EXPECT_EQ(JSON_PATCH_OK, jp.compile(&d));        \
+        EXPECT_EQ(JSON_PATCH_OK, jp.apply(&a));          \
+        EXPECT_TRUE(a.json_is_equal(&b));                \
+        a.json_free();                                   \
+        b.json_free();                                   \
+        d.json_free();                                   \
+    } while (0)
+
+TEST(TestJson, test_diff) {
+    TEST_DIFF("null", "null", 0);
+    TEST_DIFF("1", "2", 1);
+    TEST_DIFF("{\"a\":1}", "[1]", 1);
+    TEST_DIFF("{\"a\":1,\"b\":[1,2]}", "{\"b\":[1,2],\"a\":1}", 0);
+    TEST_DIFF("{\"a\":1,\"b\":2}", "{\"a\":1,\"c\":2}", 2);
+    TEST_DIFF("{\"a\":{\"b\":{\"c\":1,\"d\":2}}}", "{\"a\":{\"b\":{\"c\":1,\"d\":3}}}", 1);
+    TEST_DIFF("{\"a/b\":{\"~\":1}}", "{\"a/b\":{\"~\":2}}", 1);
+    TEST_DIFF("[1,2,3,4,5]", "[1,2,4,5]", 1);
+    TEST_DIFF("[1,2,3]", "[0,1,2,3]", 1);
+    TEST_DIFF("[1,2,3]", "[1,2,3,4]", 1);
+    TEST_DIFF("[1,2,3]", "[1,9,3]", 1);
+    TEST_DIFF("[1,{\"x\":[1,2]},3]", "[1,{\"x\":[1,2,7]},3]", 1);
+    TEST_DIFF("[1,2,3,4,5,6]", "[2,3,9,5,6,7]", 3);
+    TEST_DIFF("[\"a\",\"b\",\"c\"]", "[\"c\",\"b\",\"a\"]", 2);
+    TEST_DIFF("[[1],[2],[3]]", "[[3],[1],[2]]", 2);
+    TEST_DIFF("{\"a\":[1,2],\"b\":true}", "[]", 1);
+
+    JsonNode a, b, d;
+    a.json_init();
+    b.json_init();
+    d.json_init();
+    EXPECT_EQ(JSON_PARSE_OK, a.json_parse("{\"x\":[1,2]}"));
+    EXPECT_EQ(JSON_PARSE_OK, b.json_parse("{\"x\":[1,3]}"));
+    json_diff(&a, &b, &d);
+    EXPECT_EQ("[{\"op\":\"replace\",\"path\":\"/x/1\",\"value\":3}]", d.json_stringify());
+    a.json_free();
+    b.json_free();
+    d.json_free();
+}
+
+#define TEST_BINARY_ROUNDTRIP(json)                                                            \
+    do {                                                                                       \
+        JsonNode n, c, m;                                                                      \
+        std::string cbor, msgpack;                                                             \
+        n.json_init();                                                                         \
+        c.json_init();                                                                         \
+        m.json_init();                                                                         \
+        EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json));                                          \
+        json_to_cbor(&n, cbor);                                                                \
+        json_to_msgpack(&n, msgpack);                                                          \
+        EXPECT_EQ(JSON_PARSE_OK, json_from_cbor(cbor.data(), cbor.size(), &c));                \
+        EXPECT_EQ(JSON_PARSE_OK, json_from_msgpack(msgpack.data(), msgpack.size(), &m));       \
+        EXPECT_EQ(n.json_stringify(), c.json_stringify());                                     \
+        EXPECT_EQ(n.json_stringify(), m.json_stringify());                                     \
+        n.json_free();                                                                         \
+        c.json_free();                                                                         \
+        m.json_free();                                                                         \
+    } while (0)
+
+#define TEST_BINARY_BYTES(expect, encode, json)                    \
+    do {                                                           \
+        JsonNode n;                                                \
+        std::string out;                                           \
+        n.json_init();                                             \
+        EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json));              \
+        encode(&n, out);                                           \
+        EXPECT_EQ(std::string(expect, sizeof(expect) - 1), out);   \
+        n.json_free();                                             \
+    } while (0)
+
+#define TEST_BINARY_DECODE(error, decode, bytes, json)                            \
+    do {                                                                          \
+        JsonNode n;                                                               \
+        n.json_init();                                                            \
+        EXPECT_EQ(error, decode(bytes, sizeof(bytes) - 1, &n));                   \
+        if (error == JSON_PARSE_OK) {                                             \
+            EXPECT_EQ(json, n.json_stringify());                                  \
+        } else {                                                                  \
+            EXPECT_EQ(JSON_TYPE_NULL, n.get_type());                              \
+        }                                                                         \
+        n.json_free();                                                            \
+    } while (0)
+
+TEST(TestJson, test_binary) {
+    TEST_BINARY_ROUNDTRIP("null");
+    TEST_BINARY_ROUNDTRIP("true");
+    TEST_BINARY_ROUNDTRIP("false");
+    TEST_BINARY_ROUNDTRIP("0");
+    TEST_BINARY_ROUNDTRIP("-0");
+    TEST_BINARY_ROUNDTRIP("1.5");
+    TEST_BINARY_ROUNDTRIP("-1.0000000000000002");
+    TEST_BINARY_ROUNDTRIP("4.9406564584124654e-324");
+    TEST_BINARY_ROUNDTRIP("1.7976931348623157e+308");
+    TEST_BINARY_ROUNDTRIP("[23,24,255,256,65535,65536,4294967295,4294967296,9007199254740993]");
+    TEST_BINARY_ROUNDTRIP("[-1,-24,-25,-32,-33,-128,-129,-32768,-32769,-2147483648,-2147483649]");
+    TEST_BINARY_ROUNDTRIP("\"Hello\\u0000World\\u00A2\\u20AC\\uD834\\uDD1E\"");
+    TEST_BINARY_ROUNDTRIP("[]");
+    TEST_BINARY_ROUNDTRIP("{}");
+    TEST_BINARY_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
+    TEST_BINARY_ROUNDTRIP("[[0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16],\"0123456789012345678901234567890123\"]");
+
+    /* binary-safe strings */
+    {
+        JsonNode n, c, m;
+        std::string bytes("\xFF\x00\xC3", 3), cbor, msgpack;
+        n.json_init();
+        c.json_init();
+        m.json_init();
+        n.set_string(bytes);
+        json_to_cbor(&n, cbor);
+        json_to_msgpack(&n, msgpack);
+        EXPECT_EQ(0x43, (unsigned char) cbor[0]);
+        EXPECT_EQ(0xC4, (unsigned char) msgpack[0]);
+        EXPECT_EQ(JSON_PARSE_OK, json_from_cbor(cbor.data(), cbor.size(), &c));
+        EXPECT_EQ(JSON_PARSE_OK, json_from_msgpack(msgpack.data(), msgpack.size(), &m));
+        EXPECT_EQ(bytes, c.get_string());
+        EXPECT_EQ(bytes, m.get_string());
+        n.json_free();
+        c.json_free();
+        m.json_free();
+    }
+
+    TEST_BINARY_BYTES("\x18\x18", json_to_cbor, "24");
+    TEST_BINARY_BYTES("\x38\x63", json_to_cbor, "-100");
+    TEST_BINARY_BYTES("\xFA\x3F\xC0\x00\x00", json_to_cbor, "1.5");
+    TEST_BINARY_BYTES("\x82\x01\x82\x02\x03", json_to_cbor, "[1,[2,3]]");
+    TEST_BINARY_BYTES("\xA1\x61\x61\xF6", json_to_cbor, "{\"a\":null}");
+    TEST_BINARY_BYTES("\x81\xA1\x61\x01", json_to_msgpack, "{\"a\":1}");
+    TEST_BINARY_BYTES("\x92\xFF\xD0\x80", json_to_msgpack, "[-1,-128]");
+    TEST_BINARY_BYTES("\xCB\x3F\xF0\x00\x00\x00\x00\x00\x01", json_to_msgpack, "1.0000000000000002");
+
+    TEST_BINARY_DECODE(JSON_PARSE_OK, json_from_cbor, "\xF9\x3E\x00", "1.5");
+    TEST_BINARY_DECODE(JSON_PARSE_OK, json_from_cbor, "\x9F\x01\x82\x02\x03\xFF", "[1,[2,3]]");
+    TEST_BINARY_DECODE(JSON_PARSE_OK, json_from_cbor, "\xBF\x61\x61\x01\x7F\x61\x62\x61\x63\xFF\xF5\xFF", "{\"a\":1,\"bc\":true}");
+    TEST_BINARY_DECODE(JSON_PARSE_OK, json_from_cbor, "\xC1\x1A\x51\x4B\x67\xB0", "1363896240");
+    TEST_BINARY_DECODE(JSON_PARSE_EXPECT_VALUE, json_from_cbor, "\x82\x01", "");
+    TEST_BINARY_DECODE(JSON_PARSE_EXPECT_VALUE, json_from_cbor, "\x63\x61\x62", "");
+    TEST_BINARY_DECODE(JSON_PARSE_NOT_SINGLE_VALUE, json_from_cbor, "\x01\x02", "");
+    TEST_BINARY_DECODE(JSON_PARSE_NOT_EXIST_KEY, json_from_cbor, "\xA1\x01\x02", "");
+    TEST_BINARY_DECODE(JSON_PARSE_INVALID_VALUE, json_from_cbor, "\x1C", "");
+    TEST_BINARY_DECODE(JSON_PARSE_OK, json_from_msgpack, "\x93\xC0\xC2\xCD\x01\x00", "[null,false,256]");
+    TEST_BINARY_DECODE(JSON_PARSE_OK, json_from_msgpack, "\x82\xA1\x61\xD1\xFF\x00\xD9\x01\x62\xCA\x3F\xC0\x00\x00",
+                       "{\"a\":-256,\"b\":1.5}");
+    TEST_BINARY_DECODE(JSON_PARSE_NOT_EXIST_KEY, json_from_msgpack, "\x81\x01\x02", "");
+    TEST_BINARY_DECODE(JSON_PARSE_INVALID_VALUE, json_from_msgpack, "\xC1", "");
+    TEST_BINARY_DECODE(JSON_PARSE_NOT_SINGLE_VALUE, json_from_msgpack, "\xC0\xC0", "");
+
+    //Nesting is bounded even without max_depth, so hostile input cannot
+    //exhaust the stack.
+    JsonNode deep;
+    std::string nested(1 << 20, '\x81');
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, json_from_cbor(nested.data(), nested.size(), &deep));
+    nested.assign(1 << 20, '\xC6');
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, json_from_cbor(nested.data(), nested.size(), &deep));
+    nested.assign(1 << 20, '\x91');
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, json_from_msgpack(nested.data(), nested.size(), &deep));
+    JsonParseOptions options;
+    options.max_depth = 2;
+    EXPECT_EQ(JSON_PARSE_OK, json_from_cbor("\x81\x81\x01", 3, &deep, options));
+    EXPECT_EQ("[[1]]", deep.json_stringify());
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, json_from_cbor("\x81\x81\x81\x01", 4, &deep, options));
+    EXPECT_EQ(JSON_PARSE_OK, json_from_msgpack("\x91\x91\x01", 3, &deep, options));
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, json_from_msgpack("\x91\x91\x81\xA1\x61\x01", 6, &deep, options));
+}
+
+TEST(TestJson, test_tape) {
+    JsonTape tape, loaded;
+    EXPECT_EQ(JSON_PARSE_OK, tape.parse(
+                                     "{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"a\\u0000c\","
+                                     "\"a\":[1,[2,3],{\"x\":4}],\"o\":{\"1\":1,\"2\":2}}"));
+    JsonTapeView root = tape.root();
+    EXPECT_EQ(JSON_TYPE_OBJECT, root.get_type());
+    EXPECT_EQ(7, root.get_object_size());
+    EXPECT_EQ("n", root.get_object_key(0));
+    EXPECT_EQ(JSON_TYPE_NULL, root.get_object_value(0).get_type());
+    EXPECT_FALSE(root.get_object_value(1).get_bool());
+    EXPECT_TRUE(root.get_object_value(2).get_bool());
+    EXPECT_DOUBLE_EQ(123.0, root.find_object_value("i").get_number());
+    EXPECT_EQ(std::string("a\0c", 3), root.find_object_value("s").get_string());
+    EXPECT_FALSE(root.find_object_value("missing").is_valid());
+    JsonTapeView a = root.find_object_value("a");
+    EXPECT_EQ(3, a.get_array_size());
+    EXPECT_EQ(2, a.get_array_index(1).get_array_size());
+    EXPECT_DOUBLE_EQ(3.0, a.get_array_index(1).get_array_index(1).get_number());
+    EXPECT_DOUBLE_EQ(4.0, a.get_array_index(2).find_object_value("x").get_number());
+    EXPECT_FALSE(a.get_array_index(3).is_valid());
+    /* siblings are one step apart */
+    EXPECT_EQ(JSON_TYPE_OBJECT, a.get_array_index(0).next().next().get_type());
+    EXPECT_EQ("o", root.get_object_key(6));
+
+    char path[] = "/tmp/tiny_json_tape_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    EXPECT_EQ(JSON_TAPE_OK, tape.save(path));
+    EXPECT_EQ(JSON_TAPE_OK, loaded.load(path));
+    EXPECT_EQ(tape.get_tape_size(), loaded.get_tape_size());
+    EXPECT_EQ(tape.get_string_size(), loaded.get_string_size());
+    EXPECT_DOUBLE_EQ(2.0, loaded.root().find_object_value("o").find_object_value("2").get_number());
+    EXPECT_EQ("a", loaded.root().get_object_key(5));
+
+    /* damaged words are caught at load, not when a view reads them */
+    std::string file;
+    FILE* fp = fopen(path, "rb");
+    for (int ch; (ch = fgetc(fp)) != EOF;) {
+        file.push_back((char) ch);
+    }
+    fclose(fp);
+    auto damaged = [&](size_t word, uint64_t value) {
+        std::string copy = file;
+        memcpy(&copy[(4 + word) * sizeof(uint64_t)], &value, sizeof(value));
+        FILE* out = fopen(path, "wb");
+        fwrite(copy.data(), 1, copy.size(), out);
+        fclose(out);
+        return loaded.load(path);
+    };
+    uint64_t first;
+    memcpy(&first, &file[4 * sizeof(uint64_t)], sizeof(first));
+    EXPECT_EQ(JSON_TAPE_OK, damaged(0, first));
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, damaged(0, first + 1));//root ends early
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, damaged(0, first - 1));//root ends late
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, damaged(1, (uint64_t) '"' << 56 | tape.get_string_size()));
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, damaged(1, (uint64_t) 'n' << 56));//key that is not a string
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, damaged(tape.get_tape_size() - 1, (uint64_t) ']' << 56));
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, damaged(0, first + (1ULL << 32)));//wrong count
+    EXPECT_FALSE(loaded.root().is_valid());
+    fp = fopen(path, "wb");
+    fputs("not a tape, just some text that is long enough", fp);
+    fclose(fp);
+    EXPECT_EQ(JSON_TAPE_INVALID_FORMAT, loaded.load(path));
+    EXPECT_FALSE(loaded.root().is_valid());
+    unlink(path);
+    EXPECT_EQ(JSON_TAPE_IO_ERROR, loaded.load(path));
+
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, tape.parse("[1"));
+    EXPECT_FALSE(tape.root().is_valid());
+}
+
+TEST(TestJson, test_stringify_sink) {
+    JsonNode v;
+    std::string big(5000, 'x');
+    std::string json = "{\"a\\n\":[1,true,null,\"" + big + "\\t" + big + "\"],\"b\":{\"c\":\"\\u0001\"},\"" + big + "\":-2.5}";
+    v.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse(json.c_str()));
+    std::string expect = v.json_stringify();
+    EXPECT_EQ(json, expect);
+
+    /* tiny buffers split every token across flushes */
+    for (size_t buffer_size : {1, 7, 64, 16384}) {
+        std::string out;
+        int calls = 0;
+        JsonCallbackSink sink([&](const char* data, size_t size) {
+            out.append(data, size);
+            calls++;
+            return true;
+        });
+        EXPECT_EQ(JSON_STRINGIFY_OK, v.json_stringify(sink, buffer_size));
+        EXPECT_EQ(expect, out);
+        EXPECT_GT(calls, 0);
+    }
+
+    std::ostringstream stream;
+    JsonStreamSink stream_sink(stream);
+    EXPECT_EQ(JSON_STRINGIFY_OK, v.json_stringify(stream_sink, 100));
+    EXPECT_EQ(expect, stream.str());
+
+    char path[] = "/tmp/tiny_json_sink_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    JsonFdSink fd_sink(fd);
+    EXPECT_EQ(JSON_STRINGIFY_OK, v.json_stringify(fd_sink, 256));
+    close(fd);
+    FILE* fp = fopen(path, "rb");
+    std::string read_back(expect.size() + 1, '\0');
+    read_back.resize(fread(&read_back[0], 1, read_back.size(), fp));
+    fclose(fp);
+    EXPECT_EQ(expect, read_back);
+
+    fp = fopen(path, "wb");
+    JsonFileSink file_sink(fp);
+    EXPECT_EQ(JSON_STRINGIFY_OK, v.json_stringify(file_sink));
+    fclose(fp);
+    fp = fopen(path, "rb");
+    read_back.assign(expect.size() + 1, '\0');
+    read_back.resize(fread(&read_back[0], 1, read_back.size(), fp));
+    fclose(fp);
+    EXPECT_EQ(expect, read_back);
+    unlink(path);
+
+    /* a failing sink stops the output and is reported */
+    size_t total = 0;
+    JsonCallbackSink failing([&](const char*, size_t size) {
+        total += size;
+        return false;
+    });
+    EXPECT_EQ(JSON_STRINGIFY_SINK_ERROR, v.json_stringify(failing, 32));
+    EXPECT_LE(total, 32);
+    JsonFdSink bad_fd(-1);
+    EXPECT_EQ(JSON_STRINGIFY_SINK_ERROR, v.json_stringify(bad_fd));
+    v.json_free();
+}
+
+TEST(TestJson, test_writer) {
+    JsonWriter w;
+    w.begin_object();
+    w.key("id");
+    w.value(42);
+    w.key("name");
+    w.value("a\"b\n");
+    w.key(std::string("tags"));
+    w.begin_array();
+    w.value(nullptr);
+    w.value(true);
+    w.value(-1.5);
+    w.value(-9007199254740993LL);
+    w.value(18446744073709551615ULL);
+    w.begin_object();
+    w.end_object();
+    w.begin_array();
+    w.end_array();
+    w.end_array();
+    w.key("k\t");
+    w.value(1e300);
+    w.end_object();
+    EXPECT_TRUE(w.is_complete());
+    EXPECT_EQ("{\"id\":42,\"name\":\"a\\\"b\\n\",\"tags\":[null,true,-1.5,-9007199254740993,18446744073709551615,{},[]],"
+              "\"k\\t\":1.0000000000000001e+300}",
+              w.get_string());
+
+    /* numbers JSON cannot express become null */
+    w.clear();
+    w.begin_array();
+    w.value(std::numeric_limits<double>::quiet_NaN());
+    w.value(-std::numeric_limits<double>::infinity());
+    JsonNode nan;
+    nan.set_array();
+    nan.pushback_array_number(std::numeric_limits<double>::quiet_NaN());
+    w.value(&nan);
+    w.end_array();
+    EXPECT_EQ("[null,null,[null]]", w.get_string());
+    EXPECT_EQ("[null]", nan.json_stringify());
+    nan.set_packed_array({1, std::numeric_limits<double>::infinity()});
+    EXPECT_EQ("[1,null]", nan.json_stringify());
+
+    /* the output parses back and matches the equivalent tree */
+    JsonNode v;
+    v.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse("{\"a\":[1,\"x\",{\"b\":null}],\"c\":false}"));
+    w.clear();
+    EXPECT_FALSE(w.is_complete());
+    {
+        auto o = w.object();
+        {
+            auto a = o.array("a");
+            a.element(1).element("x");
+            a.object().member("b", nullptr);
+        }
+        o.member("c", false);
+    }
+    EXPECT_TRUE(w.is_complete());
+    EXPECT_EQ(v.json_stringify(), w.get_string());
+
+    /* existing trees embed as values */
+    w.clear();
+    w.array().element(&v).element(std::string("s"));
+    EXPECT_EQ("[" + v.json_stringify() + ",\"s\"]", w.get_string());
+    v.json_free();
+
+    /* with a sink the buffer is flushed as it fills */
+    std::string out;
+    int calls = 0;
+    JsonCallbackSink sink([&](const char* data, size_t size) {
+        out.append(data, size);
+        calls++;
+        return true;
+    });
+    JsonWriter streamed(sink, 16);
+    {
+        auto a = streamed.array();
+        for (int i = 0; i < 100; i++) {
+            a.object().member("i", i);
+        }
+    }
+    EXPECT_TRUE(streamed.flush());
+    EXPECT_GT(calls, 10);
+    EXPECT_TRUE(streamed.get_string().empty());
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse(out.c_str()));
+    EXPECT_EQ(100, v.get_array_size());
+    EXPECT_DOUBLE_EQ(99.0, v.get_array_index(99)->find_object_value("i")->get_number());
+    v.json_free();
+}
+
+TEST(TestJson, test_stringify_options) {
+    JsonNode v;
+    JsonStringifyOptions options;
+    v.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse("{\"b\":[1,[],{}],\"a\":{\"y\":null,\"x\":\"caf\\u00e9 \\ud83d\\ude00 a/b\"},\"a\":true}"));
+
+    /* defaults match json_stringify() */
+    EXPECT_EQ(v.json_stringify(), v.json_stringify(options));
+
+    options.indent = 2;
+    EXPECT_EQ("{\n"
+              "  \"b\": [\n"
+              "    1,\n"
+              "    [],\n"
+              "    {}\n"
+              "  ],\n"
+              "  \"a\": {\n"
+              "    \"y\": null,\n"
+              "    \"x\": \"caf\xC3\xA9 \xF0\x9F\x98\x80 a/b\"\n"
+              "  },\n"
+              "  \"a\": true\n"
+              "}",
+              v.json_stringify(options));
+
+    /* sorting is stable for duplicate keys and applies at every level */
+    options.indent = 0;
+    options.sort_keys = true;
+    EXPECT_EQ("{\"a\":{\"x\":\"caf\xC3\xA9 \xF0\x9F\x98\x80 a/b\",\"y\":null},\"a\":true,\"b\":[1,[],{}]}", v.json_stringify(options));
+    EXPECT_EQ("{\"b\":[1,[],{}],\"a\":{\"y\":null,\"x\":\"caf\xC3\xA9 \xF0\x9F\x98\x80 a/b\"},\"a\":true}", v.json_stringify());
+
+    options.sort_keys = false;
+    options.ascii_only = true;
+    options.escape_slash = true;
+    std::string ascii = v.json_stringify(options);
+    EXPECT_NE(std::string::npos, ascii.find("\"caf\\u00E9 \\uD83D\\uDE00 a\\/b\""));
+    JsonNode w;
+    w.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, w.json_parse(ascii.c_str()));
+    EXPECT_EQ(v.json_stringify(), w.json_stringify());
+    w.json_free();
+
+    /* invalid UTF-8 is copied through */
+    w.json_init();
+    w.set_string(std::string("a\xFF\xC3", 3));
+    EXPECT_EQ(std::string("\"a\xFF\xC3\"", 5), w.json_stringify(options));
+    w.json_free();
+
+    /* deep indentation and the sink path */
+    options = JsonStringifyOptions();
+    options.indent = 40;
+    std::string out;
+    JsonCallbackSink sink([&](const char* data, size_t size) {
+        out.append(data, size);
+        return true;
+    });
+    EXPECT_EQ(JSON_STRINGIFY_OK, v.json_stringify(sink, options, 8));
+    EXPECT_EQ(v.json_stringify(options), out);
+    EXPECT_NE(std::string::npos, out.find("\n" + std::string(80, ' ') + "1,"));
+    v.json_free();
+}
+
+struct TestBindDims {
+    int w = 0;
+    int h = 0;
+    std::string unit;
+};
+TINY_JSON_BIND(TestBindDims, w, h, unit)
+
+struct TestBindRecord {
+    long long id = 0;
+    std::string name;
+    double price = 0;
+    bool active = false;
+    unsigned char level = 7;
+    std::vector<std::string> tags;
+    std::vector<TestBindDims> dims;
+    float ratio = 0;
+};
+TINY_JSON_BIND(TestBindRecord, id, name, price, active, level, tags, dims, ratio)
+
+struct TestBindAny {
+    std::vector<int> ids;
+    JsonNode extra;
+};
+TINY_JSON_BIND(TestBindAny, ids, extra)
+
+TEST(TestJson, test_reader) {
+    JsonReader reader(" {\"a\" : [1, \"x\\n\", null, true, {}], \"b\\u0041\":false, \"c\":{\"d\":[]}} ");
+    const char* key;
+    size_t length;
+    double num;
+    bool b;
+    std::string str;
+    EXPECT_EQ(JSON_TYPE_OBJECT, reader.peek());
+    EXPECT_EQ(JSON_PARSE_OK, reader.begin_object());
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_key(key, length));
+    EXPECT_EQ("a", std::string(key, length));
+    EXPECT_EQ(JSON_PARSE_OK, reader.begin_array());
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_number(num));
+    EXPECT_DOUBLE_EQ(1.0, num);
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_string(str));
+    EXPECT_EQ("x\n", str);
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_null());
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_bool(b));
+    EXPECT_TRUE(b);
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.skip());
+    EXPECT_FALSE(reader.has_next());
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_key(key, length));
+    EXPECT_EQ("bA", std::string(key, length));
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_bool(b));
+    EXPECT_FALSE(b);
+    EXPECT_TRUE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_key(key, length));
+    JsonNode v;
+    v.json_init();
+    EXPECT_EQ(JSON_PARSE_OK, reader.read_value(v));
+    EXPECT_EQ("{\"d\":[]}", v.json_stringify());
+    v.json_free();
+    EXPECT_FALSE(reader.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, reader.finish());
+
+    /* errors are sticky */
+    JsonReader bad("[1 2]");
+    EXPECT_EQ(JSON_PARSE_OK, bad.begin_array());
+    EXPECT_TRUE(bad.has_next());
+    EXPECT_EQ(JSON_PARSE_OK, bad.read_number(num));
+    EXPECT_FALSE(bad.has_next());
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, bad.get_error());
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, bad.read_null());
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, bad.finish());
+
+    JsonReader mismatch("\"1\"");
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, mismatch.read_number(num));
+    JsonReader trailing("1 x");
+    EXPECT_EQ(JSON_PARSE_OK, trailing.read_number(num));
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, trailing.finish());
+}
+
+TEST(TestJson, test_bind) {
+    TestBindRecord r;
+    EXPECT_EQ(JSON_PARSE_OK, json_bind_parse("{\"id\":9007199254740991,\"unknown\":{\"id\":[1]},\"name\":\"a\\\"b\","
+                                             "\"price\":2.5,\"active\":true,\"tags\":[\"x\",\"y\"],"
+                                             "\"dims\":[{\"w\":1,\"h\":2,\"unit\":\"cm\"},{\"unit\":\"m\",\"w\":3}],\"ratio\":0.5}",
+                                             r));
+    EXPECT_EQ(9007199254740991LL, r.id);
+    EXPECT_EQ("a\"b", r.name);
+    EXPECT_DOUBLE_EQ(2.5, r.price);
+    EXPECT_TRUE(r.active);
+    EXPECT_EQ(7, r.level);
+    ASSERT_EQ(2, r.tags.size());
+    EXPECT_EQ("y", r.tags[1]);
+    ASSERT_EQ(2, r.dims.size());
+    EXPECT_EQ(2, r.dims[0].h);
+    EXPECT_EQ(3, r.dims[1].w);
+    EXPECT_EQ(0, r.dims[1].h);
+    EXPECT_EQ("m", r.dims[1].unit);
+    EXPECT_FLOAT_EQ(0.5f, r.ratio);
+
+    /* writing produces every field in declaration order */
+    std::string json = json_bind_stringify(r);
+    EXPECT_EQ("{\"id\":9007199254740991,\"name\":\"a\\\"b\",\"price\":2.5,\"active\":true,\"level\":7,\"tags\":[\"x\",\"y\"],"
+              "\"dims\":[{\"w\":1,\"h\":2,\"unit\":\"cm\"},{\"w\":3,\"h\":0,\"unit\":\"m\"}],\"ratio\":0.5}",
+              json);
+    TestBindRecord copy;
+    EXPECT_EQ(JSON_PARSE_OK, json_bind_parse(json.c_str(), copy));
+    EXPECT_EQ(json, json_bind_stringify(copy));
+
+    /* type and range mismatches */
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("{\"id\":\"1\"}", r));
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("{\"id\":1.5}", r));
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("{\"level\":256}", r));
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("{\"level\":-1}", r));
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("[]", r));
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("{\"tags\":[1]}", r));
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, json_bind_parse("{\"ratio\":\"x\"}", r));
+    EXPECT_FLOAT_EQ(0.5f, r.ratio);
+    EXPECT_EQ(JSON_PARSE_MISS_COLON, json_bind_parse("{\"id\" 1}", r));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, json_bind_parse("{\"id\":1 \"name\":\"\"}", r));
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, json_bind_parse("{} {}", r));
+    EXPECT_EQ(JSON_PARSE_INVALID_STRING_ESCAPEVALUE, json_bind_parse("{\"skipped\":\"\\v\"}", r));
+
+    /* JsonNode fields keep arbitrary values */
+    TestBindAny any;
+    any.extra.json_init();
+    EXPECT_EQ(JSON_PARSE_OK, json_bind_parse("{\"extra\":{\"k\":[null]},\"ids\":[3,4]}", any));
+    EXPECT_EQ("{\"ids\":[3,4],\"extra\":{\"k\":[null]}}", json_bind_stringify(any));
+    any.extra.json_free();
+}
+
+TEST(TestJson, test_shape) {
+    JsonShape shape;
+    int item = shape.set_element(0);
+    shape.add_member(item, "id");
+    shape.add_member(item, "name");
+    int tags = shape.add_member(item, "tags");
+    shape.set_element(tags);
+    int dims = shape.add_member(item, "dims");
+    shape.add_member(dims, "w");
+    shape.add_member(dims, "h");
+    shape.add_member(item, "a\"b");
+    EXPECT_EQ(10, shape.get_shape_size());
+
+    /* in order, reordered, with extra or missing keys and mismatched types */
+    static const char* const docs[] = {
+            "[{\"id\":1,\"name\":\"x\",\"tags\":[\"a\"],\"dims\":{\"w\":1,\"h\":2},\"a\\\"b\":null}]",
+            "[ { \"id\" : 1 , \"name\" : \"x\" } , {\"name\":\"y\",\"id\":2} ]",
+            "[{\"extra\":true,\"id\":1,\"dims\":{\"h\":2,\"w\":1,\"d\":3},\"n\\u0061me\":\"z\"}]",
+            "[{\"tags\":{\"a\":1},\"dims\":[1,2]},{},[],5,\"s\"]",
+            "{\"id\":[{\"id\":1}]}",
+            "[{\"id\":1,\"id\":2}]",
+    };
+    for (const char* json : docs) {
+        JsonNode expect, v;
+        expect.json_init();
+        v.json_init();
+        ASSERT_EQ(JSON_PARSE_OK, expect.json_parse(json));
+        EXPECT_EQ(JSON_PARSE_OK, shape.parse(json, &v));
+        EXPECT_EQ(expect.json_stringify(), v.json_stringify());
+        expect.json_free();
+        v.json_free();
+    }
+
+    /* errors match the generic parser */
+    JsonNode v;
+    v.json_init();
+    EXPECT_EQ(JSON_PARSE_MISS_COLON, shape.parse("[{\"id\" 1}]", &v));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, shape.parse("[{\"id\":1 \"name\":2}]", &v));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, shape.parse("[{\"id\":1}", &v));
+    EXPECT_EQ(JSON_PARSE_NOT_EXIST_KEY, shape.parse("[{\"id\":1,2:3}]", &v));
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, shape.parse("[] 1", &v));
+    EXPECT_EQ(JSON_PARSE_INVALID_VALUE, shape.parse("[{\"id\":nul}]", &v));
+
+    /* shapes compiled from a JSON Schema */
+    JsonNode schema;
+    schema.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"type\":\"object\",\"properties\":{\"b\":{\"type\":\"array\",\"items\":"
+                                               "{\"properties\":{\"y\":{},\"x\":true}}},\"a\":{\"type\":\"string\"}},"
+                                               "\"required\":[\"a\"]}"));
+    JsonShape compiled;
+    EXPECT_EQ(JSON_SHAPE_OK, compiled.compile(&schema));
+    EXPECT_EQ(6, compiled.get_shape_size());
+    EXPECT_EQ(JSON_PARSE_OK, compiled.parse("{\"b\":[{\"y\":1,\"x\":2},{\"x\":3}],\"a\":\"s\"}", &v));
+    EXPECT_EQ("{\"b\":[{\"y\":1,\"x\":2},{\"x\":3}],\"a\":\"s\"}", v.json_stringify());
+    v.json_free();
+    schema.json_free();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"properties\":{\"a\":1}}"));
+    EXPECT_EQ(JSON_SHAPE_INVALID_SCHEMA, compiled.compile(&schema));
+    EXPECT_EQ(1, compiled.get_shape_size());
+    schema.json_free();
+}
+
+TEST(TestJson, test_schema) {
+    JsonNode schema, v;
+    JsonSchema validator;
+    std::vector<JsonSchemaError> errors;
+    JsonSchemaError error;
+    schema.json_init();
+    v.json_init();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"type\":\"object\",\"required\":[\"id\",\"tags\"],\"title\":\"record\","
+                                               "\"properties\":{"
+                                               "\"id\":{\"type\":\"integer\",\"minimum\":1},"
+                                               "\"name\":{\"type\":\"string\",\"minLength\":2,\"maxLength\":4,\"pattern\":\"^[a-z\xC3\xA9]+$\"},"
+                                               "\"kind\":{\"enum\":[\"a\",{\"b\":[1]},null]},"
+                                               "\"price\":{\"type\":[\"number\",\"null\"],\"exclusiveMaximum\":100},"
+                                               "\"tags\":{\"type\":\"array\",\"maxItems\":2,\"items\":{\"type\":\"string\"}},"
+                                               "\"pair\":{\"items\":[{\"type\":\"boolean\"},false]}}}"));
+    ASSERT_EQ(JSON_SCHEMA_OK, validator.compile(&schema));
+
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse("{\"id\":3,\"name\":\"caf\xC3\xA9\",\"kind\":{\"b\":[1]},\"price\":null,"
+                                          "\"tags\":[\"x\"],\"pair\":[true],\"other\":[1,2,3]}"));
+    EXPECT_EQ(JSON_SCHEMA_OK, validator.validate(&v));
+    EXPECT_EQ(JSON_SCHEMA_OK, validator.validate(&v, errors));
+    EXPECT_EQ(0, errors.size());
+    v.json_free();
+
+    const char* invalid = "{\"id\":1.5,\"name\":\"A\",\"kind\":\"c\",\"price\":100,\"tags\":[\"x\",2,\"y\"],\"pair\":[1,2]}";
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse(invalid));
+    EXPECT_EQ(JSON_SCHEMA_MISMATCH, validator.validate(&v));
+    EXPECT_EQ(JSON_SCHEMA_MISMATCH, validator.validate(&v, errors, false));
+    ASSERT_EQ(1, errors.size());
+    EXPECT_EQ("/id", errors[0].pointer);
+    EXPECT_EQ("type", errors[0].keyword);
+    EXPECT_EQ(JSON_SCHEMA_MISMATCH, validator.validate(&v, errors));
+    std::vector<std::string> found;
+    for (const auto& e : errors) {
+        found.push_back(e.pointer + " " + e.keyword);
+    }
+    EXPECT_EQ((std::vector<std::string>{"/id type", "/name minLength", "/name pattern", "/kind enum",
+                                        "/price exclusiveMaximum", "/tags maxItems", "/tags/1 type", "/pair/0 type",
+                                        "/pair/1 false"}),
+              found);
+    v.json_free();
+    ASSERT_EQ(JSON_PARSE_OK, v.json_parse("{\"tags\":[]}"));
+    EXPECT_EQ(JSON_SCHEMA_MISMATCH, validator.validate(&v, errors));
+    ASSERT_EQ(1, errors.size());
+    EXPECT_EQ("", errors[0].pointer);
+    EXPECT_EQ("required", errors[0].keyword);
+    v.json_free();
+
+    /* streaming: rejected as soon as the offending value is complete */
+    EXPECT_EQ(JSON_PARSE_OK, validator.parse("{\"id\":7,\"tags\":[\"a\",\"b\"]}", &v, &error));
+    EXPECT_EQ("{\"id\":7,\"tags\":[\"a\",\"b\"]}", v.json_stringify());
+    v.json_free();
+    EXPECT_EQ(JSON_PARSE_SCHEMA_MISMATCH, validator.parse("{\"tags\":[\"a\",\"b\",\"c\"],\"id\":7}", &v, &error));
+    EXPECT_EQ("/tags", error.pointer);
+    EXPECT_EQ("maxItems", error.keyword);
+    EXPECT_EQ(JSON_TYPE_NULL, v.get_type());
+    /* the rest of the input is never read, so later syntax errors do not matter */
+    EXPECT_EQ(JSON_PARSE_SCHEMA_MISMATCH, validator.parse("{\"tags\":{\"x\" 1 2 3", &v, &error));
+    EXPECT_EQ("/tags", error.pointer);
+    EXPECT_EQ("type", error.keyword);
+    EXPECT_EQ(JSON_PARSE_SCHEMA_MISMATCH, validator.parse("{\"pair\":[true,{}],\"id\":1}", &v, &error));
+    EXPECT_EQ("/pair/1", error.pointer);
+    EXPECT_EQ(JSON_PARSE_SCHEMA_MISMATCH, validator.parse("{\"id\":1}", &v, &error));
+    EXPECT_EQ("", error.pointer);
+    EXPECT_EQ("required", error.keyword);
+    EXPECT_EQ(JSON_PARSE_SCHEMA_MISMATCH, validator.parse("[]", &v));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, validator.parse("{\"id\":1 \"tags\":[]}", &v, &error));
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, validator.parse("{\"id\":1,\"tags\":[]} 1", &v, &error));
+
+    /* schemas that cannot be compiled */
+    static const char* const bad[] = {"1", "{\"type\":\"float\"}", "{\"required\":[1]}", "{\"minLength\":-1}",
+                                      "{\"pattern\":\"(\"}", "{\"properties\":{\"a\":[]}}"};
+    for (const char* json : bad) {
+        schema.json_free();
+        ASSERT_EQ(JSON_PARSE_OK, schema.json_parse(json));
+        EXPECT_EQ(JSON_SCHEMA_INVALID_SCHEMA, validator.compile(&schema));
+    }
+    schema.json_free();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"properties\":{\"a\":{\"$ref\":\"#\"}}}"));
+    EXPECT_EQ(JSON_SCHEMA_UNSUPPORTED, validator.compile(&schema));
+    schema.json_free();
+
+    /* a long string is matched against a pattern without exhausting the stack */
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"type\":\"string\",\"pattern\":\"^[a-z]*$\"}"));
+    ASSERT_EQ(JSON_SCHEMA_OK, validator.compile(&schema));
+    std::string text = "\"" + std::string(1000000, 'a') + "\"";
+    JsonNode long_string;
+    ASSERT_EQ(JSON_PARSE_OK, long_string.json_parse(text.c_str()));
+    int validated = validator.validate(&long_string);
+    int parsed = validator.parse(text.c_str(), &v);
+#ifdef __GLIBCXX__
+    EXPECT_EQ(JSON_SCHEMA_OK, validated);
+    EXPECT_EQ(JSON_PARSE_OK, parsed);
+    schema.json_free();
+    ASSERT_EQ(JSON_PARSE_OK, schema.json_parse("{\"pattern\":\"(a)\\\\1\"}"));
+    EXPECT_EQ(JSON_SCHEMA_UNSUPPORTED, validator.compile(&schema));
+#else
+    EXPECT_EQ(JSON_SCHEMA_MISMATCH, validated);
+    EXPECT_EQ(JSON_PARSE_SCHEMA_MISMATCH, parsed);
+#endif
+    schema.json_free();
+}
+
+TEST(TestJson, test_parse_result) {
+    JsonNode node;
+    JsonParseResult result;
+    EXPECT_EQ(JSON_PARSE_OK, node.json_parse(" [1, 2] ", result));
+    EXPECT_EQ(JSON_PARSE_OK, result.code);
+    EXPECT_EQ(8, result.offset);
+    EXPECT_EQ(0, result.line);
+    node.json_free();
+
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, node.json_parse("[1, 2 3]", result));
+    EXPECT_EQ(6, result.offset);
+    EXPECT_EQ(1, result.line);
+    EXPECT_EQ(7, result.column);
+    EXPECT_EQ("[1, 2 3]", result.context);
+    EXPECT_EQ(6, result.context_offset);
+    node.json_free();
+
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, node.json_parse("null x", result));
+    EXPECT_EQ(5, result.offset);
+    node.json_free();
+
+    /* the escape, not the end of the string */
+    EXPECT_EQ(JSON_PARSE_INVALID_STRING_ESCAPEVALUE, node.json_parse("{\n  \"a\": \"x\\qy\"\n}", result));
+    EXPECT_EQ(11, result.offset);
+    EXPECT_EQ(2, result.line);
+    EXPECT_EQ(10, result.column);
+    EXPECT_EQ("  \"a\": \"x\\qy\"", result.context);
+    EXPECT_EQ(9, result.context_offset);
+    node.json_free();
+
+    EXPECT_EQ(JSON_PARSE_INVALID_UNICODE_SURROGATE, node.json_parse("[\"\\uD800\\u0041\"]", result));
+    EXPECT_EQ(2, result.offset);
+    node.json_free();
+
+    EXPECT_EQ(JSON_PARSE_INVALID_STRING_CHAR, node.json_parse("[\"a\tb\"]", result));
+    EXPECT_EQ(3, result.offset);
+    EXPECT_EQ("[\"a b\"]", result.context);
+    node.json_free();
+
+    /* long lines are cut to 20 bytes either side */
+    std::string json = "[" + std::string(30, '1') + ",\n" + std::string(30, '2') + " ?" + std::string(30, ' ') + "]";
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, node.json_parse(json.c_str(), result));
+    EXPECT_EQ(64, result.offset);
+    EXPECT_EQ(2, result.line);
+    EXPECT_EQ(32, result.column);
+    EXPECT_EQ(std::string(19, '2') + " ?" + std::string(19, ' '), result.context);
+    EXPECT_EQ(20, result.context_offset);
+    node.json_free();
+}
+
+TEST(TestJson, test_ownership) {
+    /* a reused node frees what it held; run under ASan/LSan to see leaks */
+    JsonNode n;
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("{\"a\":[1,{\"b\":\"c\"}]}"));
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("[[],{}]"));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, n.json_parse("{\"a\":[1,2],\"b\":{\"c\":3} \"d\"}"));
+    EXPECT_EQ(JSON_TYPE_NULL, n.get_type());
+    EXPECT_EQ(JSON_PARSE_MISS_COLON, n.json_parse("[{\"a\":1,\"b\"}]"));
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("{\"a\":[1,2]}"));
+    n.set_string("s");
+    EXPECT_EQ("s", n.get_string());
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("[1,2]"));
+    n.set_object();
+    EXPECT_EQ(0, n.get_object_size());
+
+    JsonNode copy;
+    EXPECT_EQ(JSON_PARSE_OK, copy.json_parse("[1,[2,3]]"));
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("{\"a\":{\"b\":[true]}}"));
+    copy = n;
+    copy = copy;
+    EXPECT_EQ("{\"a\":{\"b\":[true]}}", copy.json_stringify());
+    JsonNode other(copy);
+    EXPECT_EQ(copy.json_stringify(), other.json_stringify());
+}
+
+TEST(TestJson, test_memory) {
+    const char* json = "{\"id\":1,\"name\":\"a string too long for the small buffer\",\"tags\":[\"x\",true,null]}";
+    JsonCountingAllocator allocator;
+    JsonParseOptions options;
+    options.allocator = &allocator;
+    {
+        JsonNode n;
+        EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+        /* every node but the root comes from the allocator */
+        EXPECT_EQ(6, allocator.get_allocations());
+        EXPECT_EQ(allocator.get_bytes(), allocator.get_peak_bytes());
+        EXPECT_LT(0, allocator.get_bytes());
+
+        JsonMemoryStats stats;
+        n.json_memory_stats(stats);
+        EXPECT_EQ(7, stats.node_count);
+        EXPECT_EQ(1, stats.nodes[JSON_TYPE_OBJECT]);
+        EXPECT_EQ(1, stats.nodes[JSON_TYPE_ARRAY]);
+        EXPECT_EQ(2, stats.nodes[JSON_TYPE_STRING]);
+        EXPECT_EQ(1, stats.nodes[JSON_TYPE_NUMBER]);
+        EXPECT_EQ(1, stats.nodes[JSON_TYPE_TRUE]);
+        EXPECT_EQ(1, stats.nodes[JSON_TYPE_NULL]);
+        EXPECT_EQ(2 + 4 + 4 + 38 + 1, stats.string_length);
+        EXPECT_LT(38, stats.string_bytes);
+        EXPECT_EQ(stats.node_bytes + stats.string_bytes + stats.container_bytes + stats.container_slack,
+                  stats.total_bytes);
+
+        /* a parse into the same node returns the old nodes first */
+        EXPECT_EQ(JSON_PARSE_OK, n.json_parse("[1]", options));
+        EXPECT_EQ(6, allocator.get_deallocations());
+    }
+    EXPECT_EQ(0, allocator.get_bytes());
+    EXPECT_EQ(allocator.get_allocations(), allocator.get_deallocations());
+
+    /* a budget fails the parse cleanly and frees what was built */
+    JsonCountingAllocator budget(allocator.get_peak_bytes() / 2);
+    options.allocator = &budget;
+    JsonNode n;
+    EXPECT_EQ(JSON_PARSE_OUT_OF_MEMORY, n.json_parse(json, options));
+    EXPECT_EQ(JSON_TYPE_NULL, n.get_type());
+    EXPECT_EQ(1, budget.get_failures());
+    EXPECT_EQ(0, budget.get_bytes());
+}
+
+TEST(TestJson, test_parse_limits) {
+    JsonNode n;
+    JsonParseOptions options;
+    JsonParseResult result;
+    const char* json = "{\"a\":[1,[2,[3]]],\"bc\":\"xyz\"}";
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+
+    options.max_input_bytes = strlen(json);
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    options.max_input_bytes = 10;
+    EXPECT_EQ(JSON_PARSE_INPUT_TOO_LARGE, n.json_parse(json, options, result));
+    EXPECT_EQ(10, result.offset);
+    EXPECT_EQ(JSON_TYPE_NULL, n.get_type());
+    options = JsonParseOptions();
+
+    options.max_depth = 4;
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    options.max_depth = 3;
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, n.json_parse(json, options, result));
+    EXPECT_EQ(11, result.offset);
+    EXPECT_EQ(JSON_TYPE_NULL, n.get_type());
+    options = JsonParseOptions();
+
+    options.max_members = 2;
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    EXPECT_EQ(JSON_PARSE_TOO_MANY_MEMBERS, n.json_parse("[1,2,3]", options, result));
+    EXPECT_EQ(5, result.offset);
+    EXPECT_EQ(JSON_PARSE_TOO_MANY_MEMBERS, n.json_parse("{\"a\":1,\"b\":2,\"c\":3}", options));
+    options = JsonParseOptions();
+
+    /* the limit applies to keys too, and counts decoded bytes */
+    options.max_string_length = 3;
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("\"\\u00e9a\"", options));
+    EXPECT_EQ(JSON_PARSE_STRING_TOO_LONG, n.json_parse("[\"abcd\"]", options, result));
+    EXPECT_EQ(5, result.offset);
+    EXPECT_EQ(JSON_PARSE_STRING_TOO_LONG, n.json_parse("{\"abcd\":1}", options));
+    EXPECT_EQ(JSON_PARSE_STRING_TOO_LONG, n.json_parse("\"\\u00e9\\u00e9\"", options));
+    options = JsonParseOptions();
+
+    options.max_nodes = 7;
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    options.max_nodes = 6;
+    EXPECT_EQ(JSON_PARSE_TOO_MANY_NODES, n.json_parse(json, options));
+    EXPECT_EQ(JSON_TYPE_NULL, n.get_type());
+}
+
+TEST(TestJson, test_packed_array) {
+    JsonParseOptions options;
+    options.pack_numbers = true;
+    JsonNode n, plain;
+    const char* json = "{\"p\":[1,2.5,-300,0.5],\"m\":[1,2,\"x\",3],\"n\":[[1,2],[3,4]],\"e\":[]}";
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    ASSERT_EQ(JSON_PARSE_OK, plain.json_parse(json));
+    EXPECT_EQ(plain.json_stringify(), n.json_stringify());
+    EXPECT_TRUE(n.json_is_equal(&plain));
+    EXPECT_TRUE(plain.json_is_equal(&n));
+    JsonStringifyOptions pretty;
+    pretty.indent = 2;
+    EXPECT_EQ(plain.json_stringify(pretty), n.json_stringify(pretty));
+
+    JsonNode* p = n.find_object_value("p");
+    ASSERT_TRUE(p->is_packed_array());
+    EXPECT_EQ(4, p->get_array_size());
+    EXPECT_DOUBLE_EQ(2.5, p->get_packed_array()[1]);
+    EXPECT_DOUBLE_EQ(-300, p->get_array_number(2));
+    EXPECT_FALSE(n.find_object_value("m")->is_packed_array());
+    EXPECT_DOUBLE_EQ(3, n.find_object_value("m")->get_array_number(3));
+    EXPECT_TRUE(n.find_object_value("n")->get_array_index(1)->is_packed_array());
+    EXPECT_FALSE(n.find_object_value("e")->is_packed_array());
+
+    /* numbers keep it packed, editing or handing out nodes unpacks it */
+    p->pushback_array_number(7);
+    p->popback_array_element();
+    p->erase_array_element(0, 1);
+    EXPECT_TRUE(p->is_packed_array());
+    EXPECT_EQ("[2.5,-300,0.5]", p->json_stringify());
+    JsonNode copy(*p);
+    EXPECT_TRUE(copy.is_packed_array());
+
+    /* const readers and the encoders read the numbers where they are */
+    const JsonNode* readonly = p;
+    EXPECT_EQ(nullptr, readonly->get_array_index(1));
+    std::string cbor, msgpack;
+    json_to_cbor(p, cbor);
+    json_to_msgpack(p, msgpack);
+    JsonTape tape;
+    tape.build(p);
+    EXPECT_DOUBLE_EQ(-300, tape.root().get_array_index(1).get_number());
+    JsonNode unpacked, diff;
+    ASSERT_EQ(JSON_PARSE_OK, unpacked.json_parse("[2.5,-300,0.5]"));
+    json_diff(p, &unpacked, &diff);
+    EXPECT_EQ(0, diff.get_array_size());
+    JsonSchema schema;
+    ASSERT_EQ(JSON_PARSE_OK, diff.json_parse("{\"items\":{\"minimum\":0},\"enum\":[[2.5,-300,0.5]]}", options));
+    ASSERT_EQ(JSON_SCHEMA_OK, schema.compile(&diff));
+    EXPECT_EQ(JSON_SCHEMA_MISMATCH, schema.validate(p));
+    EXPECT_TRUE(p->is_packed_array());
+    ASSERT_EQ(JSON_PARSE_OK, diff.json_parse("[0]", options));
+    JsonPatch patch;
+    EXPECT_EQ(JSON_PATCH_INVALID_OPERATION, patch.compile(&diff));
+    EXPECT_TRUE(diff.is_packed_array());
+    ASSERT_EQ(JSON_PARSE_OK, json_from_cbor(cbor.data(), cbor.size(), &unpacked));
+    EXPECT_EQ("[2.5,-300,0.5]", unpacked.json_stringify());
+    ASSERT_EQ(JSON_PARSE_OK, json_from_msgpack(msgpack.data(), msgpack.size(), &unpacked));
+    EXPECT_EQ("[2.5,-300,0.5]", unpacked.json_stringify());
+    JsonNode* element = p->get_array_index(1);
+    EXPECT_FALSE(p->is_packed_array());
+    EXPECT_DOUBLE_EQ(-300, element->get_number());
+    EXPECT_EQ(element, p->get_array_index(1));
+    EXPECT_TRUE(copy.json_is_equal(p));
+    element->set_string("s");
+    EXPECT_FALSE(copy.json_is_equal(p));
+    EXPECT_FALSE(p->json_is_equal(&copy));
+
+    JsonMemoryStats stats;
+    copy.json_memory_stats(stats);
+    EXPECT_EQ(1, stats.node_count);
+    EXPECT_EQ(3, stats.packed_numbers);
+
+    std::vector<double> numbers = {1, 2};
+    copy.set_packed_array(numbers);
+    EXPECT_EQ("[1,2]", copy.json_stringify());
+
+    /* unpacked nodes come from the allocator of the parse */
+    JsonCountingAllocator counting;
+    options.allocator = &counting;
+    ASSERT_EQ(JSON_PARSE_OK, copy.json_parse("[[1,2,3]]", options));
+    size_t allocations = counting.get_allocations();
+    copy.get_array_index(0)->get_array_index(0);
+    EXPECT_EQ(allocations + 3, counting.get_allocations());
+    copy.set_null();
+    EXPECT_EQ(0u, counting.get_bytes());
+    options.allocator = nullptr;
+
+    options.max_members = 3;
+    EXPECT_EQ(JSON_PARSE_TOO_MANY_MEMBERS, n.json_parse("[1,2,3,4]", options));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, n.json_parse("[1 2]", options));
+    EXPECT_EQ(JSON_PARSE_INVALID_VALUE, n.json_parse("[1,-]", options));
+    EXPECT_EQ(JSON_TYPE_NULL, n.get_type());
+}
+
+TEST(TestJson, test_columnar) {
+    const char* json = "[{\"id\":1,\"name\":\"a\",\"ok\":true,\"dims\":{\"w\":2},\"tags\":[1]},"
+                       "{\"id\":2,\"name\":\"b\",\"ok\":null,\"dims\":{\"w\":3}},"
+                       "{\"name\":\"a\",\"id\":3,\"extra\":\"x\",\"id\":9},"
+                       "{\"id\":\"4\",\"name\":\"b\",\"ok\":false}]";
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json));
+    JsonColumnar a, b;
+    ASSERT_EQ(JSON_COLUMNAR_OK, a.convert(&n));
+    ASSERT_EQ(JSON_PARSE_OK, b.parse(json));
+    for (JsonColumnar* c : {&a, &b}) {
+        EXPECT_EQ(4, c->get_row_count());
+        EXPECT_EQ(6, c->get_column_count());
+        EXPECT_EQ("/id", c->get_column(0)->path);
+        EXPECT_EQ(nullptr, c->get_column(6));
+
+        //"4" turned the id column into JSON text; the repeated id kept 3.
+        const JsonColumn* id = c->find_column("/id");
+        ASSERT_NE(nullptr, id);
+        EXPECT_EQ(JSON_COLUMN_JSON, id->type);
+        EXPECT_EQ(std::vector<std::string>({"1", "2", "3", "\"4\""}), id->texts);
+
+        const JsonColumn* name = c->find_column("/name");
+        EXPECT_EQ(JSON_COLUMN_STRING, name->type);
+        EXPECT_EQ(std::vector<std::string>({"a", "b"}), name->dictionary);
+        EXPECT_EQ(std::vector<int32_t>({0, 1, 0, 1}), name->codes);
+
+        const JsonColumn* ok = c->find_column("/ok");
+        EXPECT_EQ(JSON_COLUMN_BOOLEAN, ok->type);
+        EXPECT_TRUE(ok->is_valid(0));
+        EXPECT_FALSE(ok->is_valid(1));
+        EXPECT_FALSE(ok->is_valid(2));
+        EXPECT_TRUE(ok->is_valid(3));
+        EXPECT_EQ(4, ok->booleans.size());
+
+        const JsonColumn* w = c->find_column("/dims/w");
+        EXPECT_EQ(JSON_COLUMN_NUMBER, w->type);
+        EXPECT_EQ(std::vector<double>({2, 3, 0, 0}), w->numbers);
+        EXPECT_EQ(std::vector<std::string>({"[1]", "", "", ""}), c->find_column("/tags")->texts);
+        EXPECT_EQ(nullptr, c->find_column("/dims"));
+    }
+
+    size_t count;
+    double result;
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.count("/ok", count));
+    EXPECT_EQ(2, count);
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.sum("/dims/w", result));
+    EXPECT_EQ(5, result);
+    EXPECT_EQ(JSON_COLUMNAR_NOT_NUMBER, a.sum("/id", result));
+    EXPECT_EQ(JSON_COLUMNAR_NO_COLUMN, a.sum("/missing", result));
+    std::vector<uint64_t> selection;
+    EXPECT_EQ(JSON_COLUMNAR_NOT_STRING, a.filter("/ok", "a", selection));
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.filter("/name", "b", selection));
+    EXPECT_EQ(std::vector<uint64_t>({0xa}), selection);
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.filter("/dims/w", JSON_COMPARE_GT, 2, selection));
+    EXPECT_EQ(std::vector<uint64_t>({0x2}), selection);
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.sum("/dims/w", result, &selection));
+    EXPECT_EQ(3, result);
+    selection.clear();
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.filter("/name", "z", selection));
+    EXPECT_EQ(JSON_COLUMNAR_OK, a.min("/dims/w", result, &selection));
+    EXPECT_TRUE(std::isnan(result));
+
+    //Past one bitmap word, with the full-word fast path.
+    std::string big = "[";
+    for (int i = 0; i < 200; i++) {
+        big += (i ? ",{\"v\":" : "{\"v\":") + std::to_string(i) + "}";
+    }
+    big += "]";
+    ASSERT_EQ(JSON_PARSE_OK, b.parse(big.c_str()));
+    EXPECT_EQ(JSON_COLUMNAR_OK, b.sum("/v", result));
+    EXPECT_EQ(19900, result);
+    selection.clear();
+    EXPECT_EQ(JSON_COLUMNAR_OK, b.filter("/v", JSON_COMPARE_GE, 100, selection));
+    EXPECT_EQ(JSON_COLUMNAR_OK, b.count("/v", count, &selection));
+    EXPECT_EQ(100, count);
+    EXPECT_EQ(JSON_COLUMNAR_OK, b.min("/v", result, &selection));
+    EXPECT_EQ(100, result);
+    EXPECT_EQ(JSON_COLUMNAR_OK, b.max("/v", result, &selection));
+    EXPECT_EQ(199, result);
+
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse("[{},1]"));
+    EXPECT_EQ(JSON_COLUMNAR_NOT_RECORDS, a.convert(&n));
+    EXPECT_EQ(0, a.get_column_count());
+    EXPECT_EQ(JSON_PARSE_UNEXPECTED_TYPE, b.parse("[{\"a\":1},2]"));
+    EXPECT_EQ(0, b.get_row_count());
+    EXPECT_NE(JSON_PARSE_OK, b.parse("[{\"a\":1}"));
+    EXPECT_EQ(JSON_PARSE_OK, b.parse("[]"));
+    EXPECT_EQ(0, b.get_column_count());
+}
+
+TEST(TestJson, test_document) {
+    JsonCountingAllocator counting;
+    JsonParseOptions options;
+    options.allocator = &counting;
+    const char* first = "{\"id\":1,\"name\":\"a fairly long string value\",\"a_rather_long_key_name\":[1,{\"x\":null}]}";
+    const char* second = "{\"id\":2,\"name\":\"another long string value\",\"a_rather_long_key_name\":[3,{\"x\":true}]}";
+    JsonDocument document;
+    ASSERT_EQ(JSON_PARSE_OK, document.parse(first, options));
+    EXPECT_EQ(first, document.get_root().json_stringify());
+    EXPECT_EQ(6, counting.get_allocations());
+    const JsonNode* name = document.get_root().get_object_value(1);
+
+    //A same-shape message lands in the same nodes.
+    ASSERT_EQ(JSON_PARSE_OK, document.parse(second, options));
+    EXPECT_EQ(second, document.get_root().json_stringify());
+    EXPECT_EQ(6, counting.get_allocations());
+    EXPECT_EQ(name, document.get_root().get_object_value(1));
+    EXPECT_EQ(0, document.get_spare_nodes());
+
+    //Smaller and larger trees take what they need and allocate the rest.
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[1,2]", options));
+    EXPECT_EQ("[1,2]", document.get_root().json_stringify());
+    EXPECT_EQ(4, document.get_spare_nodes());
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[[[[[[[[1]]]]]]]]", options));
+    EXPECT_EQ("[[[[[[[[1]]]]]]]]", document.get_root().json_stringify());
+    EXPECT_EQ(8, counting.get_allocations());
+    EXPECT_EQ(0, document.get_spare_nodes());
+
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, document.parse("{\"a\":[1,2] ]", options));
+    EXPECT_EQ(JSON_TYPE_NULL, document.get_root().get_type());
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("\"text\""));
+    EXPECT_EQ("text", document.get_root().get_string());
+
+    document.reset();
+    EXPECT_EQ(JSON_TYPE_NULL, document.get_root().get_type());
+    document.release();
+    EXPECT_EQ(0, document.get_spare_nodes());
+    EXPECT_EQ(counting.get_allocations(), counting.get_deallocations());
+    ASSERT_EQ(JSON_PARSE_OK, document.parse(first));
+    EXPECT_EQ(first, document.get_root().json_stringify());
+}
+
+TEST(TestJson, test_batch) {
+    std::vector<std::string> documents;
+    for (int i = 0; i < 1000; i++) {
+        if (i % 97 == 0) {
+            documents.push_back("{\"id\":" + std::to_string(i) + ",}");
+        } else {
+            documents.push_back("{\"id\":" + std::to_string(i) + ",\"tags\":[\"t" + std::to_string(i % 7) + "\"]}");
+        }
+    }
+    JsonBatch batch(4);
+    EXPECT_EQ(4, batch.get_thread_count());
+    for (int round = 0; round < 3; round++) {
+        EXPECT_EQ(JSON_PARSE_NOT_EXIST_KEY, batch.parse(documents));
+        ASSERT_EQ(documents.size(), batch.get_size());
+        for (size_t i = 0; i < documents.size(); i++) {
+            JsonNode expected;
+            int ret = expected.json_parse(documents[i].c_str());
+            EXPECT_EQ(ret, batch.get_result(i));
+            if (ret == JSON_PARSE_OK) {
+                EXPECT_EQ(expected.json_stringify(), batch.get_root(i).json_stringify());
+            }
+        }
+    }
+
+    const char* small[] = {"1", "[true]"};
+    EXPECT_EQ(JSON_PARSE_OK, batch.parse(small, 2));
+    EXPECT_EQ(2, batch.get_size());
+    EXPECT_EQ("[true]", batch.get_root(1).json_stringify());
+    EXPECT_EQ(JSON_PARSE_OK, batch.parse(small, 0));
+    EXPECT_EQ(JSON_PARSE_NOT_EXIST_KEY, batch.parse(documents));
+    EXPECT_EQ("{\"id\":999,\"tags\":[\"t5\"]}", batch.get_root(999).json_stringify());
+
+    JsonParseOptions options;
+    options.max_depth = 1;
+    const char* deep[] = {"[1]", "[[1]]"};
+    EXPECT_EQ(JSON_PARSE_TOO_DEEP, batch.parse(deep, 2, options));
+    EXPECT_EQ(JSON_PARSE_OK, batch.get_result(0));
+
+    JsonBatch single(1);
+    EXPECT_EQ(1, single.get_thread_count());
+    EXPECT_EQ(JSON_PARSE_NOT_EXIST_KEY, single.parse(documents));
+    EXPECT_EQ("{\"id\":1,\"tags\":[\"t1\"]}", single.get_root(1).json_stringify());
+}
+
+TEST(TestJson, test_reserve_exact) {
+    const char* json = "{\"a\":[1,2,3,[4,5],{\"b\":\"x,]}\",\"c\":[\"\\\"[\",\"y\"]}],\"d\":{},\"e\":[ ],"
+                       "\"f\":[6,7,8,9,10],\"g\":\"a string long enough to live on the heap, built a byte at a time\"}";
+    JsonNode plain, n;
+    ASSERT_EQ(JSON_PARSE_OK, plain.json_parse(json));
+    JsonMemoryStats before;
+    plain.json_memory_stats(before);
+    EXPECT_LT(0, before.container_slack);
+
+    JsonParseOptions options;
+    options.reserve_exact = true;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    EXPECT_EQ(plain.json_stringify(), n.json_stringify());
+    JsonMemoryStats reserved;
+    n.json_memory_stats(reserved);
+    EXPECT_EQ(0, reserved.container_slack);
+    EXPECT_LT(0, reserved.string_slack);
+
+    options.pack_numbers = true;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    EXPECT_EQ(plain.json_stringify(), n.json_stringify());
+    EXPECT_TRUE(n.find_object_value("f")->is_packed_array());
+
+    options = JsonParseOptions();
+    options.shrink_to_fit = true;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    EXPECT_EQ(plain.json_stringify(), n.json_stringify());
+    JsonMemoryStats shrunk;
+    n.json_memory_stats(shrunk);
+    EXPECT_EQ(0, shrunk.container_slack);
+    EXPECT_EQ(0, shrunk.string_slack);
+
+    //The counts are only reserve sizes: bad input still fails as before.
+    options.reserve_exact = true;
+    options.max_members = 2;
+    EXPECT_EQ(JSON_PARSE_TOO_MANY_MEMBERS, n.json_parse("[1,2,3]", options));
+    EXPECT_EQ(JSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, n.json_parse("[1,[2 3]]", options));
+    EXPECT_EQ(JSON_PARSE_MISS_DOUBLEDUOTE, n.json_parse("[\"1,2", options));
+    EXPECT_EQ(JSON_PARSE_OK, n.json_parse("[[1,2],{\"a\":1,\"b\":2}]", options));
+    EXPECT_EQ("[[1,2],{\"a\":1,\"b\":2}]", n.json_stringify());
+    //Containers that never close get no reserve, whatever their commas say.
+    options.max_members = INT_MAX;
+    EXPECT_EQ(JSON_PARSE_NOT_EXIST_KEY, n.json_parse(("{" + std::string(1 << 20, ',')).c_str(), options));
+    EXPECT_EQ(JSON_PARSE_INVALID_VALUE, n.json_parse(("[[" + std::string(1 << 20, ',') + "]").c_str(), options));
+    EXPECT_EQ(JSON_PARSE_INVALID_VALUE, n.json_parse("[,,,,]", options));
+}
+
+TEST(TestJson, test_iterator) {
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse("{\"a\":[1,2,3],\"b\":\"x\",\"c\":{}}"));
+    std::string keys;
+    for (auto member : n.members()) {
+        keys += member.key;
+    }
+    EXPECT_EQ("abc", keys);
+    EXPECT_EQ(3, n.members().size());
+    EXPECT_TRUE(n.find_object_value("c")->members().empty());
+
+    //Mutable iterators change the values in place.
+    JsonNode* a = n.find_object_value("a");
+    for (JsonNode& element : a->elements()) {
+        element.set_number(element.get_number() * 10);
+    }
+    EXPECT_EQ("[10,20,30]", a->json_stringify());
+    auto member = std::find_if(n.members().begin(), n.members().end(),
+                               [](JsonMember<JsonNode> m) { return m.value.get_type() == JSON_TYPE_STRING; });
+    ASSERT_NE(n.members().end(), member);
+    EXPECT_EQ("b", member->key);
+    member->value.set_string("y");
+    EXPECT_EQ("y", n.find_object_value("b")->get_string());
+
+    //Const iterators, random access and conversion.
+    const JsonNode& c = *a;
+    double sum = 0;
+    for (const JsonNode& element : c.elements()) {
+        sum += element.get_number();
+    }
+    EXPECT_EQ(60, sum);
+    JsonElementIterator first = a->elements().begin();
+    JsonConstElementIterator last = c.elements().end();
+    JsonConstElementIterator converted = first;
+    EXPECT_EQ(3, last - converted);
+    EXPECT_EQ(3, std::distance(converted, last));
+    EXPECT_EQ(20, first[1].get_number());
+    EXPECT_EQ(30, (first + 2)->get_number());
+    EXPECT_EQ(30, (2 + first)->get_number());
+    EXPECT_TRUE(converted < last && first + 3 == a->elements().end());
+    auto iter = first;
+    EXPECT_EQ(10, (iter++)->get_number());
+    EXPECT_EQ(20, iter->get_number());
+    iter += 2;
+    --iter;
+    EXPECT_EQ(30, iter->get_number());
+    std::vector<double> numbers;
+    std::transform(c.elements().begin(), c.elements().end(), std::back_inserter(numbers),
+                   [](const JsonNode& element) { return element.get_number(); });
+    EXPECT_EQ(std::vector<double>({10, 20, 30}), numbers);
+    const JsonNode& object = n;
+    EXPECT_EQ("a", object.members().begin()[0].key);
+    EXPECT_EQ(JSON_TYPE_OBJECT, (object.members().end() - 1)->value.get_type());
+
+    //Packed arrays are unpacked on first iteration.
+    JsonParseOptions options;
+    options.pack_numbers = true;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse("[4,5]", options));
+    sum = 0;
+    for (const JsonNode& element : n.elements()) {
+        sum += element.get_number();
+    }
+    EXPECT_EQ(9, sum);
+    EXPECT_FALSE(n.is_packed_array());
+}
+
+TEST(TestJson, test_dedup) {
+    const char* json = "[{\"sku\":1,\"price\":{\"currency\":\"USD\",\"unit\":\"kg\"},\"tags\":[\"a\",\"b\"]},"
+                       "{\"sku\":2,\"price\":{\"currency\":\"USD\",\"unit\":\"kg\"},\"tags\":[\"a\",\"b\"]},"
+                       "{\"sku\":3,\"price\":{\"unit\":\"kg\",\"currency\":\"USD\"},\"tags\":[0,-0]}]";
+    auto n = new JsonNode();
+    ASSERT_EQ(JSON_PARSE_OK, n->json_parse(json));
+    std::string text = n->json_stringify();
+    JsonMemoryStats before;
+    n->json_memory_stats(before);
+
+    auto dedup = new JsonDedup();
+    JsonDedupStats stats;
+    dedup->dedup(n, stats);
+    EXPECT_EQ(text, n->json_stringify());
+    EXPECT_EQ(before.node_count - 1, stats.nodes);
+    EXPECT_LT(0, stats.shared);
+    EXPECT_LT(0, stats.bytes_saved);
+    EXPECT_EQ(before.node_count - 1 - stats.shared, dedup->get_size());
+
+    //Equal subtrees are one node; a different member order or -0 is not.
+    JsonNode* first = n->get_array_index(0);
+    JsonNode* second = n->get_array_index(1);
+    JsonNode* third = n->get_array_index(2);
+    EXPECT_EQ(first->find_object_value("price"), second->find_object_value("price"));
+    EXPECT_EQ(first->find_object_value("tags"), second->find_object_value("tags"));
+    EXPECT_NE(first->find_object_value("price"), third->find_object_value("price"));
+    EXPECT_EQ(first->find_object_value("price")->find_object_value("unit"),
+              third->find_object_value("price")->find_object_value("unit"));
+    JsonNode* tags = third->find_object_value("tags");
+    EXPECT_NE(tags->get_array_index(0), tags->get_array_index(1));
+    EXPECT_TRUE(first->find_object_value("price")->json_is_equal(third->find_object_value("price")));
+
+    //A second tree through the same pool shares with the first.
+    JsonNode other;
+    ASSERT_EQ(JSON_PARSE_OK, other.json_parse(json));
+    dedup->dedup(&other);
+    EXPECT_EQ(n->get_array_index(2), other.get_array_index(2));
+    EXPECT_TRUE(n->json_is_equal(&other));
+
+    //Detach and replace hand back nodes the caller owns alone.
+    JsonNode* price = second->detach_object_value(second->find_object_index("price"));
+    EXPECT_NE(first->find_object_value("price"), price);
+    price->set_null();
+    delete price;
+    EXPECT_EQ("{\"currency\":\"USD\",\"unit\":\"kg\"}", first->find_object_value("price")->json_stringify());
+    auto number = new JsonNode();
+    number->set_number(5);
+    delete tags->replace_array_element(0, number);
+    EXPECT_EQ("[5,-0]", tags->json_stringify());
+    n->popback_array_element();
+    n->erase_array_element(0, 1);
+
+    //The records edited above are shared with other, which sees the edits.
+    //The pool and the trees can go in either order.
+    std::string edited = other.json_stringify();
+    EXPECT_NE(text, edited);
+    JsonNode copy(other);
+    delete dedup;
+    EXPECT_EQ(edited, other.json_stringify());
+    delete n;
+    EXPECT_EQ(edited, other.json_stringify());
+    EXPECT_TRUE(copy.json_is_equal(&other));
+
+    //A recycling document gives shared nodes back to their other owners.
+    JsonDedup pool;
+    JsonDocument document;
+    ASSERT_EQ(JSON_PARSE_OK, document.parse(json));
+    pool.dedup(&document.get_root());
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[1]"));
+    ASSERT_EQ(JSON_PARSE_OK, document.parse(json));
+    EXPECT_EQ(text, document.get_root().json_stringify());
+
+    JsonParseOptions options;
+    options.pack_numbers = true;
+    ASSERT_EQ(JSON_PARSE_OK, copy.json_parse("[[1,2],[1,2],[1,3]]", options));
+    pool.dedup(&copy, stats);
+    EXPECT_EQ(copy.get_array_index(0), copy.get_array_index(1));
+    EXPECT_NE(copy.get_array_index(0), copy.get_array_index(2));
+    EXPECT_EQ("[[1,2],[1,2],[1,3]]", copy.json_stringify());
+}
+
+TEST(TestJson, test_stringify_cached) {
+    auto cache_bytes = [](const JsonNode* node) {
+        JsonMemoryStats stats;
+        node->json_memory_stats(stats);
+        return stats.cache_bytes;
+    };
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse("{\"a\":{\"x\":[1,2],\"y\":{\"z\":\"s\"}},\"b\":[{\"c\":true}],\"d\":0}"));
+    std::string text = n.json_stringify();
+    EXPECT_EQ(0u, cache_bytes(&n));
+    EXPECT_EQ(text, n.json_stringify_cached());
+    EXPECT_LT(0u, cache_bytes(&n));
+    EXPECT_EQ(text, n.json_stringify_cached());
+    EXPECT_EQ(text, n.json_stringify());
+
+    //Only the root keeps text; an edited leaf leaves it in place and the
+    //next call copies the unchanged parts from it.
+    JsonNode* a = n.find_object_value("a");
+    JsonNode* b = n.find_object_value("b");
+    EXPECT_EQ(0u, cache_bytes(a));
+    size_t cached = cache_bytes(&n);
+    a->find_object_value("y")->find_object_value("z")->set_string("t");
+    EXPECT_EQ(cached, cache_bytes(&n));
+    text = "{\"a\":{\"x\":[1,2],\"y\":{\"z\":\"t\"}},\"b\":[{\"c\":true}],\"d\":0}";
+    EXPECT_EQ(text, n.json_stringify());
+    EXPECT_EQ(text, n.json_stringify_cached());
+    EXPECT_EQ(text, n.json_stringify_cached());
+
+    //Called on a child, the cache of the tree above is read but not kept twice.
+    EXPECT_EQ("{\"x\":[1,2],\"y\":{\"z\":\"t\"}}", a->json_stringify_cached());
+    EXPECT_EQ(0u, cache_bytes(a));
+    a->find_object_value("x")->get_array_index(0)->set_number(0);
+    EXPECT_EQ("{\"x\":[0,2],\"y\":{\"z\":\"t\"}}", a->json_stringify_cached());
+    EXPECT_LT(0u, cache_bytes(a));
+    a->find_object_value("x")->get_array_index(0)->set_number(1);
+    EXPECT_EQ(text, n.json_stringify_cached());
+    EXPECT_EQ(cached, cache_bytes(&n));
+
+    //Every kind of edit reaches the root.
+    auto check = [&](const char* expect) {
+        EXPECT_EQ(expect, n.json_stringify());
+        EXPECT_EQ(expect, n.json_stringify_cached());
+        JsonNode fresh(n);
+        EXPECT_EQ(expect, fresh.json_stringify());
+    };
+    auto number = new JsonNode();
+    number->set_number(3);
+    a->find_object_value("x")->pushback_array_element(number);
+    check("{\"a\":{\"x\":[1,2,3],\"y\":{\"z\":\"t\"}},\"b\":[{\"c\":true}],\"d\":0}");
+    number->set_number(4);
+    check("{\"a\":{\"x\":[1,2,4],\"y\":{\"z\":\"t\"}},\"b\":[{\"c\":true}],\"d\":0}");
+    a->find_object_value("x")->erase_array_element(0, 1);
+    check("{\"a\":{\"x\":[2,4],\"y\":{\"z\":\"t\"}},\"b\":[{\"c\":true}],\"d\":0}");
+    delete b->detach_array_element(0);
+    check("{\"a\":{\"x\":[2,4],\"y\":{\"z\":\"t\"}},\"b\":[],\"d\":0}");
+    JsonNode* y = a->detach_object_value(a->find_object_index("y"));
+    y->set_null();
+    check("{\"a\":{\"x\":[2,4]},\"b\":[],\"d\":0}");
+    b->pushback_array_element(y);
+    check("{\"a\":{\"x\":[2,4]},\"b\":[null],\"d\":0}");
+    y->set_bool(true);
+    check("{\"a\":{\"x\":[2,4]},\"b\":[true],\"d\":0}");
+    ASSERT_EQ(JSON_PARSE_OK, a->find_object_value("x")->json_parse("{\"k\":[5]}"));
+    check("{\"a\":{\"x\":{\"k\":[5]}},\"b\":[true],\"d\":0}");
+    a->find_object_value("x")->find_object_value("k")->get_array_index(0)->set_number(6);
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[true],\"d\":0}");
+    JsonNode other;
+    ASSERT_EQ(JSON_PARSE_OK, other.json_parse("[\"o\"]"));
+    b->json_swap(&other);
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[\"o\"],\"d\":0}");
+    EXPECT_EQ("[true]", other.json_stringify_cached());
+    b->get_array_index(0)->set_string("p");
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[\"p\"],\"d\":0}");
+    other.get_array_index(0)->set_null();
+    EXPECT_EQ("[null]", other.json_stringify_cached());
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[\"p\"],\"d\":0}");
+    b->json_copy(&other);
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[null],\"d\":0}");
+
+    //Packed arrays, whose elements get their parent when unpacked.
+    JsonParseOptions options;
+    options.pack_numbers = true;
+    ASSERT_EQ(JSON_PARSE_OK, n.find_object_value("d")->json_parse("[1,2]", options));
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[null],\"d\":[1,2]}");
+    n.find_object_value("d")->pushback_array_number(3);
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[null],\"d\":[1,2,3]}");
+    n.find_object_value("d")->get_array_index(2)->set_number(-3);
+    check("{\"a\":{\"x\":{\"k\":[6]}},\"b\":[null],\"d\":[1,2,-3]}");
+
+    //The cache serves the streaming form, not the options-driven one.
+    std::string out;
+    JsonCallbackSink sink([&](const char* data, size_t size) {
+        out.append(data, size);
+        return true;
+    });
+    EXPECT_EQ(JSON_STRINGIFY_OK, n.json_stringify(sink, 4));
+    EXPECT_EQ(n.json_stringify(), out);
+    JsonStringifyOptions pretty;
+    pretty.indent = 1;
+    EXPECT_EQ("[\n 1,\n 2,\n -3\n]", n.find_object_value("d")->json_stringify(pretty));
+    n.clear_stringify_cache();
+    EXPECT_EQ(0u, cache_bytes(&n));
+
+    //A recycled document starts without cached text.
+    JsonDocument document;
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[{\"a\":[1]},{\"b\":2}]"));
+    EXPECT_EQ("[{\"a\":[1]},{\"b\":2}]", document.get_root().json_stringify_cached());
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[{\"a\":[3]},{\"b\":4}]"));
+    EXPECT_EQ(0u, cache_bytes(&document.get_root()));
+    EXPECT_EQ("[{\"a\":[3]},{\"b\":4}]", document.get_root().json_stringify_cached());
+
+    //Deep nesting keeps one copy of the text, not one per level.
+    std::string deep = std::string(10000, '[') + std::string(10000, ']');
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(deep.c_str()));
+    EXPECT_EQ(deep, n.json_stringify_cached());
+    EXPECT_GT(2 * deep.size(), cache_bytes(&n));
+    JsonNode* inner = &n;
+    for (int i = 0; i < 5000; i++) {
+        inner = inner->get_array_index(0);
+    }
+    inner->pushback_array_element(new JsonNode());
+    deep.insert(deep.size() - 5001, ",null");
+    EXPECT_EQ(deep, n.json_stringify_cached());
+    EXPECT_GT(2 * deep.size(), cache_bytes(&n));
+}
+
+TEST(TestJson, test_raw_numbers) {
+    JsonParseOptions options;
+    options.raw_numbers = true;
+    const char* json = "[1.10,1E2,-0,0.1,9223372036854775807,12345678901234567890,-5]";
+    JsonNode n;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(json, options));
+    EXPECT_EQ(json, n.json_stringify());
+    EXPECT_EQ(json, n.json_stringify_cached());
+    EXPECT_TRUE(n.get_array_index(0)->is_raw_number());
+    EXPECT_EQ("1.10", n.get_array_index(0)->get_number_text());
+    EXPECT_DOUBLE_EQ(1.1, n.get_array_index(0)->get_number());
+    EXPECT_DOUBLE_EQ(100, n.get_array_index(1)->get_number());
+    EXPECT_TRUE(std::signbit(n.get_array_index(2)->get_number()));
+    EXPECT_EQ("[1.10,1E2,-0,0.1,9223372036854775807,12345678901234567890,-5]", n.json_stringify());
+
+    long long integer = 0;
+    EXPECT_TRUE(n.get_array_index(1)->get_integer(integer));
+    EXPECT_EQ(100, integer);
+    EXPECT_FALSE(n.get_array_index(3)->get_integer(integer));
+    EXPECT_TRUE(n.get_array_index(4)->get_integer(integer));
+    EXPECT_EQ(9223372036854775807LL, integer);
+    EXPECT_FALSE(n.get_array_index(5)->get_integer(integer));
+    EXPECT_TRUE(n.get_array_index(6)->get_integer(integer));
+    EXPECT_EQ(-5, integer);
+
+    //Reads leave the token; set_number converts for good.
+    JsonNode raw;
+    ASSERT_EQ(JSON_PARSE_OK, raw.json_parse("0.1", options));
+    EXPECT_DOUBLE_EQ(0.1, raw.get_number());
+    EXPECT_TRUE(raw.is_raw_number());
+    raw.set_number(raw.get_number());
+    EXPECT_FALSE(raw.is_raw_number());
+    EXPECT_EQ("0.10000000000000001", raw.get_number_text());
+
+    //Edits, copies and comparisons.
+    JsonNode copy(n);
+    EXPECT_EQ(json, copy.json_stringify());
+    EXPECT_TRUE(copy.get_array_index(0)->is_raw_number());
+    JsonNode plain;
+    ASSERT_EQ(JSON_PARSE_OK, plain.json_parse(json));
+    EXPECT_FALSE(plain.get_array_index(0)->is_raw_number());
+    EXPECT_EQ("1.1000000000000001", plain.get_array_index(0)->get_number_text());
+    EXPECT_TRUE(n.json_is_equal(&plain));
+    n.get_array_index(0)->set_number(2.5);
+    EXPECT_FALSE(n.get_array_index(0)->is_raw_number());
+    EXPECT_EQ("[2.5,1E2,-0,0.1,9223372036854775807,12345678901234567890,-5]", n.json_stringify_cached());
+
+    //Equal values with different text stay apart when deduplicated.
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse("[[1.10],[1.1],[1.10]]", options));
+    JsonDedup dedup;
+    dedup.dedup(&n);
+    EXPECT_NE(n.get_array_index(0), n.get_array_index(1));
+    EXPECT_EQ(n.get_array_index(0), n.get_array_index(2));
+    EXPECT_EQ("[[1.10],[1.1],[1.10]]", n.json_stringify());
+
+    //The same errors as converting up front.
+    EXPECT_EQ(JSON_PARSE_NUMBER_TOO_BIG, n.json_parse("[1e400]", options));
+    EXPECT_EQ(JSON_PARSE_NUMBER_TOO_BIG, n.json_parse(("1" + std::string(400, '0')).c_str(), options));
+    EXPECT_EQ(JSON_PARSE_NOT_SINGLE_VALUE, n.json_parse("01", options));
+    EXPECT_EQ(JSON_PARSE_INVALID_VALUE, n.json_parse("[1.]", options));
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse(("1" + std::string(300, '0')).c_str(), options));
+    EXPECT_EQ(1e300, n.get_number());
+
+    //Packed arrays hold doubles, so packing wins.
+    options.pack_numbers = true;
+    ASSERT_EQ(JSON_PARSE_OK, n.json_parse("{\"a\":[1.10],\"b\":1.10}", options));
+    EXPECT_EQ("{\"a\":[1.1000000000000001],\"b\":1.10}", n.json_stringify());
+
+    //A recycled node drops the text when reused for a converted number.
+    JsonDocument document;
+    options.pack_numbers = false;
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[\"abc\",1.10]", options));
+    ASSERT_EQ(JSON_PARSE_OK, document.parse("[1.10,\"abc\"]"));
+    EXPECT_EQ("[1.1000000000000001,\"abc\"]", document.get_root().json_stringify());
 }
 
 int main(int argc, char* argv[]) {